@@ -0,0 +1,342 @@
+// chronofs_bench - microbenchmarks for ChronoFS hot paths.
+//
+// Usage: chronofs_bench [--quick] [--filter <substr>] [--out <file.json>]
+//
+// Results are written as a JSON array, one object per case:
+//   {"name": "...", "params": {...}, "iterations": N, "ns_per_op": X,
+//    "bytes_per_sec": Y}
+#include "util/Sha256.hpp"
+#include "vcs/Diff.hpp"
+#include "vcs/Index.hpp"
+#include "vcs/ObjectStore.hpp"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+
+    struct Result
+    {
+        std::string name;
+        std::vector<std::pair<std::string, std::string>> params; // value is raw JSON
+        long long iterations = 0;
+        double nsPerOp = 0;
+        double bytesPerOp = 0;
+    };
+
+    struct Options
+    {
+        bool quick = false;
+        std::string filter;
+        std::string out;
+    };
+
+    std::string jsonEscape(const std::string &s)
+    {
+        std::string o;
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+                o.push_back('\\');
+            o.push_back(c);
+        }
+        return o;
+    }
+
+    std::string param(long long v) { return std::to_string(v); }
+    std::string param(double v)
+    {
+        std::ostringstream oss;
+        oss << v;
+        return oss.str();
+    }
+
+    class Runner
+    {
+    public:
+        explicit Runner(const Options &opt) : opt_(opt) {}
+
+        bool enabled(const std::string &name) const
+        {
+            return opt_.filter.empty() || name.find(opt_.filter) != std::string::npos;
+        }
+
+        // Runs fn until at least minTime has elapsed (and minIters iterations).
+        // setup runs outside the timed region before each iteration when given.
+        void run(const std::string &name,
+                 std::vector<std::pair<std::string, std::string>> params,
+                 double bytesPerOp, const std::function<void()> &fn,
+                 long long minIters = 1, const std::function<void()> &setup = {})
+        {
+            if (!enabled(name))
+                return;
+            const auto minTime = std::chrono::milliseconds(opt_.quick ? 50 : 250);
+            Clock::duration total{};
+            long long iters = 0;
+            while (iters < minIters || total < minTime)
+            {
+                if (setup)
+                    setup();
+                auto t0 = Clock::now();
+                fn();
+                total += Clock::now() - t0;
+                iters++;
+            }
+            Result r;
+            r.name = name;
+            r.params = std::move(params);
+            r.iterations = iters;
+            r.nsPerOp = std::chrono::duration<double, std::nano>(total).count() / (double)iters;
+            r.bytesPerOp = bytesPerOp;
+            std::cerr << r.name;
+            for (auto &p : r.params)
+                std::cerr << ' ' << p.first << '=' << p.second;
+            std::cerr << "  " << r.nsPerOp / 1e3 << " us/op\n";
+            results_.push_back(std::move(r));
+        }
+
+        std::string json() const
+        {
+            std::ostringstream o;
+            o << "[\n";
+            for (size_t i = 0; i < results_.size(); i++)
+            {
+                auto &r = results_[i];
+                o << "  {\"name\": \"" << jsonEscape(r.name) << "\", \"params\": {";
+                for (size_t j = 0; j < r.params.size(); j++)
+                    o << (j ? ", " : "") << '"' << jsonEscape(r.params[j].first) << "\": " << r.params[j].second;
+                o << "}, \"iterations\": " << r.iterations
+                  << ", \"ns_per_op\": " << r.nsPerOp;
+                if (r.bytesPerOp > 0)
+                    o << ", \"bytes_per_sec\": " << r.bytesPerOp * 1e9 / r.nsPerOp;
+                o << '}' << (i + 1 < results_.size() ? "," : "") << '\n';
+            }
+            o << "]\n";
+            return o.str();
+        }
+
+    private:
+        const Options &opt_;
+        std::vector<Result> results_;
+    };
+
+    std::mt19937_64 rng(0xC4A0F5);
+
+    std::string randomBytes(size_t n)
+    {
+        std::string s(n, '\0');
+        for (auto &c : s)
+            c = static_cast<char>(rng() & 0xFF);
+        return s;
+    }
+
+    std::string randomLine()
+    {
+        static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789 _(){};=";
+        size_t len = 8 + rng() % 56;
+        std::string s(len, ' ');
+        for (auto &c : s)
+            c = alphabet[rng() % (sizeof(alphabet) - 1)];
+        return s;
+    }
+
+    std::string randomText(size_t lines)
+    {
+        std::string s;
+        for (size_t i = 0; i < lines; i++)
+            s += randomLine() + "\n";
+        return s;
+    }
+
+    std::string editText(const std::string &text, double ratio)
+    {
+        std::istringstream iss(text);
+        std::string line, out;
+        std::uniform_real_distribution<double> u(0, 1);
+        while (std::getline(iss, line))
+        {
+            double r = u(rng);
+            if (r < ratio / 3)
+                continue; // delete
+            if (r < 2 * ratio / 3)
+                out += randomLine() + "\n"; // insert before
+            if (r < ratio && r >= 2 * ratio / 3)
+                line = randomLine(); // replace
+            out += line + "\n";
+        }
+        return out;
+    }
+
+    std::string randomHash() { return util::Sha256::hashHex(randomBytes(16)); }
+
+    // Builds a synthetic monorepo-like path: dirs share prefixes, names repeat.
+    std::string syntheticPath(size_t i)
+    {
+        std::string p = "src";
+        size_t x = i;
+        for (int d = 0; d < 4; d++)
+        {
+            p += "/module_" + std::to_string(x % 17);
+            x /= 17;
+        }
+        return p + "/file_" + std::to_string(i) + ".cpp";
+    }
+
+    void benchSha(Runner &R)
+    {
+        for (size_t size : {64ull, 4096ull, 1ull << 20})
+        {
+            auto data = randomBytes(size);
+            R.run("sha256", {{"bytes", param((long long)size)}}, (double)size, [&]
+                  { volatile auto h = util::Sha256::hashHex(data); (void)h; }, 10);
+        }
+    }
+
+    void benchDiff(Runner &R, const Options &opt)
+    {
+        std::vector<size_t> sizes = {100, 1000};
+        if (!opt.quick)
+            sizes.push_back(3000);
+        for (size_t lines : sizes)
+        {
+            auto a = randomText(lines);
+            for (double ratio : {0.01, 0.1, 0.5})
+            {
+                auto b = editText(a, ratio);
+                R.run("diffText", {{"lines", param((long long)lines)}, {"edit_ratio", param(ratio)}},
+                      (double)(a.size() + b.size()), [&]
+                      { volatile auto n = vcs::diffText(a, b).size(); (void)n; });
+            }
+        }
+    }
+
+    void benchTree(Runner &R, const fs::path &dir)
+    {
+        vcs::ObjectStore store(dir);
+        for (size_t n : {16ull, 256ull, 4096ull})
+        {
+            std::vector<vcs::TreeEntry> entries;
+            for (size_t i = 0; i < n; i++)
+                entries.push_back({"100644", "file_" + std::to_string(i) + ".txt", randomHash()});
+            std::string h = store.writeTree(entries);
+            R.run("tree.write", {{"entries", param((long long)n)}}, 0, [&]
+                  { store.writeTree(entries); });
+            R.run("tree.read", {{"entries", param((long long)n)}}, 0, [&]
+                  { std::vector<vcs::TreeEntry> out; store.readTree(h, out); });
+        }
+    }
+
+    void benchObjects(Runner &R, const fs::path &dir)
+    {
+        vcs::ObjectStore store(dir);
+        for (size_t size : {1024ull, 64ull << 10, 1ull << 20})
+        {
+            std::string data;
+            R.run("object.write", {{"bytes", param((long long)size)}}, (double)size, [&]
+                  { store.writeBlob(data); }, 5, [&]
+                  { data = randomBytes(size); });
+            auto h = store.writeBlob(data);
+            R.run("object.write_existing", {{"bytes", param((long long)size)}}, (double)size, [&]
+                  { store.writeBlob(data); });
+            R.run("object.read", {{"bytes", param((long long)size)}}, (double)size, [&]
+                  { std::string out; store.readBlob(h, out); });
+        }
+    }
+
+    void benchIndex(Runner &R, const fs::path &dir, const Options &opt)
+    {
+        std::vector<size_t> sizes = {10000, 100000};
+        if (!opt.quick)
+            sizes.push_back(1000000);
+        // The filter may name a single case; build the index only if one runs.
+        if (!R.enabled("index.save") && !R.enabled("index.load") && !R.enabled("index.lookup"))
+            return;
+        for (size_t n : sizes)
+        {
+            vcs::Index idx(dir);
+            for (size_t i = 0; i < n; i++)
+                idx.add(syntheticPath(i), "100644", randomHash());
+            idx.save();
+            double bytes = (double)fs::file_size(idx.indexPath());
+            R.run("index.save", {{"entries", param((long long)n)}}, bytes, [&]
+                  { idx.save(); });
+            R.run("index.load", {{"entries", param((long long)n)}}, bytes, [&]
+                  { idx.load(); });
+            R.run("index.lookup", {{"entries", param((long long)n)}}, 0, [&]
+                  {
+                      size_t hits = 0;
+                      for (size_t i = 0; i < 1000; i++)
+                          hits += idx.has(syntheticPath((i * 7919) % n));
+                      volatile size_t h = hits;
+                      (void)h; });
+        }
+    }
+
+}
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string a = argv[i];
+        if (a == "--quick")
+            opt.quick = true;
+        else if (a == "--filter" && i + 1 < argc)
+            opt.filter = argv[++i];
+        else if (a == "--out" && i + 1 < argc)
+            opt.out = argv[++i];
+        else
+        {
+            std::cerr << "usage: chronofs_bench [--quick] [--filter <substr>] [--out <file.json>]\n";
+            return 1;
+        }
+    }
+
+    fs::path dir = fs::temp_directory_path() / ("chronofs-bench-" + std::to_string(getpid()));
+    fs::create_directories(dir / ".chronofs");
+
+    Runner R(opt);
+    benchSha(R);
+    benchDiff(R, opt);
+    benchTree(R, dir);
+    benchObjects(R, dir);
+    benchIndex(R, dir, opt);
+
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+
+    auto json = R.json();
+    if (opt.out.empty())
+    {
+        std::cout << json;
+    }
+    else
+    {
+        std::ofstream f(opt.out, std::ios::binary);
+        f << json;
+        if (!f)
+        {
+            std::cerr << "cannot write " << opt.out << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
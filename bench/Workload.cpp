@@ -0,0 +1,402 @@
+// chronofs_workload - end-to-end scale workload generator and regression report.
+//
+// Synthesizes a repository (file count, directory depth/fanout, file size
+// distribution, history length, churn per commit), then times the user-facing
+// operations through the Repository API. Results can be stored as a baseline
+// and later runs compared against it with per-operation regression thresholds.
+//
+// Usage: chronofs_workload [options]
+//   --files N            files in the initial tree           (default 2000)
+//   --depth D            maximum directory depth             (default 4)
+//   --fanout F           subdirectories per directory        (default 8)
+//   --min-size B         smallest file in bytes              (default 64)
+//   --max-size B         largest file in bytes               (default 65536)
+//   --dist uniform|log   file size distribution              (default log)
+//   --commits H          history length after the import     (default 20)
+//   --churn C            files modified per commit           (default 50)
+//   --seed S             RNG seed                            (default 1)
+//   --dir <path>         where to build the repo (kept); default temp, removed
+//   --out <file.json>    write this run's report
+//   --baseline <file>    compare against a stored report
+//   --threshold X        allowed slowdown ratio, e.g. 0.2 = +20% (default 0.25)
+//   --threshold op=X     per-operation override (repeatable)
+//
+// Exit status is 2 when any operation regressed beyond its threshold.
+#include "vcs/Repository.hpp"
+#include "fs/FileOps.hpp"
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+
+    struct Config
+    {
+        size_t files = 2000;
+        int depth = 4;
+        int fanout = 8;
+        size_t minSize = 64;
+        size_t maxSize = 64 << 10;
+        bool logDist = true;
+        size_t commits = 20;
+        size_t churn = 50;
+        unsigned long long seed = 1;
+        std::string dir, out, baseline;
+        double threshold = 0.25;
+        std::map<std::string, double> opThreshold;
+    };
+
+    class Generator
+    {
+    public:
+        explicit Generator(const Config &cfg) : cfg_(cfg), rng_(cfg.seed) {}
+
+        std::string randomPath()
+        {
+            std::string p;
+            int d = (int)(rng_() % (cfg_.depth + 1));
+            for (int i = 0; i < d; i++)
+                p += "d" + std::to_string(rng_() % cfg_.fanout) + "/";
+            return p + "f" + std::to_string(counter_++) + ".txt";
+        }
+
+        size_t randomSize()
+        {
+            double lo = (double)std::max<size_t>(cfg_.minSize, 1), hi = (double)std::max(cfg_.maxSize, cfg_.minSize);
+            std::uniform_real_distribution<double> u(0, 1);
+            if (cfg_.logDist)
+                return (size_t)std::exp(std::log(lo) + u(rng_) * (std::log(hi) - std::log(lo)));
+            return (size_t)(lo + u(rng_) * (hi - lo));
+        }
+
+        std::string content(size_t size)
+        {
+            static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789 _(){};=";
+            std::string s;
+            s.reserve(size);
+            while (s.size() < size)
+            {
+                size_t len = 8 + rng_() % 56;
+                for (size_t i = 0; i < len; i++)
+                    s.push_back(alphabet[rng_() % (sizeof(alphabet) - 1)]);
+                s.push_back('\n');
+            }
+            return s;
+        }
+
+        // Rewrites roughly a tenth of the lines so diffs stay small and realistic.
+        std::string mutate(const std::string &text)
+        {
+            std::istringstream iss(text);
+            std::string line, out;
+            while (std::getline(iss, line))
+            {
+                if (rng_() % 10 == 0)
+                    line = content(line.size()).substr(0, line.size());
+                out += line + "\n";
+            }
+            return out;
+        }
+
+        size_t pick(size_t n) { return (size_t)(rng_() % n); }
+
+    private:
+        const Config &cfg_;
+        std::mt19937_64 rng_;
+        size_t counter_ = 0;
+    };
+
+    template <class Fn>
+    double timeIt(Fn &&fn)
+    {
+        auto t0 = Clock::now();
+        fn();
+        return std::chrono::duration<double>(Clock::now() - t0).count();
+    }
+
+    std::string report(const Config &c, const std::vector<std::pair<std::string, double>> &timings)
+    {
+        std::ostringstream o;
+        o << "{\n  \"config\": {\"files\": " << c.files << ", \"depth\": " << c.depth
+          << ", \"fanout\": " << c.fanout << ", \"min_size\": " << c.minSize
+          << ", \"max_size\": " << c.maxSize << ", \"dist\": \"" << (c.logDist ? "log" : "uniform")
+          << "\", \"commits\": " << c.commits << ", \"churn\": " << c.churn
+          << ", \"seed\": " << c.seed << "},\n  \"timings\": {";
+        for (size_t i = 0; i < timings.size(); i++)
+            o << (i ? ", " : "") << "\n    \"" << timings[i].first << "\": " << timings[i].second;
+        o << "\n  }\n}\n";
+        return o.str();
+    }
+
+    // Reads the "timings" object of a report written by report(). False
+    // with `error` set when the file or one of its entries cannot be read.
+    bool loadBaseline(const std::string &path, std::map<std::string, double> &out, std::string &error)
+    {
+        std::string s;
+        if (!fsops::readFile(path, s))
+        {
+            error = "cannot read baseline " + path;
+            return false;
+        }
+        auto pos = s.find("\"timings\"");
+        if (pos == std::string::npos)
+        {
+            error = "no timings in baseline " + path;
+            return false;
+        }
+        pos = s.find('{', pos);
+        auto end = s.find('}', pos);
+        while (pos != std::string::npos && pos < end)
+        {
+            auto k0 = s.find('"', pos);
+            if (k0 == std::string::npos || k0 > end)
+                break;
+            auto k1 = s.find('"', k0 + 1);
+            auto colon = k1 == std::string::npos ? k1 : s.find(':', k1);
+            auto next = colon == std::string::npos ? colon : s.find(',', colon);
+            auto stop = std::min(next, end);
+            bool ok = colon != std::string::npos && colon < end;
+            if (ok)
+            {
+                try
+                {
+                    out[s.substr(k0 + 1, k1 - k0 - 1)] = std::stod(s.substr(colon + 1, stop - colon - 1));
+                }
+                catch (const std::exception &)
+                {
+                    ok = false;
+                }
+            }
+            if (!ok)
+            {
+                auto entry = s.substr(k0, std::min(stop, s.size()) - k0);
+                while (!entry.empty() && std::isspace((unsigned char)entry.back()))
+                    entry.pop_back();
+                error = "bad timing in baseline " + path + ": " + entry;
+                return false;
+            }
+            pos = next;
+        }
+        return true;
+    }
+
+    bool parseArgs(int argc, char **argv, Config &c)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string a = argv[i];
+            if (i + 1 >= argc)
+                return false;
+            std::string v = argv[++i];
+            if (a == "--files")
+                c.files = std::stoull(v);
+            else if (a == "--depth")
+                c.depth = std::max(0, std::stoi(v));
+            else if (a == "--fanout")
+                c.fanout = std::max(1, std::stoi(v));
+            else if (a == "--min-size")
+                c.minSize = std::stoull(v);
+            else if (a == "--max-size")
+                c.maxSize = std::stoull(v);
+            else if (a == "--dist" && (v == "log" || v == "uniform"))
+                c.logDist = v == "log";
+            else if (a == "--commits")
+                c.commits = std::stoull(v);
+            else if (a == "--churn")
+                c.churn = std::stoull(v);
+            else if (a == "--seed")
+                c.seed = std::stoull(v);
+            else if (a == "--dir")
+                c.dir = v;
+            else if (a == "--out")
+                c.out = v;
+            else if (a == "--baseline")
+                c.baseline = v;
+            else if (a == "--threshold")
+            {
+                auto eq = v.find('=');
+                if (eq == std::string::npos)
+                    c.threshold = std::stod(v);
+                else
+                    c.opThreshold[v.substr(0, eq)] = std::stod(v.substr(eq + 1));
+            }
+            else
+                return false;
+        }
+        return c.files > 0;
+    }
+
+}
+
+int main(int argc, char **argv)
+{
+    Config cfg;
+    try
+    {
+        if (!parseArgs(argc, argv, cfg))
+        {
+            std::cerr << "usage: see header of bench/Workload.cpp\n";
+            return 1;
+        }
+    }
+    catch (const std::exception &)
+    {
+        std::cerr << "invalid numeric argument\n";
+        return 1;
+    }
+
+    bool keep = !cfg.dir.empty();
+    fs::path root = keep ? fs::path(cfg.dir) : fs::temp_directory_path() / ("chronofs-workload-" + std::to_string(getpid()));
+    if (fs::exists(root / ".chronofs"))
+    {
+        std::cerr << root << " already contains a repository\n";
+        return 1;
+    }
+    fs::create_directories(root);
+
+    Generator gen(cfg);
+    std::vector<std::string> paths;
+    std::vector<std::pair<std::string, double>> timings;
+    auto record = [&](const std::string &op, double secs)
+    {
+        timings.emplace_back(op, secs);
+        std::cerr << op << "\t" << secs * 1e3 << " ms\n";
+    };
+
+    double genSecs = timeIt([&]
+                            {
+                                for (size_t i = 0; i < cfg.files; i++)
+                                {
+                                    paths.push_back(gen.randomPath());
+                                    fsops::writeFile(root / paths.back(), gen.content(gen.randomSize()));
+                                } });
+    std::cerr << "generated " << cfg.files << " files in " << genSecs * 1e3 << " ms\n";
+
+    std::vector<std::string> commits;
+    {
+        vcs::Repository repo(root);
+        repo.init();
+        record("add", timeIt([&]
+                             { repo.addPaths(std::vector<fs::path>(paths.begin(), paths.end())); }));
+        record("commit", timeIt([&]
+                                { commits.push_back(repo.commit("import", "workload").value_or("")); }));
+
+        // History: each commit rewrites `churn` random files.
+        double addSecs = 0, commitSecs = 0;
+        for (size_t h = 0; h < cfg.commits; h++)
+        {
+            std::vector<std::string> touched;
+            for (size_t k = 0; k < cfg.churn && !paths.empty(); k++)
+            {
+                auto &p = paths[gen.pick(paths.size())];
+                std::string data;
+                fsops::readFile(root / p, data);
+                fsops::writeFile(root / p, gen.mutate(data));
+                touched.push_back(p);
+            }
+            addSecs += timeIt([&]
+                              { repo.addPaths(std::vector<fs::path>(touched.begin(), touched.end())); });
+            commitSecs += timeIt([&]
+                                 { commits.push_back(repo.commit("change " + std::to_string(h), "workload").value_or("")); });
+        }
+        if (cfg.commits)
+        {
+            record("add_incremental", addSecs / cfg.commits);
+            record("commit_incremental", commitSecs / cfg.commits);
+        }
+    }
+
+    // Dirty part of the tree so status/diff have real work to report.
+    for (size_t k = 0; k < cfg.churn && !paths.empty(); k++)
+    {
+        auto &p = paths[gen.pick(paths.size())];
+        std::string data;
+        fsops::readFile(root / p, data);
+        fsops::writeFile(root / p, gen.mutate(data));
+    }
+
+    {
+        // Cold: a fresh Repository with no in-process state, as the CLI sees it.
+        double cold = timeIt([&]
+                             { vcs::Repository repo(root); repo.status(); });
+        record("status_cold", cold);
+        vcs::Repository repo(root);
+        repo.status();
+        record("status_warm", timeIt([&]
+                                     { repo.status(); }));
+        record("diff_index_working", timeIt([&]
+                                            { repo.diff("INDEX", "WORKING"); }));
+        if (commits.size() >= 2)
+            record("diff_commits", timeIt([&]
+                                          { repo.diff(commits[commits.size() - 2], commits.back()); }));
+        record("log", timeIt([&]
+                             { repo.log({}, [](const vcs::Repository::LogEntry &e)
+                                        { return !vcs::Repository::formatLogEntry(e, false).empty(); }); }));
+        record("checkout_oldest", timeIt([&]
+                                         { repo.checkout(commits.front()); }));
+        record("checkout_latest", timeIt([&]
+                                         { repo.checkout(commits.back()); }));
+    }
+
+    if (!keep)
+    {
+        std::error_code ec;
+        fs::remove_all(root, ec);
+    }
+
+    auto json = report(cfg, timings);
+    if (!cfg.out.empty() && !fsops::writeFile(cfg.out, json))
+    {
+        std::cerr << "cannot write " << cfg.out << "\n";
+        return 1;
+    }
+    if (cfg.out.empty())
+        std::cout << json;
+
+    if (cfg.baseline.empty())
+        return 0;
+    std::map<std::string, double> base;
+    std::string error;
+    if (!loadBaseline(cfg.baseline, base, error))
+    {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    bool regressed = false;
+    std::cout << "\noperation              baseline(ms)   current(ms)   change   limit\n";
+    for (auto &t : timings)
+    {
+        auto it = base.find(t.first);
+        if (it == base.end() || it->second <= 0)
+            continue;
+        double limit = cfg.opThreshold.count(t.first) ? cfg.opThreshold[t.first] : cfg.threshold;
+        double change = t.second / it->second - 1.0;
+        bool bad = change > limit;
+        regressed |= bad;
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-22s %12.2f %13.2f %+7.1f%% %+6.0f%%%s\n",
+                      t.first.c_str(), it->second * 1e3, t.second * 1e3, change * 100, limit * 100,
+                      bad ? "  REGRESSION" : "");
+        std::cout << line;
+    }
+    return regressed ? 2 : 0;
+}
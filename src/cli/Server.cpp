@@ -0,0 +1,378 @@
+#include "Server.hpp"
+#include "../fs/FileOps.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <streambuf>
+#include <thread>
+
+#ifdef __linux__
+#include <csignal>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace cli
+{
+
+    Server::Server(const fs::path &root) : root_(root) {}
+
+    long Server::readPid() const
+    {
+        std::string s;
+        if (!fsops::readFile(pidFile(), s))
+            return 0;
+        try
+        {
+            return std::stol(s);
+        }
+        catch (const std::exception &)
+        {
+            return 0;
+        }
+    }
+
+#ifdef __linux__
+
+    namespace
+    {
+        // Relative to the repository root: sun_path is too short for deep absolute paths.
+        const char *kSocketName = ".chronofs/serve.sock";
+
+        volatile std::sig_atomic_t stopRequested = 0;
+        void onSignal(int) { stopRequested = 1; }
+
+        bool writeAll(int fd, const std::string &s)
+        {
+            size_t off = 0;
+            while (off < s.size())
+            {
+                ssize_t n = ::write(fd, s.data() + off, s.size() - off);
+                if (n <= 0)
+                    return false;
+                off += (size_t)n;
+            }
+            return true;
+        }
+
+        bool readAll(int fd, std::string &s)
+        {
+            char buf[64 * 1024];
+            for (;;)
+            {
+                ssize_t n = ::read(fd, buf, sizeof(buf));
+                if (n < 0)
+                    return false;
+                if (n == 0)
+                    return true;
+                s.append(buf, (size_t)n);
+            }
+        }
+
+        bool socketAddress(const fs::path &root, sockaddr_un &addr, socklen_t &len)
+        {
+            // Clients run from the repository root (the CLI's cwd); the daemon chdirs there.
+            std::error_code ec;
+            if (fs::current_path(ec) != root)
+                return false;
+            addr = sockaddr_un{};
+            addr.sun_family = AF_UNIX;
+            std::snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", kSocketName);
+            len = (socklen_t)sizeof(addr);
+            return true;
+        }
+
+        // Frame: "<count>\n" then "<len>\n<bytes>" per field.
+        std::string encode(const std::vector<std::string> &fields)
+        {
+            std::string s = std::to_string(fields.size()) + "\n";
+            for (auto &f : fields)
+                s += std::to_string(f.size()) + "\n" + f;
+            return s;
+        }
+
+        // Decodes the frame at pos and advances past it; false if it is
+        // malformed or not yet complete.
+        bool decode(const std::string &s, size_t &pos, std::vector<std::string> &fields)
+        {
+            size_t start = pos;
+            auto fail = [&]
+            {
+                pos = start;
+                return false;
+            };
+            auto number = [&](size_t &v)
+            {
+                auto nl = s.find('\n', pos);
+                if (nl == std::string::npos)
+                    return false;
+                try
+                {
+                    v = std::stoull(s.substr(pos, nl - pos));
+                }
+                catch (const std::exception &)
+                {
+                    return false;
+                }
+                pos = nl + 1;
+                return true;
+            };
+            size_t count = 0;
+            if (!number(count))
+                return fail();
+            fields.clear();
+            for (size_t i = 0; i < count; i++)
+            {
+                size_t len = 0;
+                if (!number(len) || pos + len > s.size())
+                    return fail();
+                fields.push_back(s.substr(pos, len));
+                pos += len;
+            }
+            return true;
+        }
+
+        bool decode(const std::string &s, std::vector<std::string> &fields)
+        {
+            size_t pos = 0;
+            return decode(s, pos, fields) && pos == s.size();
+        }
+
+        // Replies are a sequence of frames: {"out", bytes} and {"err", bytes}
+        // as the command produces output, then {"rc", status}. ReplyBuf
+        // sends what a stream has buffered once it is large, on flush, or
+        // when output has waited a few milliseconds, so a long `log` or
+        // `grep` shows its first lines before it finishes.
+        class ReplyBuf : public std::streambuf
+        {
+        public:
+            ReplyBuf(int fd, const char *tag) : fd_(fd), tag_(tag) {}
+
+            bool send()
+            {
+                if (buf_.empty())
+                    return ok_;
+                ok_ = ok_ && writeAll(fd_, encode({tag_, buf_}));
+                buf_.clear();
+                last_ = std::chrono::steady_clock::now();
+                return ok_;
+            }
+
+        protected:
+            int_type overflow(int_type c) override
+            {
+                if (traits_type::eq_int_type(c, traits_type::eof()))
+                    return sync() == 0 ? traits_type::not_eof(c) : traits_type::eof();
+                char ch = traits_type::to_char_type(c);
+                return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+            }
+
+            std::streamsize xsputn(const char *s, std::streamsize n) override
+            {
+                if (!ok_)
+                    return 0;
+                buf_.append(s, (size_t)n);
+                if (buf_.size() >= kChunk || std::chrono::steady_clock::now() - last_ >= kLatency)
+                    send();
+                return ok_ ? n : 0;
+            }
+
+            int sync() override { return send() ? 0 : -1; }
+
+        private:
+            static constexpr size_t kChunk = 64 * 1024;
+            static constexpr std::chrono::milliseconds kLatency{20};
+
+            int fd_;
+            const char *tag_;
+            std::string buf_;
+            bool ok_ = true;
+            std::chrono::steady_clock::time_point last_ = std::chrono::steady_clock::now();
+        };
+    }
+
+    bool Server::supported() { return true; }
+
+    bool Server::running() const
+    {
+        long pid = readPid();
+        return pid > 0 && kill((pid_t)pid, 0) == 0;
+    }
+
+    int Server::run(const Handler &handler)
+    {
+        if (running())
+            return 1;
+        std::error_code ec;
+        fs::current_path(root_, ec);
+        if (ec)
+            return 1;
+        sockaddr_un addr;
+        socklen_t len;
+        if (!socketAddress(root_, addr, len))
+            return 1;
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            return 1;
+        ::unlink(kSocketName); // stale socket from a daemon that died
+        mode_t old = umask(077);
+        int rc = bind(fd, (sockaddr *)&addr, len);
+        umask(old);
+        if (rc != 0 || listen(fd, 64) != 0)
+        {
+            close(fd);
+            return 1;
+        }
+        fsops::writeFile(pidFile(), std::to_string(getpid()) + "\n");
+
+        struct sigaction sa{};
+        sa.sa_handler = onSignal; // no SA_RESTART: accept() must return on SIGTERM
+        sigaction(SIGTERM, &sa, nullptr);
+        sigaction(SIGINT, &sa, nullptr);
+        std::signal(SIGPIPE, SIG_IGN);
+        std::signal(SIGHUP, SIG_IGN);
+
+        while (!stopRequested)
+        {
+            int c = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (c < 0)
+                continue;
+            std::string req;
+            std::vector<std::string> args;
+            if (readAll(c, req) && decode(req, args))
+            {
+                ReplyBuf outBuf(c, "out"), errBuf(c, "err");
+                std::ostream out(&outBuf), err(&errBuf);
+                int status = 1;
+                try
+                {
+                    status = handler(args, out, err);
+                }
+                catch (const std::exception &e)
+                {
+                    err << "serve: " << e.what() << "\n";
+                }
+                // A client that went away (`log | head`) fails the sends and
+                // sets badbit, which stops streaming handlers early.
+                if (outBuf.send() && errBuf.send())
+                    writeAll(c, encode({"rc", std::to_string(status)}));
+            }
+            close(c);
+        }
+        close(fd);
+        ::unlink(kSocketName);
+        fs::remove(pidFile(), ec);
+        return 0;
+    }
+
+    bool Server::start(const Handler &handler)
+    {
+        if (running())
+            return true;
+        pid_t pid = fork();
+        if (pid < 0)
+            return false;
+        if (pid == 0)
+        {
+            setsid();
+            int devnull = ::open("/dev/null", O_RDWR);
+            if (devnull >= 0)
+            {
+                dup2(devnull, 0);
+                dup2(devnull, 1);
+                dup2(devnull, 2);
+            }
+            _exit(run(handler));
+        }
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            if (running())
+                return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    }
+
+    bool Server::stop()
+    {
+        long pid = readPid();
+        if (pid <= 0)
+            return false;
+        if (kill((pid_t)pid, SIGTERM) != 0)
+        {
+            std::error_code ec;
+            fs::remove(pidFile(), ec); // stale pid from a crashed daemon
+            return false;
+        }
+        return true;
+    }
+
+    bool Server::forward(const std::vector<std::string> &args, std::ostream &out, std::ostream &err, int &rc) const
+    {
+        sockaddr_un addr;
+        socklen_t len;
+        if (!socketAddress(root_, addr, len))
+            return false;
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            return false;
+        if (connect(fd, (sockaddr *)&addr, len) != 0)
+        {
+            close(fd);
+            return false;
+        }
+        // From here on the daemon may have run the command, so a failure is
+        // reported rather than handed back for a second, local run. Output
+        // frames are relayed as they arrive.
+        bool done = false;
+        if (writeAll(fd, encode(args)) && shutdown(fd, SHUT_WR) == 0)
+        {
+            std::string reply;
+            size_t pos = 0;
+            char buf[64 * 1024];
+            ssize_t n;
+            while (!done && (n = ::read(fd, buf, sizeof(buf))) > 0)
+            {
+                reply.append(buf, (size_t)n);
+                std::vector<std::string> fields;
+                while (!done && decode(reply, pos, fields) && fields.size() == 2)
+                {
+                    if (fields[0] == "out")
+                        out << fields[1] << std::flush;
+                    else if (fields[0] == "err")
+                        err << fields[1] << std::flush;
+                    else if (fields[0] == "rc")
+                    {
+                        rc = std::atoi(fields[1].c_str());
+                        done = true;
+                    }
+                }
+                reply.erase(0, pos);
+                pos = 0;
+            }
+        }
+        close(fd);
+        if (!done)
+        {
+            err << "no complete reply from the serve daemon; the command may or may not have run\n";
+            rc = 1;
+        }
+        return true;
+    }
+
+#else
+
+    bool Server::supported() { return false; }
+    bool Server::running() const { return false; }
+    int Server::run(const Handler &) { return 1; }
+    bool Server::start(const Handler &) { return false; }
+    bool Server::stop() { return false; }
+    bool Server::forward(const std::vector<std::string> &, std::ostream &, std::ostream &, int &) const { return false; }
+
+#endif
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <filesystem>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace cli
+{
+    namespace fs = std::filesystem;
+
+    // `chronofs serve`: a per-repository daemon listening on the Unix socket
+    // .chronofs/serve.sock. It keeps one Repository alive between commands so
+    // the index, parsed objects and working-tree stat cache stay warm; the CLI
+    // forwards its argv and relays output as the command produces it, then
+    // the exit status.
+    class Server
+    {
+    public:
+        using Handler = std::function<int(const std::vector<std::string> &args, std::ostream &out, std::ostream &err)>;
+
+        explicit Server(const fs::path &root);
+
+        static bool supported();
+
+        bool start(const Handler &handler); // fork a background daemon
+        bool stop();
+        bool running() const;
+        int run(const Handler &handler); // serve in the foreground until stopped
+
+        // Client side: false when no daemon accepted the connection, so the
+        // caller runs locally. Once the request is sent, a failure sets rc
+        // to 1 and writes an error instead.
+        bool forward(const std::vector<std::string> &args, std::ostream &out, std::ostream &err, int &rc) const;
+
+    private:
+        fs::path root_;
+
+        fs::path pidFile() const { return root_ / ".chronofs" / "serve.pid"; }
+        long readPid() const;
+    };
+
+}
@@ -1,5 +1,12 @@
 #include "../vcs/Repository.hpp"
+#include "../util/Trace.hpp"
+#include "../fs/FsMonitor.hpp"
+#include "Server.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
 #include <iostream>
+#include <optional>
 #include <vector>
 #include <string>
 
@@ -36,19 +43,91 @@ static void printBanner()
 
 using namespace vcs;
 
-static void printUsage()
+// Owns --trace/--stats output so every return path from main() flushes it.
+struct TraceSession
 {
-    std::cout <<
+    std::string traceFile;
+    bool stats = false;
+
+    ~TraceSession()
+    {
+        if (!util::Trace::enabled())
+            return;
+        util::Trace::stop();
+        if (!traceFile.empty() && !util::Trace::writeChromeTrace(traceFile))
+            std::cerr << "cannot write trace " << traceFile << "\n";
+        if (stats)
+            std::cerr << "\n"
+                      << util::Trace::summary();
+    }
+};
+
+// Strips global options from argv so commands keep their positional layout.
+static void parseGlobalOptions(int &argc, char **argv, TraceSession &session, bool &noDaemon)
+{
+    int out = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string a = argv[i];
+        if (a.rfind("--trace=", 0) == 0)
+            session.traceFile = a.substr(8);
+        else if (a == "--stats")
+            session.stats = true;
+        else if (a == "--no-daemon")
+            noDaemon = true;
+        else
+            argv[out++] = argv[i];
+    }
+    argc = out;
+    if (!session.traceFile.empty() || session.stats)
+        util::Trace::start(!session.traceFile.empty());
+}
+
+static void printUsage(std::ostream &out)
+{
+    out <<
         R"(chronofs - simple C++ versioned file manager
 
 Commands:
-  init
+  init [--raw-blobs]      # raw: header-less blobs, reflinked/copy_file_range'd on checkout
   add <path>...
-  commit -m "<message>" [-a author]
-  checkout <commit-hash>
+  commit -m "<message>" [-a author] [-t key=value]...   # -t tags the commit itself
+  import [<dir>] [-m msg] [-a author]   # parallel add + commit of a whole tree
+  checkout <branch|commit>  # a commit hash detaches HEAD
+  restore <rev> -- <path>...   # write just these files/directories from rev and stage them
+  branch [-d] [<name> [<rev>]]   # list, create at rev (default HEAD) or delete
+  worktree add <dir> <rev> | list | remove <dir>
+                          # extra working trees sharing this repository's objects and refs
+  fetch [--force] [--name <remote>] <path> [<branch>...]
+                          # copy another repository's branches to refs/remotes/<remote>/ (default origin)
+  push [--force] <path> [<branch>...]   # fast-forward the other repository's branches (default: current)
+  pack-refs               # move loose refs into the sorted packed-refs file
+  tag [-d] <key=value> <path>...   # stage (or remove) a tag on tracked paths; kept in later commits
+  tag list [<rev>] | find <key=value> [<rev>] | commits <key=value>
+                          # staged or committed tags; paths tagged at rev (default HEAD) or
+                          # commits carrying the tag, answered from the tag index
+  merge <rev> [-m msg] [-a author] | --abort
+                          # three-way merge; conflicts leave markers to resolve, add and commit
+  sparse set <dir>... | list | disable   # cone-mode sparse checkout, applied on next checkout
   status
-  log
-  diff <LEFT> <RIGHT>     # LEFT/RIGHT: WORKING | INDEX | HEAD | <commitHash>
+  grep [-F] [-i] [--history] [--jobs N] <pattern> [<rev>...]
+                          # ECMAScript regex (or -F literal) over the working tree, the revisions,
+                          # or every commit; each distinct blob is scanned once
+  blame [<rev>] <path>    # commit, author and time that last changed each line
+  log [-n <count>] [--since <when>] [--until <when>] [--oneline] [<rev>]
+                          # first-parent history, streamed; <when>: epoch seconds or YYYY-MM-DD[ HH:MM[:SS]] (UTC)
+  diff [-M<n>] [-C] [--no-renames] <LEFT> <RIGHT>
+                          # LEFT/RIGHT: WORKING | INDEX | HEAD | <branch> | <commitHash>
+                          # renames/copies at >= n% similarity (default 50) are shown as such
+  gc [--jobs N] [--grace SECONDS] [--dry-run]   # delete unreachable objects
+  fsck [--jobs N] [--incremental]               # verify object hashes and references
+  fsmonitor [start|stop|status|run]   # inotify daemon that narrows status/diff WORKING
+  serve [start|stop|status|run]       # keep repository state warm; the CLI forwards to it
+
+Global options:
+  --trace=<file.json>     # write a Chrome trace of the command's hot phases
+  --stats                 # print per-phase timings and counters to stderr
+  --no-daemon             # run in this process even if `serve` is running
 
 FS helpers:
   fs-mkdir <dir>
@@ -58,51 +137,54 @@ FS helpers:
 )";
 }
 
-int main(int argc, char **argv)
+static bool parseCount(const std::string &s, size_t &out)
 {
-#ifdef _WIN32
-    enableANSI();
-#endif
-    printBanner();
+    if (s.empty() || s.size() > 18 || !std::all_of(s.begin(), s.end(), [](char c)
+                                  { return std::isdigit((unsigned char)c); }))
+        return false;
+    out = (size_t)std::stoull(s);
+    return true;
+}
 
-    std::filesystem::path root = std::filesystem::current_path();
-    Repository repo(root);
+// Seconds since the epoch for log --since/--until: a number of seconds, or
+// "YYYY-MM-DD" with an optional " HH:MM[:SS]" / "THH:MM[:SS]" (UTC).
+static std::optional<long long> parseTime(const std::string &s)
+{
+    size_t count = 0;
+    if (parseCount(s, count))
+        return (long long)count;
+    int y = 0, mo = 0, d = 0, h = 0, mi = 0, sec = 0;
+    char sep = 0;
+    int n = std::sscanf(s.c_str(), "%4d-%2d-%2d%c%2d:%2d:%2d", &y, &mo, &d, &sep, &h, &mi, &sec);
+    if (n < 3 || (n > 3 && n < 6) || (n > 3 && sep != ' ' && sep != 'T') ||
+        mo < 1 || mo > 12 || d < 1 || d > 31 || h > 23 || mi > 59 || sec > 60)
+        return std::nullopt;
+    // Days from the civil date (Howard Hinnant's algorithm), avoiding timegm.
+    y -= mo <= 2;
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    long long yoe = y - era * 400;
+    long long doy = (153 * (mo + (mo > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    long long days = era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+    return days * 86400 + h * 3600 + mi * 60 + sec;
+}
 
-    if (argc < 2)
-    {
-        printUsage();
-        return 0;
-    }
+// Runs one repository command. Shared by the CLI and `chronofs serve`, so all
+// output goes through out/err rather than the process streams.
+static int runCommand(Repository &repo, const std::vector<std::string> &argv, std::ostream &out, std::ostream &err)
+{
+    int argc = (int)argv.size();
     std::string cmd = argv[1];
 
-    if (cmd == "init")
-    {
-        if (repo.init())
-            std::cout << "Initialized empty repository in .chronofs\n";
-        else
-            std::cout << "Init failed\n";
-        return 0;
-    }
-
-    if (!repo.isInitialized())
-    {
-        std::cerr << "Not a chronofs repository (run `chronofs init`)\n";
-        return 1;
-    }
-
     if (cmd == "add")
     {
-        bool ok = true;
-        for (int i = 2; i < argc; i++)
-        {
-            ok &= repo.addPath(argv[i]);
-        }
-        std::cout << (ok ? "Added\n" : "Add failed\n");
+        bool ok = repo.addPaths(std::vector<std::filesystem::path>(argv.begin() + 2, argv.end()));
+        out << (ok ? "Added\n" : "Add failed\n");
         return ok ? 0 : 1;
     }
     else if (cmd == "commit")
     {
         std::string msg, author = "user";
+        std::vector<std::string> tags;
         for (int i = 2; i < argc; i++)
         {
             std::string a = argv[i];
@@ -114,34 +196,347 @@ int main(int argc, char **argv)
             {
                 author = argv[++i];
             }
+            else if ((a == "-t" || a == "--tag") && i + 1 < argc)
+            {
+                tags.push_back(argv[++i]);
+            }
         }
         if (msg.empty())
         {
-            std::cerr << "commit requires -m \"message\"\n";
+            err << "commit requires -m \"message\"\n";
             return 1;
         }
-        auto h = repo.commit(msg, author);
+        for (auto &t : tags)
+            if (!validTag(t))
+            {
+                err << "bad tag " << t << " (expected key=value)\n";
+                return 1;
+            }
+        auto h = repo.commit(msg, author, tags);
         if (h)
         {
-            std::cout << "Committed " << *h << "\n";
+            out << "Committed " << *h << "\n";
             return 0;
         }
-        std::cout << "Commit failed\n";
+        out << "Commit failed (unresolved conflict markers, or the branch moved concurrently)\n";
         return 1;
     }
+    else if (cmd == "import")
+    {
+        std::string dir = ".", msg, author = "user";
+        for (int i = 2; i < argc; i++)
+        {
+            std::string a = argv[i];
+            if (a == "-m" && i + 1 < argc)
+                msg = argv[++i];
+            else if ((a == "-a" || a == "--author") && i + 1 < argc)
+                author = argv[++i];
+            else
+                dir = a;
+        }
+        ImportStats stats;
+        auto h = repo.importDir(dir, msg.empty() ? "Import " + dir : msg, author, stats);
+        if (!h)
+        {
+            err << "import failed (directory outside the repository, a merge in progress, or the index or HEAD changed concurrently)\n";
+            return 1;
+        }
+        out << "Imported " << stats.files << " files (" << stats.bytes << " bytes, " << stats.objectsWritten
+            << " new objects) in " << stats.dirs << " directories\n";
+        if (stats.failed)
+            out << "warning: " << stats.failed << " files or directories could not be read\n";
+        out << "Committed " << *h << "\n";
+        return stats.failed ? 1 : 0;
+    }
     else if (cmd == "checkout")
     {
         if (argc < 3)
         {
-            std::cerr << "checkout <commit-hash>\n";
+            err << "checkout <branch|commit>\n";
             return 1;
         }
         if (repo.checkout(argv[2]))
-            std::cout << "Checked out " << argv[2] << "\n";
+            out << "Checked out " << argv[2] << "\n";
         else
-            std::cout << "Checkout failed\n";
+            out << "Checkout failed (unknown revision, or the branch is checked out in another worktree)\n";
+        return 0;
+    }
+    else if (cmd == "restore")
+    {
+        if (argc < 5 || argv[3] != "--")
+        {
+            err << "restore <rev> -- <path>...\n";
+            return 1;
+        }
+        std::string error;
+        std::vector<std::string> paths(argv.begin() + 4, argv.end());
+        if (!repo.restore(argv[2], paths, error))
+        {
+            err << "restore failed: " << error << "\n";
+            return 1;
+        }
+        out << "Restored " << paths.size() << (paths.size() == 1 ? " path" : " paths") << " from " << argv[2] << "\n";
         return 0;
     }
+    else if (cmd == "worktree")
+    {
+        std::string sub = argc >= 3 ? argv[2] : "list";
+        std::string error;
+        if (sub == "list" && argc <= 3)
+        {
+            for (auto &w : repo.worktrees())
+                out << w.root.string() << "  " << (w.head.empty() ? "(unborn)" : w.head.substr(0, 12)) << "  "
+                    << (w.branch.empty() ? "(detached)" : "[" + w.branch.substr(w.branch.rfind("refs/heads/", 0) == 0 ? 11 : 0) + "]")
+                    << "\n";
+            return 0;
+        }
+        if (sub == "add" && argc == 5)
+        {
+            if (!repo.addWorktree(argv[3], argv[4], error))
+            {
+                err << "worktree add failed: " << error << "\n";
+                return 1;
+            }
+            out << "Prepared worktree " << argv[3] << " at " << argv[4] << "\n";
+            return 0;
+        }
+        if (sub == "remove" && argc == 4)
+        {
+            if (!repo.removeWorktree(argv[3], error))
+            {
+                err << "worktree remove failed: " << error << "\n";
+                return 1;
+            }
+            out << "Removed worktree " << argv[3] << "\n";
+            return 0;
+        }
+        err << "worktree add <dir> <rev> | worktree list | worktree remove <dir>\n";
+        return 1;
+    }
+    else if (cmd == "fetch" || cmd == "push")
+    {
+        bool force = false;
+        std::string name = "origin", remote;
+        std::vector<std::string> branches;
+        for (int i = 2; i < argc; i++)
+        {
+            std::string a = argv[i];
+            if (a == "--force" || a == "-f")
+                force = true;
+            else if (a == "--name" && i + 1 < argc && cmd == "fetch")
+                name = argv[++i];
+            else if (remote.empty())
+                remote = a;
+            else
+                branches.push_back(a);
+        }
+        if (remote.empty())
+        {
+            err << (cmd == "fetch" ? "fetch [--force] [--name <remote>] <path> [<branch>...]\n"
+                                   : "push [--force] <path> [<branch>...]\n");
+            return 1;
+        }
+        TransferStats stats;
+        std::vector<Repository::RefUpdate> updated;
+        std::string error;
+        bool ok = cmd == "fetch" ? repo.fetch(remote, branches, name, force, stats, updated, error)
+                                 : repo.push(remote, branches, force, stats, updated, error);
+        if (!ok)
+        {
+            err << cmd << " failed: " << error << "\n";
+            return 1;
+        }
+        if (updated.empty())
+        {
+            out << "Everything up to date\n";
+            return 0;
+        }
+        out << (cmd == "fetch" ? "Received " : "Sent ") << stats.objects << " objects (" << stats.bytes << " bytes, "
+            << stats.stored << " new) for " << stats.commits << " commits\n";
+        for (auto &u : updated)
+            out << "  " << (u.oldHash.empty() ? "* [new]     " : u.oldHash.substr(0, 12)) << " -> "
+                << u.newHash.substr(0, 12) << "  " << u.ref << "\n";
+        return 0;
+    }
+    else if (cmd == "branch")
+    {
+        if (argc == 2)
+        {
+            auto current = repo.currentHeadRef();
+            for (auto &b : repo.branches())
+                out << (current == "refs/heads/" + b ? "* " : "  ") << b << "\n";
+            return 0;
+        }
+        if (std::string(argv[2]) == "-d")
+        {
+            if (argc < 4)
+            {
+                err << "branch -d <name>\n";
+                return 1;
+            }
+            if (!repo.deleteBranch(argv[3]))
+            {
+                err << "cannot delete branch " << argv[3] << "\n";
+                return 1;
+            }
+            out << "Deleted branch " << argv[3] << "\n";
+            return 0;
+        }
+        std::string rev = argc > 3 ? argv[3] : "HEAD";
+        if (!repo.createBranch(argv[2], rev))
+        {
+            err << "cannot create branch " << argv[2] << " at " << rev << "\n";
+            return 1;
+        }
+        out << "Created branch " << argv[2] << "\n";
+        return 0;
+    }
+    else if (cmd == "pack-refs")
+    {
+        size_t packed = 0;
+        if (!repo.packRefs(packed))
+        {
+            err << "cannot write packed-refs\n";
+            return 1;
+        }
+        out << "Packed " << packed << " refs\n";
+        return 0;
+    }
+    else if (cmd == "tag")
+    {
+        std::string sub = argc >= 3 ? argv[2] : "";
+        if (sub == "list" && argc <= 4)
+        {
+            auto tags = argc == 4 ? repo.tagsAt(argv[3]) : std::make_optional(repo.stagedTags());
+            if (!tags)
+            {
+                err << "unknown revision " << argv[3] << "\n";
+                return 1;
+            }
+            for (auto &t : *tags)
+                out << (t.path.empty() ? "(commit)" : t.path) << "\t" << t.tag << "\n";
+            return 0;
+        }
+        if (sub == "find" && (argc == 4 || argc == 5))
+        {
+            std::string rev = argc == 5 ? argv[4] : "HEAD";
+            auto paths = repo.taggedPaths(argv[3], rev);
+            if (!paths)
+            {
+                err << "unknown revision " << rev << "\n";
+                return 1;
+            }
+            for (auto &p : *paths)
+                out << p << "\n";
+            return paths->empty() ? 1 : 0;
+        }
+        if (sub == "commits" && argc == 4)
+        {
+            auto commits = repo.taggedCommits(argv[3]);
+            for (auto &c : commits)
+                out << c << "\n";
+            return commits.empty() ? 1 : 0;
+        }
+        bool remove = sub == "-d";
+        int first = remove ? 3 : 2;
+        if (argc < first + 2 || !validTag(argv[first]))
+        {
+            err << "tag [-d] <key=value> <path>... | tag list [<rev>] | tag find <key=value> [<rev>] | tag commits <key=value>\n";
+            return 1;
+        }
+        if (!repo.tagPaths(argv[first], std::vector<std::string>(argv.begin() + first + 1, argv.end()), remove))
+        {
+            err << "tag failed (paths must be tracked; the tags file may be locked)\n";
+            return 1;
+        }
+        out << (remove ? "Untagged " : "Tagged ") << (argc - first - 1) << " paths\n";
+        return 0;
+    }
+    else if (cmd == "merge")
+    {
+        std::string rev, msg, author = "user";
+        bool abort = false;
+        for (int i = 2; i < argc; i++)
+        {
+            std::string a = argv[i];
+            if (a == "--abort")
+                abort = true;
+            else if (a == "-m" && i + 1 < argc)
+                msg = argv[++i];
+            else if ((a == "-a" || a == "--author") && i + 1 < argc)
+                author = argv[++i];
+            else
+                rev = a;
+        }
+        if (abort)
+        {
+            if (!repo.mergeAbort())
+            {
+                err << "no merge to abort\n";
+                return 1;
+            }
+            out << "Merge aborted\n";
+            return 0;
+        }
+        if (rev.empty())
+        {
+            err << "merge <rev> [-m msg] [-a author] | --abort\n";
+            return 1;
+        }
+        using Kind = Repository::MergeResult::Kind;
+        auto r = repo.merge(rev, author, msg);
+        switch (r.kind)
+        {
+        case Kind::UpToDate:
+            out << "Already up to date\n";
+            return 0;
+        case Kind::FastForward:
+            out << "Fast-forward to " << r.commit << "\n";
+            return 0;
+        case Kind::Merged:
+            out << "Merged " << rev << " as " << r.commit << "\n";
+            return 0;
+        case Kind::Conflicts:
+            for (auto &c : r.conflicts)
+                out << "CONFLICT (" << c.kind << ")\t" << c.path << "\n";
+            out << "Fix conflicts, add the files and commit; or merge --abort\n";
+            return 1;
+        case Kind::Failed:
+            break;
+        }
+        err << "merge failed: " << r.error << "\n";
+        return 1;
+    }
+    else if (cmd == "sparse")
+    {
+        std::string sub = argc >= 3 ? argv[2] : "list";
+        if (sub == "list")
+        {
+            auto spec = repo.sparseSpec();
+            for (auto &d : spec.dirs())
+                out << d << "\n";
+            return 0;
+        }
+        if (sub == "set" && argc >= 4)
+        {
+            std::vector<std::string> dirs(argv.begin() + 3, argv.end());
+            if (!repo.setSparseSpec(dirs))
+            {
+                err << "cannot write sparse-checkout\n";
+                return 1;
+            }
+            out << "Sparse checkout: " << dirs.size() << " directories; run checkout to apply\n";
+            return 0;
+        }
+        if (sub == "disable")
+        {
+            repo.setSparseSpec({});
+            out << "Sparse checkout disabled; run checkout to apply\n";
+            return 0;
+        }
+        err << "sparse set <dir>... | list | disable\n";
+        return 1;
+    }
     else if (cmd == "status")
     {
         auto s = repo.status();
@@ -149,73 +544,387 @@ int main(int argc, char **argv)
         {
             if (e.state == "clean")
             {
-                std::cout << "clean\n";
+                out << "clean\n";
                 break;
             }
-            std::cout << e.state << "\t" << e.path << "\n";
+            out << e.state << "\t" << e.path << "\n";
         }
         return 0;
     }
     else if (cmd == "log")
     {
-        auto lines = repo.log();
-        for (auto &l : lines)
-            std::cout << l;
+        Repository::LogOptions opt;
+        bool oneline = false, bad = false;
+        for (int i = 2; i < argc && !bad; i++)
+        {
+            std::string a = argv[i];
+            auto value = [&](const std::string &flag) -> std::optional<std::string>
+            {
+                if (a == flag && i + 1 < argc)
+                    return argv[++i];
+                if (a.rfind(flag + "=", 0) == 0)
+                    return a.substr(flag.size() + 1);
+                return std::nullopt;
+            };
+            std::optional<std::string> v;
+            if (a == "--oneline")
+                oneline = true;
+            else if ((v = value("-n")) || (v = value("--max-count")))
+                bad = !parseCount(*v, opt.maxCount);
+            else if (a.size() > 2 && a.rfind("-n", 0) == 0)
+                bad = !parseCount(a.substr(2), opt.maxCount);
+            else if (a.size() > 1 && a[0] == '-' && std::isdigit((unsigned char)a[1]))
+                bad = !parseCount(a.substr(1), opt.maxCount);
+            else if ((v = value("--since")) || (v = value("--after")))
+                bad = !(opt.since = parseTime(*v));
+            else if ((v = value("--until")) || (v = value("--before")))
+                bad = !(opt.until = parseTime(*v));
+            else if (a[0] != '-')
+                opt.start = a;
+            else
+                bad = true;
+        }
+        if (bad)
+        {
+            err << "log [-n <count>] [--since <when>] [--until <when>] [--oneline] [<rev>]\n";
+            return 1;
+        }
+        size_t shown = 0;
+        bool ok = repo.log(opt, [&](const Repository::LogEntry &e)
+                           {
+                               out << Repository::formatLogEntry(e, oneline);
+                               shown++;
+                               return (bool)out; });
+        if (!ok)
+        {
+            err << "unknown revision " << opt.start << "\n";
+            return 1;
+        }
+        if (shown == 0 && !repo.resolveHEAD())
+            out << "(no commits yet)\n";
+        return 0;
+    }
+    else if (cmd == "grep")
+    {
+        GrepOptions opt;
+        std::string pattern;
+        std::vector<std::string> revs;
+        bool havePattern = false, bad = false;
+        for (int i = 2; i < argc && !bad; i++)
+        {
+            std::string a = argv[i];
+            if (a == "-F" || a == "--fixed-strings")
+                opt.fixed = true;
+            else if (a == "-i" || a == "--ignore-case")
+                opt.ignoreCase = true;
+            else if (a == "--history")
+                opt.history = true;
+            else if (a == "--jobs" && i + 1 < argc)
+                bad = !parseCount(argv[++i], opt.jobs);
+            else if (a == "-e" && i + 1 < argc && !havePattern)
+                pattern = argv[++i], havePattern = true;
+            else if (!havePattern)
+                pattern = a, havePattern = true;
+            else
+                revs.push_back(a);
+        }
+        if (bad || !havePattern)
+        {
+            err << "grep [-F] [-i] [--history] [--jobs N] [-e] <pattern> [<rev>...]\n";
+            return 1;
+        }
+        size_t hits = 0;
+        std::string error;
+        bool ok = repo.grep(pattern, revs, opt, [&](const GrepHit &h)
+                            {
+                                hits++;
+                                auto where = h.target.empty() ? h.path
+                                                              : (opt.history ? h.target.substr(0, 12) : h.target) + ":" + h.path;
+                                if (h.line == 0)
+                                    out << "Binary file " << where << " matches\n";
+                                else
+                                    out << where << ":" << h.line << ":" << h.text << "\n";
+                                return (bool)out; }, error);
+        if (!ok)
+        {
+            err << error << "\n";
+            return 2;
+        }
+        return hits ? 0 : 1;
+    }
+    else if (cmd == "blame")
+    {
+        if (argc < 3 || argc > 4)
+        {
+            err << "blame [<rev>] <path>\n";
+            return 1;
+        }
+        std::string rev = argc == 4 ? argv[2] : "HEAD", path = argv[argc - 1];
+        auto lines = repo.blame(path, rev);
+        if (!lines)
+        {
+            err << "no such path " << path << " in " << rev << "\n";
+            return 1;
+        }
+        size_t width = std::to_string(lines->size()).size();
+        for (size_t k = 0; k < lines->size(); k++)
+        {
+            auto &l = (*lines)[k];
+            auto n = std::to_string(k + 1);
+            out << l.commit.substr(0, 12) << " (" << l.author << " " << l.time << " "
+                << std::string(width - n.size(), ' ') << n << ") " << l.text << "\n";
+        }
         return 0;
     }
     else if (cmd == "diff")
     {
-        if (argc < 4)
+        RenameOptions ropt;
+        std::vector<std::string> sides;
+        try
+        {
+            for (int i = 2; i < argc; i++)
+            {
+                const std::string &a = argv[i];
+                if (a == "--no-renames")
+                    ropt.detect = false;
+                else if (a == "-C")
+                    ropt.copies = true;
+                else if (a.rfind("-M", 0) == 0)
+                    ropt.threshold = a.size() > 2 ? std::stoi(a.substr(2)) / 100.0 : ropt.threshold;
+                else
+                    sides.push_back(a);
+            }
+        }
+        catch (const std::exception &)
         {
-            std::cerr << "diff <LEFT> <RIGHT>\n";
+            sides.clear();
+        }
+        if (sides.size() != 2)
+        {
+            err << "diff [-M<percent>] [-C] [--no-renames] <LEFT> <RIGHT>\n";
             return 1;
         }
-        std::cout << repo.diff(argv[2], argv[3]);
+        out << repo.diff(sides[0], sides[1], ropt);
+        return 0;
+    }
+    else if (cmd == "gc")
+    {
+        GcOptions opt;
+        bool bad = false;
+        for (int i = 2; i < argc && !bad; i++)
+        {
+            std::string a = argv[i];
+            size_t grace = 0;
+            if (a == "--jobs" && i + 1 < argc)
+                bad = !parseCount(argv[++i], opt.jobs);
+            else if (a == "--grace" && i + 1 < argc && parseCount(argv[++i], grace))
+                opt.graceSeconds = (long long)grace;
+            else if (a == "--dry-run")
+                opt.dryRun = true;
+            else
+                bad = true;
+        }
+        if (bad)
+        {
+            err << "gc [--jobs N] [--grace SECONDS] [--dry-run]\n";
+            return 1;
+        }
+        auto st = repo.gc(opt);
+        if (!st.error.empty())
+        {
+            err << "gc failed: " << st.error << "\n";
+            return 1;
+        }
+        out << (opt.dryRun ? "Would remove " : "Removed ") << st.removed << " objects ("
+            << st.bytesRemoved << " bytes) of " << st.scanned << "; "
+            << st.reachable << " reachable, " << st.keptRecent << " unreachable within grace period\n";
+        return 0;
+    }
+    else if (cmd == "fsck")
+    {
+        FsckOptions opt;
+        bool bad = false;
+        for (int i = 2; i < argc && !bad; i++)
+        {
+            std::string a = argv[i];
+            if (a == "--jobs" && i + 1 < argc)
+                bad = !parseCount(argv[++i], opt.jobs);
+            else if (a == "--incremental")
+                opt.incremental = true;
+            else
+                bad = true;
+        }
+        if (bad)
+        {
+            err << "fsck [--jobs N] [--incremental]\n";
+            return 1;
+        }
+        auto rep = repo.fsck(opt);
+        for (auto &p : rep.problems)
+            out << p << "\n";
+        out << "Checked " << rep.checked << " objects";
+        if (opt.incremental)
+            out << " (" << rep.skipped << " unchanged since last checkpoint)";
+        out << ", " << rep.references << " references: "
+            << (rep.problems.empty() ? "ok" : std::to_string(rep.problems.size()) + " problem(s)") << "\n";
+        return rep.problems.empty() ? 0 : 1;
+    }
+    else if (cmd == "fsmonitor")
+    {
+        fsops::FsMonitor monitor(repo.root());
+        std::string sub = argc >= 3 ? argv[2] : "status";
+        if (!fsops::FsMonitor::supported())
+        {
+            err << "fsmonitor is not supported on this platform\n";
+            return 1;
+        }
+        if (sub == "start")
+        {
+            bool ok = monitor.start();
+            out << (ok ? "fsmonitor running\n" : "fsmonitor failed to start\n");
+            return ok ? 0 : 1;
+        }
+        if (sub == "stop")
+        {
+            bool ok = monitor.stop();
+            out << (ok ? "fsmonitor stopped\n" : "fsmonitor not running\n");
+            return ok ? 0 : 1;
+        }
+        if (sub == "run")
+            return monitor.run();
+        out << (monitor.running() ? "fsmonitor running\n" : "fsmonitor not running\n");
         return 0;
     }
     else if (cmd == "fs-mkdir")
     {
         if (argc < 3)
         {
-            std::cerr << "fs-mkdir <dir>\n";
+            err << "fs-mkdir <dir>\n";
             return 1;
         }
-        std::cout << (repo.fsMkdirs(argv[2]) ? "ok\n" : "fail\n");
+        out << (repo.fsMkdirs(argv[2]) ? "ok\n" : "fail\n");
         return 0;
     }
     else if (cmd == "fs-touch")
     {
         if (argc < 3)
         {
-            std::cerr << "fs-touch <file>\n";
+            err << "fs-touch <file>\n";
             return 1;
         }
-        std::cout << (repo.fsTouch(argv[2]) ? "ok\n" : "fail\n");
+        out << (repo.fsTouch(argv[2]) ? "ok\n" : "fail\n");
         return 0;
     }
     else if (cmd == "fs-rm")
     {
         if (argc < 3)
         {
-            std::cerr << "fs-rm <path>\n";
+            err << "fs-rm <path>\n";
             return 1;
         }
-        std::cout << (repo.fsRemove(argv[2]) ? "ok\n" : "fail\n");
+        out << (repo.fsRemove(argv[2]) ? "ok\n" : "fail\n");
         return 0;
     }
     else if (cmd == "fs-mv")
     {
         if (argc < 4)
         {
-            std::cerr << "fs-mv <from> <to>\n";
+            err << "fs-mv <from> <to>\n";
             return 1;
         }
-        std::cout << (repo.fsMove(argv[2], argv[3]) ? "ok\n" : "fail\n");
+        out << (repo.fsMove(argv[2], argv[3]) ? "ok\n" : "fail\n");
         return 0;
     }
     else
     {
-        printUsage();
+        printUsage(out);
     }
     return 0;
 }
+
+// Commands that must run in this process rather than in a `serve` daemon.
+static bool runsLocally(const std::string &cmd)
+{
+    return cmd == "init" || cmd == "serve" || cmd == "fsmonitor";
+}
+
+int main(int argc, char **argv)
+{
+#ifdef _WIN32
+    enableANSI();
+#endif
+    printBanner();
+
+    TraceSession trace;
+    bool noDaemon = false;
+    parseGlobalOptions(argc, argv, trace, noDaemon);
+
+    std::filesystem::path root = std::filesystem::current_path();
+    Repository repo(root);
+
+    if (argc < 2)
+    {
+        printUsage(std::cout);
+        return 0;
+    }
+    std::string cmd = argv[1];
+    std::vector<std::string> args(argv, argv + argc);
+
+    if (cmd == "init")
+    {
+        bool raw = argc >= 3 && std::string(argv[2]) == "--raw-blobs";
+        if (repo.init(raw))
+            std::cout << "Initialized empty repository in .chronofs" << (raw ? " (raw blob layout)" : "") << "\n";
+        else
+            std::cout << "Init failed\n";
+        return 0;
+    }
+
+    if (!repo.isInitialized())
+    {
+        std::cerr << "Not a chronofs repository (run `chronofs init`)\n";
+        return 1;
+    }
+
+    // Hand the command to a warm `serve` daemon when one is listening. Traced
+    // runs stay local so the trace describes this process.
+    if (!noDaemon && !util::Trace::enabled() && !runsLocally(cmd))
+    {
+        int rc = 0;
+        if (cli::Server(root).forward(args, std::cout, std::cerr, rc))
+            return rc;
+    }
+
+    if (cmd == "serve")
+    {
+        cli::Server server(root);
+        std::string sub = argc >= 3 ? argv[2] : "status";
+        auto handler = [&repo](const std::vector<std::string> &a, std::ostream &out, std::ostream &err)
+        {
+            if (a.size() < 2 || runsLocally(a[1]))
+            {
+                err << "command not available through serve\n";
+                return 1;
+            }
+            return runCommand(repo, a, out, err);
+        };
+        if (sub == "start")
+        {
+            bool ok = server.start(handler);
+            std::cout << (ok ? "serve running\n" : "serve failed to start\n");
+            return ok ? 0 : 1;
+        }
+        if (sub == "stop")
+        {
+            bool ok = server.stop();
+            std::cout << (ok ? "serve stopped\n" : "serve not running\n");
+            return ok ? 0 : 1;
+        }
+        if (sub == "run")
+            return server.run(handler);
+        std::cout << (server.running() ? "serve running\n" : "serve not running\n");
+        return 0;
+    }
+
+    return runCommand(repo, args, std::cout, std::cerr);
+}
@@ -0,0 +1,384 @@
+#include "fs/AsyncIo.hpp"
+#include "fs/FileOps.hpp"
+#include "util/ThreadPool.hpp"
+#include "util/Trace.hpp"
+#include <algorithm>
+#include <functional>
+
+#if defined(__linux__) && !defined(CHRONOFS_NO_IO_URING) && __has_include(<linux/io_uring.h>)
+#define CHRONOFS_HAVE_URING 1
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace fsops
+{
+
+#ifdef CHRONOFS_HAVE_URING
+
+    // Minimal io_uring driver over the raw syscalls (no liburing dependency).
+    // Every batch is submitted and fully reaped before the next one, so the
+    // completion queue (twice the submission queue) can never overflow.
+    struct AsyncIo::Ring
+    {
+        int fd = -1;
+        unsigned entries = 0;
+        void *sqMap = MAP_FAILED, *cqMap = MAP_FAILED;
+        size_t sqMapLen = 0, cqMapLen = 0, sqesLen = 0;
+        io_uring_sqe *sqes = nullptr;
+        unsigned *sqTail = nullptr, *sqMask = nullptr, *sqArray = nullptr;
+        unsigned *cqHead = nullptr, *cqTail = nullptr, *cqMask = nullptr;
+        io_uring_cqe *cqes = nullptr;
+        unsigned tail = 0, queued = 0;
+
+        bool setup(unsigned depth)
+        {
+            io_uring_params p;
+            std::memset(&p, 0, sizeof(p));
+            fd = (int)::syscall(__NR_io_uring_setup, depth, &p);
+            if (fd < 0)
+                return false;
+            entries = p.sq_entries;
+            sqMapLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            cqMapLen = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+            bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+            if (single)
+                sqMapLen = cqMapLen = std::max(sqMapLen, cqMapLen);
+            sqMap = ::mmap(nullptr, sqMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            if (sqMap == MAP_FAILED)
+                return false;
+            cqMap = single ? sqMap : ::mmap(nullptr, cqMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cqMap == MAP_FAILED)
+                return false;
+            sqesLen = p.sq_entries * sizeof(io_uring_sqe);
+            void *s = ::mmap(nullptr, sqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+            if (s == MAP_FAILED)
+                return false;
+            sqes = static_cast<io_uring_sqe *>(s);
+            auto *sq = static_cast<char *>(sqMap);
+            auto *cq = static_cast<char *>(cqMap);
+            sqTail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+            sqMask = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+            sqArray = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+            cqHead = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+            cqTail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+            cqMask = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+            tail = *sqTail;
+            return probe();
+        }
+
+        // openat/statx/read/write/close all arrived in 5.6; so did the probe.
+        bool probe()
+        {
+            const size_t ops = 64;
+            std::vector<char> buf(sizeof(io_uring_probe) + ops * sizeof(io_uring_probe_op), 0);
+            auto *pr = reinterpret_cast<io_uring_probe *>(buf.data());
+            if (::syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, pr, ops) < 0)
+                return false;
+            for (int op : {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE})
+                if (op > pr->last_op || !(pr->ops[op].flags & IO_URING_OP_SUPPORTED))
+                    return false;
+            return true;
+        }
+
+        ~Ring()
+        {
+            if (sqes)
+                ::munmap(sqes, sqesLen);
+            if (cqMap != MAP_FAILED && cqMap != sqMap)
+                ::munmap(cqMap, cqMapLen);
+            if (sqMap != MAP_FAILED)
+                ::munmap(sqMap, sqMapLen);
+            if (fd >= 0)
+                ::close(fd);
+        }
+
+        io_uring_sqe *next(uint64_t userData)
+        {
+            unsigned idx = tail & *sqMask;
+            io_uring_sqe *sqe = &sqes[idx];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqe->user_data = userData;
+            sqArray[idx] = idx;
+            tail++;
+            queued++;
+            return sqe;
+        }
+
+        // Submits everything queued and calls onDone(user_data, res) for each
+        // completion. Returns false if the ring itself failed.
+        bool run(const std::function<void(uint64_t, int)> &onDone)
+        {
+            __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+            unsigned toSubmit = queued, outstanding = queued;
+            queued = 0;
+            while (outstanding > 0)
+            {
+                util::Trace::add(util::Counter::FsOps);
+                int r = (int)::syscall(__NR_io_uring_enter, fd, toSubmit, 1u, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (r < 0)
+                {
+                    if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                        continue;
+                    return false;
+                }
+                toSubmit -= std::min<unsigned>(toSubmit, (unsigned)r);
+                unsigned head = *cqHead;
+                unsigned ctail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+                while (head != ctail)
+                {
+                    auto &cqe = cqes[head & *cqMask];
+                    onDone(cqe.user_data, cqe.res);
+                    head++;
+                    outstanding--;
+                }
+                __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            }
+            return true;
+        }
+
+        void closeAll(const std::vector<int> &fds, std::vector<int> *results)
+        {
+            for (size_t i = 0; i < fds.size(); i++)
+            {
+                if (fds[i] < 0)
+                    continue;
+                auto *c = next(i);
+                c->opcode = IORING_OP_CLOSE;
+                c->fd = fds[i];
+            }
+            run([&](uint64_t i, int res)
+                { if (results) (*results)[i] = res; });
+        }
+    };
+
+    void AsyncIo::uringRead(std::vector<IoRequest> &reqs, size_t begin, size_t end)
+    {
+        size_t n = end - begin;
+        std::vector<int> fds(n, -1);
+        std::vector<struct statx> stx(n);
+        std::vector<size_t> done(n, 0);
+        std::vector<bool> statOk(n, false);
+
+        // Phase 1: open and stat every file in the window.
+        for (size_t i = 0; i < n; i++)
+        {
+            auto &r = reqs[begin + i];
+            r.ok = false;
+            auto *o = ring_->next(i * 2);
+            o->opcode = IORING_OP_OPENAT;
+            o->fd = AT_FDCWD;
+            o->addr = reinterpret_cast<uint64_t>(r.path.c_str());
+            o->open_flags = O_RDONLY | O_CLOEXEC;
+            auto *s = ring_->next(i * 2 + 1);
+            s->opcode = IORING_OP_STATX;
+            s->fd = AT_FDCWD;
+            s->addr = reinterpret_cast<uint64_t>(r.path.c_str());
+            s->len = STATX_SIZE;
+            s->off = reinterpret_cast<uint64_t>(&stx[i]);
+        }
+        bool alive = ring_->run([&](uint64_t u, int res)
+                                {
+                                    if (u % 2 == 0)
+                                        fds[u / 2] = res;
+                                    else
+                                        statOk[u / 2] = res == 0; });
+
+        // Phase 2: read whole files, resubmitting short reads.
+        for (size_t i = 0; i < n; i++)
+        {
+            auto &r = reqs[begin + i];
+            if (fds[i] >= 0 && statOk[i])
+            {
+                r.data.resize((size_t)stx[i].stx_size);
+                r.ok = r.data.empty();
+            }
+        }
+        for (bool pending = alive; pending && alive;)
+        {
+            pending = false;
+            for (size_t i = 0; i < n; i++)
+            {
+                auto &r = reqs[begin + i];
+                if (fds[i] < 0 || !statOk[i] || r.ok || done[i] == (size_t)-1)
+                    continue;
+                auto *q = ring_->next(i);
+                q->opcode = IORING_OP_READ;
+                q->fd = fds[i];
+                q->addr = reinterpret_cast<uint64_t>(&r.data[done[i]]);
+                q->len = (unsigned)std::min<size_t>(r.data.size() - done[i], 1u << 30);
+                q->off = done[i];
+                pending = true;
+            }
+            if (!pending)
+                break;
+            alive = ring_->run([&](uint64_t i, int res)
+                               {
+                                   auto &r = reqs[begin + i];
+                                   if (res < 0)
+                                   {
+                                       done[i] = (size_t)-1;
+                                       return;
+                                   }
+                                   util::Trace::add(util::Counter::BytesRead, (uint64_t)res);
+                                   if (res == 0)
+                                       r.data.resize(done[i]); // file shrank under us
+                                   else
+                                       done[i] += (size_t)res;
+                                   r.ok = done[i] == r.data.size(); });
+        }
+
+        // Phase 3: close.
+        if (alive)
+            ring_->closeAll(fds, nullptr);
+        else
+            for (int fd : fds)
+                if (fd >= 0)
+                    ::close(fd);
+    }
+
+    void AsyncIo::uringWrite(std::vector<IoRequest> &reqs, size_t begin, size_t end)
+    {
+        size_t n = end - begin;
+        std::vector<int> fds(n, -1), closed(n, -1);
+        std::vector<size_t> done(n, 0);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            auto &r = reqs[begin + i];
+            r.ok = false;
+            auto *o = ring_->next(i);
+            o->opcode = IORING_OP_OPENAT;
+            o->fd = AT_FDCWD;
+            o->addr = reinterpret_cast<uint64_t>(r.path.c_str());
+            o->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+            o->len = 0644;
+        }
+        bool alive = ring_->run([&](uint64_t i, int res)
+                                { fds[i] = res; });
+
+        std::vector<bool> failed(n, false);
+        for (bool pending = alive; pending && alive;)
+        {
+            pending = false;
+            for (size_t i = 0; i < n; i++)
+            {
+                auto &r = reqs[begin + i];
+                if (fds[i] < 0 || failed[i] || done[i] == r.data.size())
+                    continue;
+                auto *q = ring_->next(i);
+                q->opcode = IORING_OP_WRITE;
+                q->fd = fds[i];
+                q->addr = reinterpret_cast<uint64_t>(r.data.data() + done[i]);
+                q->len = (unsigned)std::min<size_t>(r.data.size() - done[i], 1u << 30);
+                q->off = done[i];
+                pending = true;
+            }
+            if (!pending)
+                break;
+            alive = ring_->run([&](uint64_t i, int res)
+                               {
+                                   if (res <= 0)
+                                   {
+                                       failed[i] = true;
+                                       return;
+                                   }
+                                   util::Trace::add(util::Counter::BytesWritten, (uint64_t)res);
+                                   done[i] += (size_t)res; });
+        }
+
+        if (alive)
+            ring_->closeAll(fds, &closed);
+        else
+            for (int fd : fds)
+                if (fd >= 0)
+                    ::close(fd);
+        for (size_t i = 0; i < n; i++)
+            reqs[begin + i].ok = alive && fds[i] >= 0 && !failed[i] && closed[i] == 0 &&
+                                 done[i] == reqs[begin + i].data.size();
+    }
+
+#else
+
+    struct AsyncIo::Ring
+    {
+        unsigned entries = 0;
+        bool setup(unsigned) { return false; }
+    };
+
+    void AsyncIo::uringRead(std::vector<IoRequest> &, size_t, size_t) {}
+    void AsyncIo::uringWrite(std::vector<IoRequest> &, size_t, size_t) {}
+
+#endif
+
+    AsyncIo::AsyncIo(unsigned depth)
+    {
+        ring_ = std::make_unique<Ring>();
+        if (!ring_->setup(std::max(depth, 2u)))
+            ring_.reset();
+    }
+
+    AsyncIo::~AsyncIo() = default;
+
+    util::ThreadPool &AsyncIo::pool()
+    {
+        if (!pool_)
+            pool_ = std::make_unique<util::ThreadPool>(std::min<size_t>(util::ThreadPool::defaultThreads(), 16));
+        return *pool_;
+    }
+
+    void AsyncIo::readFiles(std::vector<IoRequest> &reqs)
+    {
+        util::TraceScope scope("io.read");
+        if (ring_ && reqs.size() > 1)
+        {
+            // Two submissions (open + statx) per file must fit in one batch.
+            size_t window = std::max<size_t>(1, ring_->entries / 2);
+            for (size_t b = 0; b < reqs.size(); b += window)
+                uringRead(reqs, b, std::min(reqs.size(), b + window));
+            // Anything the ring could not handle is retried the plain way.
+            for (auto &r : reqs)
+                if (!r.ok)
+                    r.ok = readFile(r.path, r.data);
+            return;
+        }
+        if (reqs.size() <= 1)
+        {
+            for (auto &r : reqs)
+                r.ok = readFile(r.path, r.data);
+            return;
+        }
+        pool().parallelFor(reqs.size(), [&](size_t i)
+                           { reqs[i].ok = readFile(reqs[i].path, reqs[i].data); });
+    }
+
+    void AsyncIo::writeFiles(std::vector<IoRequest> &reqs)
+    {
+        util::TraceScope scope("io.write");
+        if (ring_ && reqs.size() > 1)
+        {
+            for (size_t b = 0; b < reqs.size(); b += ring_->entries)
+                uringWrite(reqs, b, std::min<size_t>(reqs.size(), b + ring_->entries));
+            for (auto &r : reqs)
+                if (!r.ok)
+                    r.ok = writeFile(r.path, r.data);
+            return;
+        }
+        if (reqs.size() <= 1)
+        {
+            for (auto &r : reqs)
+                r.ok = writeFile(r.path, r.data);
+            return;
+        }
+        pool().parallelFor(reqs.size(), [&](size_t i)
+                           { reqs[i].ok = writeFile(reqs[i].path, reqs[i].data); });
+    }
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace util
+{
+    class ThreadPool;
+}
+
+namespace fsops
+{
+    namespace fs = std::filesystem;
+
+    struct IoRequest
+    {
+        fs::path path;
+        std::string data; // filled by readFiles, consumed by writeFiles
+        bool ok = false;
+    };
+
+    // Whole-file reads and writes for many files at once. On Linux the opens,
+    // reads/writes and closes of a batch are each submitted to io_uring in one
+    // go, keeping the device queue full; when io_uring is unavailable (old
+    // kernel, seccomp, CHRONOFS_IO_URING=OFF) the files are spread over a
+    // thread pool instead. Not thread-safe: use one instance per thread.
+    class AsyncIo
+    {
+    public:
+        explicit AsyncIo(unsigned depth = 64);
+        ~AsyncIo();
+        AsyncIo(const AsyncIo &) = delete;
+        AsyncIo &operator=(const AsyncIo &) = delete;
+
+        bool usingUring() const { return ring_ != nullptr; }
+
+        void readFiles(std::vector<IoRequest> &reqs);
+        // Creates or truncates each file; parent directories must exist.
+        void writeFiles(std::vector<IoRequest> &reqs);
+
+    private:
+        struct Ring;
+        std::unique_ptr<Ring> ring_;
+        std::unique_ptr<util::ThreadPool> pool_;
+
+        util::ThreadPool &pool();
+        void uringRead(std::vector<IoRequest> &reqs, size_t begin, size_t end);
+        void uringWrite(std::vector<IoRequest> &reqs, size_t begin, size_t end);
+    };
+
+}
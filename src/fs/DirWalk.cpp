@@ -0,0 +1,252 @@
+#include "fs/DirWalk.hpp"
+#include "util/Trace.hpp"
+#include <algorithm>
+#include <chrono>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace fsops
+{
+
+    namespace
+    {
+        void sortEntries(std::vector<DirEntry> &out)
+        {
+            std::sort(out.begin(), out.end(), [](const DirEntry &a, const DirEntry &b)
+                      { return a.name < b.name; });
+        }
+
+#ifdef __linux__
+        int64_t toNs(const struct timespec &ts) { return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec; }
+
+        EntryType fromMode(mode_t m)
+        {
+            if (S_ISREG(m))
+                return EntryType::File;
+            if (S_ISDIR(m))
+                return EntryType::Dir;
+            if (S_ISLNK(m))
+                return EntryType::Symlink;
+            return EntryType::Other;
+        }
+
+        bool readFd(int fd, std::vector<DirEntry> &out)
+        {
+            alignas(struct dirent64) char buf[32 * 1024];
+            for (;;)
+            {
+                long n = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+                util::Trace::add(util::Counter::FsOps);
+                if (n < 0)
+                    return false;
+                if (n == 0)
+                    break;
+                for (long off = 0; off < n;)
+                {
+                    auto *d = reinterpret_cast<struct dirent64 *>(buf + off);
+                    off += d->d_reclen;
+                    const char *name = d->d_name;
+                    if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                        continue;
+                    EntryType type;
+                    switch (d->d_type)
+                    {
+                    case DT_REG:
+                        type = EntryType::File;
+                        break;
+                    case DT_DIR:
+                        type = EntryType::Dir;
+                        break;
+                    case DT_LNK:
+                        type = EntryType::Symlink;
+                        break;
+                    case DT_UNKNOWN:
+                    {
+                        // Some filesystems do not fill d_type.
+                        struct stat st;
+                        util::Trace::add(util::Counter::FsOps);
+                        type = fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 ? fromMode(st.st_mode) : EntryType::Other;
+                        break;
+                    }
+                    default:
+                        type = EntryType::Other;
+                    }
+                    out.push_back({name, type});
+                }
+            }
+            sortEntries(out);
+            return true;
+        }
+
+        bool walkFd(int fd, size_t depth, std::string &rel, const DirWalker::Visitor &visit)
+        {
+            std::vector<DirEntry> entries;
+            bool ok = readFd(fd, entries);
+            size_t base = rel.size();
+            for (auto &e : entries)
+            {
+                if (base)
+                    rel.push_back('/');
+                rel.append(e.name);
+                DirWalker::Entry entry{rel, e.name, e.type, depth};
+                entry.dirFd = fd;
+                if (visit(entry) && e.type == EntryType::Dir)
+                {
+                    util::Trace::add(util::Counter::FsOps);
+                    int sub = openat(fd, e.name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+                    if (sub >= 0)
+                    {
+                        util::Trace::add(util::Counter::FsOps); // close
+                        ok &= walkFd(sub, depth + 1, rel, visit);
+                        close(sub);
+                    }
+                    else
+                    {
+                        ok = false;
+                    }
+                }
+                rel.resize(base);
+            }
+            return ok;
+        }
+#else
+        EntryType typeOf(const fs::directory_entry &e)
+        {
+            std::error_code ec;
+            auto st = e.symlink_status(ec);
+            if (fs::is_symlink(st))
+                return EntryType::Symlink;
+            if (fs::is_directory(st))
+                return EntryType::Dir;
+            if (fs::is_regular_file(st))
+                return EntryType::File;
+            return EntryType::Other;
+        }
+
+        bool walkPath(const fs::path &dir, size_t depth, std::string &rel, const DirWalker::Visitor &visit)
+        {
+            std::vector<DirEntry> entries;
+            bool ok = readDir(dir, entries);
+            size_t base = rel.size();
+            for (auto &e : entries)
+            {
+                if (base)
+                    rel.push_back('/');
+                rel.append(e.name);
+                DirWalker::Entry entry{rel, e.name, e.type, depth};
+                entry.dirPath = &dir;
+                if (visit(entry) && e.type == EntryType::Dir)
+                    ok &= walkPath(dir / e.name, depth + 1, rel, visit);
+                rel.resize(base);
+            }
+            return ok;
+        }
+#endif
+    }
+
+#ifdef __linux__
+    bool statFile(const fs::path &p, FileStat &st)
+    {
+        struct stat s;
+        util::Trace::add(util::Counter::FsOps);
+        if (::stat(p.c_str(), &s) != 0)
+            return false;
+        st.mtimeNs = toNs(s.st_mtim);
+        st.size = (uintmax_t)s.st_size;
+        st.dir = S_ISDIR(s.st_mode);
+        return true;
+    }
+
+    int64_t nowNs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return toNs(ts);
+    }
+
+    bool readDir(const fs::path &dir, std::vector<DirEntry> &out)
+    {
+        util::Trace::add(util::Counter::FsOps);
+        int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        util::Trace::add(util::Counter::FsOps); // close
+        bool ok = readFd(fd, out);
+        close(fd);
+        return ok;
+    }
+
+    bool DirWalker::Entry::stat(FileStat &st) const
+    {
+        struct stat s;
+        util::Trace::add(util::Counter::FsOps);
+        if (fstatat(dirFd, name.data(), &s, 0) != 0)
+            return false;
+        st.mtimeNs = toNs(s.st_mtim);
+        st.size = (uintmax_t)s.st_size;
+        st.dir = S_ISDIR(s.st_mode);
+        return true;
+    }
+
+    bool DirWalker::walk(const fs::path &root, const std::string &relDir, const Visitor &visit)
+    {
+        util::TraceScope scope("walk.dir");
+        util::Trace::add(util::Counter::FsOps);
+        int fd = open((relDir.empty() ? root : root / relDir).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        util::Trace::add(util::Counter::FsOps); // close
+        std::string rel = relDir;
+        bool ok = walkFd(fd, 0, rel, visit);
+        close(fd);
+        return ok;
+    }
+#else
+    bool statFile(const fs::path &p, FileStat &st)
+    {
+        std::error_code ec;
+        auto t = fs::last_write_time(p, ec);
+        if (ec)
+            return false;
+        st.dir = fs::is_directory(p, ec);
+        st.size = st.dir ? 0 : fs::file_size(p, ec);
+        st.mtimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+        return !ec;
+    }
+
+    int64_t nowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   fs::file_time_type::clock::now().time_since_epoch())
+            .count();
+    }
+
+    bool readDir(const fs::path &dir, std::vector<DirEntry> &out)
+    {
+        std::error_code ec;
+        for (auto it = fs::directory_iterator(dir, ec); !ec && it != fs::directory_iterator(); it.increment(ec))
+            out.push_back({it->path().filename().string(), typeOf(*it)});
+        sortEntries(out);
+        return !ec;
+    }
+
+    bool DirWalker::Entry::stat(FileStat &st) const
+    {
+        return statFile(*dirPath / std::string(name), st);
+    }
+
+    bool DirWalker::walk(const fs::path &root, const std::string &relDir, const Visitor &visit)
+    {
+        util::TraceScope scope("walk.dir");
+        std::string rel = relDir;
+        return walkPath(relDir.empty() ? root : root / relDir, 0, rel, visit);
+    }
+#endif
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fsops
+{
+    namespace fs = std::filesystem;
+
+    enum class EntryType : unsigned char
+    {
+        File,
+        Dir,
+        Symlink,
+        Other
+    };
+
+    // Size and modification time in the units used by the working-tree
+    // stat cache; nowNs() is on the same clock as mtimeNs.
+    struct FileStat
+    {
+        int64_t mtimeNs = 0;
+        uintmax_t size = 0;
+        bool dir = false;
+    };
+    bool statFile(const fs::path &p, FileStat &st); // follows symlinks
+    int64_t nowNs();
+
+    struct DirEntry
+    {
+        std::string name;
+        EntryType type;
+    };
+
+    // One directory's entries (without "." and ".."), sorted by name. On Linux
+    // this is getdents64 on an open fd with the type taken from d_type, so
+    // no entry is stat'ed unless the filesystem leaves d_type unknown.
+    bool readDir(const fs::path &dir, std::vector<DirEntry> &out);
+
+    // Depth-first walk in sorted order. Directories are opened relative to
+    // their parent (openat) and each entry's path relative to the walk root
+    // is built in one reused buffer, so no path is re-derived or normalized.
+    class DirWalker
+    {
+    public:
+        struct Entry
+        {
+            const std::string &rel; // valid during the callback only
+            std::string_view name;
+            EntryType type;
+            size_t depth; // 0 for entries of the starting directory
+            // statFile() for this entry, resolved against the open directory.
+            bool stat(FileStat &st) const;
+
+            // Walker-private: the open directory (an fd on Linux, a path elsewhere).
+            int dirFd = -1;
+            const fs::path *dirPath = nullptr;
+        };
+        // Return true to descend into a directory entry; ignored for others.
+        using Visitor = std::function<bool(const Entry &)>;
+
+        // Walks root/relDir; entry paths are relative to root.
+        static bool walk(const fs::path &root, const std::string &relDir, const Visitor &visit);
+    };
+
+}
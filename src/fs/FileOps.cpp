@@ -1,5 +1,18 @@
 #include "fs/FileOps.hpp"
+#include "util/Trace.hpp"
+#include <atomic>
 #include <fstream>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace fsops
 {
@@ -35,24 +48,171 @@ namespace fsops
     bool writeFile(const fs::path &p, const std::string &data)
     {
         if (p.has_parent_path())
+        {
+            util::Trace::add(util::Counter::FsOps);
             std::filesystem::create_directories(p.parent_path());
+        }
+        util::Trace::add(util::Counter::FsOps);
         std::ofstream f(p, std::ios::binary);
         if (!f)
             return false;
+        util::Trace::add(util::Counter::FsOps, 2); // write, close
+        util::Trace::add(util::Counter::BytesWritten, data.size());
         f.write(data.data(), (std::streamsize)data.size());
-        return true;
+        f.close();
+        return !f.fail();
+    }
+    fs::path tempSibling(const fs::path &p)
+    {
+        static std::atomic<unsigned long> counter{0};
+#ifdef __linux__
+        auto pid = (unsigned long)::getpid();
+#else
+        auto pid = (unsigned long)std::hash<std::thread::id>()(std::this_thread::get_id());
+#endif
+        return p.parent_path() / ("tmp_" + p.filename().string() + "_" + std::to_string(pid) + "_" + std::to_string(counter++));
+    }
+    bool writeFileAtomic(const fs::path &p, const std::string &data)
+    {
+        auto tmp = tempSibling(p);
+        std::error_code ec;
+        if (!writeFile(tmp, data))
+        {
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+        util::Trace::add(util::Counter::FsOps);
+        std::filesystem::rename(tmp, p, ec);
+        if (!ec)
+            return true;
+        util::Trace::add(util::Counter::FsOps);
+        std::filesystem::remove(tmp, ec);
+        return false;
     }
     bool readFile(const fs::path &p, std::string &out)
     {
+        util::Trace::add(util::Counter::FsOps);
         std::ifstream f(p, std::ios::binary);
         if (!f)
             return false;
+        util::Trace::add(util::Counter::FsOps, 3); // seek, read, close
         f.seekg(0, std::ios::end);
         std::streamsize size = f.tellg();
         f.seekg(0, std::ios::beg);
         out.resize((size_t)size);
         if (size > 0)
             f.read(&out[0], size);
+        util::Trace::add(util::Counter::BytesRead, out.size());
         return true;
     }
+    bool streamFile(const fs::path &p, const std::function<bool(const char *, size_t)> &fn, size_t chunk)
+    {
+        util::Trace::add(util::Counter::FsOps);
+        std::ifstream f(p, std::ios::binary);
+        if (!f)
+            return false;
+        util::Trace::add(util::Counter::FsOps); // close
+        std::vector<char> buf(chunk);
+        while (f)
+        {
+            f.read(buf.data(), (std::streamsize)buf.size());
+            auto n = (size_t)f.gcount();
+            if (n == 0)
+                break;
+            util::Trace::add(util::Counter::FsOps);
+            util::Trace::add(util::Counter::BytesRead, n);
+            if (!fn(buf.data(), n))
+                break;
+        }
+        return !f.bad();
+    }
+
+#ifdef __linux__
+    bool cloneFile(const fs::path &src, const fs::path &dst)
+    {
+        if (dst.has_parent_path())
+        {
+            util::Trace::add(util::Counter::FsOps);
+            std::filesystem::create_directories(dst.parent_path());
+        }
+        util::Trace::add(util::Counter::FsOps);
+        int in = ::open(src.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0)
+            return false;
+        struct stat st;
+        util::Trace::add(util::Counter::FsOps, 2); // fstat, close(in)
+        if (::fstat(in, &st) != 0)
+        {
+            ::close(in);
+            return false;
+        }
+        util::Trace::add(util::Counter::FsOps);
+        int out = ::open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (out < 0)
+        {
+            ::close(in);
+            return false;
+        }
+        util::Trace::add(util::Counter::FsOps, 2); // ioctl, close(out)
+        bool ok = ::ioctl(out, FICLONE, in) == 0;
+        if (!ok)
+        {
+            // No reflink support (ext4, tmpfs, cross-device): let the kernel
+            // copy, falling back to user space if it cannot.
+            off_t left = st.st_size;
+            while (left > 0)
+            {
+                util::Trace::add(util::Counter::FsOps);
+                ssize_t n = ::copy_file_range(in, nullptr, out, nullptr, (size_t)left, 0);
+                if (n <= 0)
+                    break;
+                left -= n;
+            }
+            ok = left == 0;
+            bool rewound = false;
+            if (!ok)
+            {
+                util::Trace::add(util::Counter::FsOps, 3); // lseek, ftruncate, lseek
+                rewound = ::lseek(in, 0, SEEK_SET) == 0 && ::ftruncate(out, 0) == 0 && ::lseek(out, 0, SEEK_SET) == 0;
+            }
+            if (rewound)
+            {
+                std::vector<char> buf(1 << 16);
+                ok = true;
+                for (;;)
+                {
+                    util::Trace::add(util::Counter::FsOps);
+                    ssize_t n = ::read(in, buf.data(), buf.size());
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n <= 0)
+                    {
+                        ok = n == 0;
+                        break;
+                    }
+                    util::Trace::add(util::Counter::FsOps); // write
+                    util::Trace::add(util::Counter::BytesRead, (uint64_t)n);
+                    util::Trace::add(util::Counter::BytesWritten, (uint64_t)n);
+                    if (::write(out, buf.data(), (size_t)n) != n)
+                    {
+                        ok = false;
+                        break;
+                    }
+                }
+            }
+        }
+        ::close(in);
+        ok &= ::close(out) == 0;
+        return ok;
+    }
+#else
+    bool cloneFile(const fs::path &src, const fs::path &dst)
+    {
+        std::error_code ec;
+        if (dst.has_parent_path())
+            std::filesystem::create_directories(dst.parent_path(), ec);
+        std::filesystem::copy_file(src, dst, std::filesystem::copy_options::overwrite_existing, ec);
+        return !ec;
+    }
+#endif
 }
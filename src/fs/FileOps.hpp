@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <filesystem>
+#include <functional>
 
 namespace fsops
 {
@@ -11,5 +12,16 @@ namespace fsops
     bool removePath(const fs::path &p);
     bool movePath(const fs::path &from, const fs::path &to);
     bool writeFile(const fs::path &p, const std::string &data);
+    // Writes a unique temporary file next to p and renames it over p, so
+    // readers never see a partial file and concurrent writers of the same
+    // contents need no lock. Temporaries are named "tmp_*" (see tempSibling).
+    bool writeFileAtomic(const fs::path &p, const std::string &data);
+    fs::path tempSibling(const fs::path &p); // unique per process and call
     bool readFile(const fs::path &p, std::string &out);
+    // Copies src to dst (replacing it). On Linux this tries a reflink (FICLONE)
+    // first, then copy_file_range, so the kernel or filesystem does the work;
+    // a plain read/write loop is the last resort.
+    bool cloneFile(const fs::path &src, const fs::path &dst);
+    // Feeds the file to fn in fixed-size chunks; fn returns false to stop early.
+    bool streamFile(const fs::path &p, const std::function<bool(const char *, size_t)> &fn, size_t chunk = 1 << 16);
 }
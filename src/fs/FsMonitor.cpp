@@ -0,0 +1,412 @@
+#include "fs/FsMonitor.hpp"
+#include "fs/DirWalk.hpp"
+#include "fs/FileOps.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fsops
+{
+
+    FsMonitor::FsMonitor(const fs::path &root) : root_(root) {}
+
+    bool FsMonitor::readState(long &pid, std::string &epoch) const
+    {
+        std::string s;
+        if (!readFile(stateFile(), s))
+            return false;
+        std::istringstream iss(s);
+        return (bool)(iss >> pid >> epoch);
+    }
+
+#ifdef __linux__
+
+    namespace
+    {
+        // Daemon rotates to a new epoch once the log grows past this size.
+        constexpr std::uintmax_t kMaxLogBytes = 16u << 20;
+        constexpr auto kSyncTimeout = std::chrono::seconds(2);
+
+        bool parseToken(const std::string &token, std::string &epoch, unsigned long long &seq)
+        {
+            auto colon = token.rfind(':');
+            if (colon == std::string::npos)
+                return false;
+            epoch = token.substr(0, colon);
+            try
+            {
+                seq = std::stoull(token.substr(colon + 1));
+            }
+            catch (const std::exception &)
+            {
+                return false;
+            }
+            return !epoch.empty();
+        }
+
+        volatile std::sig_atomic_t stopRequested = 0;
+        void onSignal(int) { stopRequested = 1; }
+
+        bool writeAtomic(const fs::path &p, const std::string &data)
+        {
+            auto tmp = p;
+            tmp += ".tmp";
+            if (!writeFile(tmp, data))
+                return false;
+            std::error_code ec;
+            fs::rename(tmp, p, ec);
+            return !ec;
+        }
+
+        class Watcher
+        {
+        public:
+            Watcher(const fs::path &root, const fs::path &cookieDir) : root_(root), cookieDir_(cookieDir) {}
+            ~Watcher()
+            {
+                if (fd_ >= 0)
+                    close(fd_);
+            }
+
+            bool open()
+            {
+                fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+                return fd_ >= 0;
+            }
+            int fd() const { return fd_; }
+
+            // Watches dir and everything below it except .chronofs.
+            bool watchTree(const std::string &rel)
+            {
+                if (!watch(rel))
+                    return false;
+                bool ok = true;
+                DirWalker::walk(root_, rel, [&](const DirWalker::Entry &e)
+                                {
+                                    if (!ok || e.type != EntryType::Dir || e.name == ".chronofs")
+                                        return false;
+                                    ok = watch(e.rel);
+                                    return ok; });
+                return ok;
+            }
+
+            bool watchCookies()
+            {
+                cookieWd_ = inotify_add_watch(fd_, cookieDir_.c_str(), IN_CREATE);
+                return cookieWd_ >= 0;
+            }
+
+            // Drains pending events into log lines. Returns false on overflow.
+            bool drain(unsigned long long &seq, std::string &out, bool &rootGone)
+            {
+                alignas(inotify_event) char buf[64 * 1024];
+                for (;;)
+                {
+                    ssize_t n = read(fd_, buf, sizeof(buf));
+                    if (n <= 0)
+                        return true;
+                    for (char *p = buf; p < buf + n;)
+                    {
+                        auto *ev = reinterpret_cast<inotify_event *>(p);
+                        p += sizeof(inotify_event) + ev->len;
+                        if (ev->mask & IN_Q_OVERFLOW)
+                            return false;
+                        if (ev->wd == cookieWd_)
+                        {
+                            if (ev->len)
+                                out += "K " + std::to_string(++seq) + " " + ev->name + "\n";
+                            continue;
+                        }
+                        auto it = dirs_.find(ev->wd);
+                        if (it == dirs_.end())
+                            continue;
+                        const std::string dir = it->second;
+                        if (ev->mask & IN_IGNORED)
+                        {
+                            dirs_.erase(it);
+                            continue;
+                        }
+                        if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+                        {
+                            if (dir.empty())
+                                rootGone = true;
+                            continue;
+                        }
+                        if (!ev->len)
+                            continue;
+                        std::string name = ev->name;
+                        if (dir.empty() && name == ".chronofs")
+                            continue;
+                        std::string rel = dir.empty() ? name : dir + "/" + name;
+                        if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO)))
+                        {
+                            if (!watchTree(rel))
+                                return false;
+                        }
+                        out += "D " + std::to_string(++seq) + " " + rel + "\n";
+                    }
+                }
+            }
+
+        private:
+            fs::path root_, cookieDir_;
+            int fd_ = -1;
+            int cookieWd_ = -1;
+            std::unordered_map<int, std::string> dirs_;
+
+            bool watch(const std::string &rel)
+            {
+                const uint32_t mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+                                      IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+                fs::path p = rel.empty() ? root_ : root_ / rel;
+                int wd = inotify_add_watch(fd_, p.c_str(), mask);
+                if (wd < 0)
+                    return errno == ENOENT || errno == ENOTDIR; // raced with a delete
+                dirs_[wd] = rel;
+                return true;
+            }
+        };
+
+        std::string newEpoch()
+        {
+            auto now = std::chrono::system_clock::now().time_since_epoch();
+            return std::to_string(getpid()) + "-" +
+                   std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+        }
+    }
+
+    bool FsMonitor::supported() { return true; }
+
+    bool FsMonitor::running() const
+    {
+        long pid = 0;
+        std::string epoch;
+        return readState(pid, epoch) && pid > 0 && kill((pid_t)pid, 0) == 0;
+    }
+
+    int FsMonitor::run()
+    {
+        if (running())
+            return 1;
+        fs::create_directories(cookieDir());
+        Watcher w(root_, cookieDir());
+        if (!w.open() || !w.watchCookies() || !w.watchTree(""))
+            return 1;
+
+        std::signal(SIGTERM, onSignal);
+        std::signal(SIGINT, onSignal);
+        std::signal(SIGHUP, SIG_IGN);
+
+        auto rotate = [&](std::string &epoch, unsigned long long &seq)
+        {
+            epoch = newEpoch();
+            seq = 0;
+            writeFile(logFile(), "");
+            return writeAtomic(stateFile(), std::to_string(getpid()) + " " + epoch + "\n");
+        };
+
+        std::string epoch;
+        unsigned long long seq = 0;
+        if (!rotate(epoch, seq))
+            return 1;
+        int logFd = ::open(logFile().c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (logFd < 0)
+            return 1;
+
+        int rc = 0;
+        while (!stopRequested)
+        {
+            pollfd pfd{w.fd(), POLLIN, 0};
+            if (poll(&pfd, 1, 500) <= 0)
+                continue;
+            std::string lines;
+            bool rootGone = false;
+            if (!w.drain(seq, lines, rootGone))
+            {
+                // Queue overflow: we lost events, so every outstanding token is void.
+                close(logFd);
+                if (!rotate(epoch, seq) || !w.watchTree(""))
+                    return 1;
+                logFd = ::open(logFile().c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+                if (logFd < 0)
+                    return 1;
+                continue;
+            }
+            if (rootGone)
+                break;
+            if (!lines.empty() && write(logFd, lines.data(), lines.size()) != (ssize_t)lines.size())
+            {
+                rc = 1;
+                break;
+            }
+            std::error_code ec;
+            if (fs::file_size(logFile(), ec) > kMaxLogBytes)
+            {
+                close(logFd);
+                if (!rotate(epoch, seq))
+                    return 1;
+                logFd = ::open(logFile().c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+                if (logFd < 0)
+                    return 1;
+            }
+        }
+        close(logFd);
+        std::error_code ec;
+        fs::remove(stateFile(), ec);
+        fs::remove(logFile(), ec);
+        return rc;
+    }
+
+    bool FsMonitor::start()
+    {
+        if (running())
+            return true;
+        pid_t pid = fork();
+        if (pid < 0)
+            return false;
+        if (pid == 0)
+        {
+            setsid();
+            int devnull = ::open("/dev/null", O_RDWR);
+            if (devnull >= 0)
+            {
+                dup2(devnull, 0);
+                dup2(devnull, 1);
+                dup2(devnull, 2);
+            }
+            _exit(run());
+        }
+        auto deadline = std::chrono::steady_clock::now() + kSyncTimeout;
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            if (running())
+                return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    }
+
+    bool FsMonitor::stop()
+    {
+        long pid = 0;
+        std::string epoch;
+        if (!readState(pid, epoch) || pid <= 0)
+            return false;
+        if (kill((pid_t)pid, SIGTERM) != 0)
+        {
+            std::error_code ec;
+            fs::remove(stateFile(), ec); // stale state from a crashed daemon
+            return false;
+        }
+        return true;
+    }
+
+    FsMonitor::Changes FsMonitor::changesSince(const std::string &since) const
+    {
+        Changes out;
+        long pid = 0;
+        std::string epoch;
+        if (!readState(pid, epoch) || pid <= 0 || kill((pid_t)pid, 0) != 0)
+            return out;
+
+        // Cookie round trip: once the daemon logs our cookie, every event that
+        // happened before we created it is in the log too.
+        static unsigned counter = 0;
+        std::string cookie = std::to_string(getpid()) + "-" + std::to_string(++counter);
+        if (!writeFile(cookieDir() / cookie, ""))
+            return out;
+        std::string log, marker = " " + cookie + "\n";
+        size_t cookieAt = std::string::npos;
+        auto deadline = std::chrono::steady_clock::now() + kSyncTimeout;
+        std::ifstream f(logFile(), std::ios::binary);
+        while (f && cookieAt == std::string::npos)
+        {
+            std::ostringstream chunk;
+            chunk << f.rdbuf();
+            f.clear();
+            size_t scanFrom = log.size() > marker.size() ? log.size() - marker.size() : 0;
+            log += chunk.str();
+            auto k = log.find(marker, scanFrom);
+            while (k != std::string::npos)
+            {
+                auto bol = log.rfind('\n', k);
+                bol = bol == std::string::npos ? 0 : bol + 1;
+                if (log.compare(bol, 2, "K ") == 0)
+                {
+                    cookieAt = bol;
+                    break;
+                }
+                k = log.find(marker, k + 1);
+            }
+            if (cookieAt == std::string::npos)
+            {
+                if (std::chrono::steady_clock::now() > deadline)
+                    break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        std::error_code ec;
+        fs::remove(cookieDir() / cookie, ec);
+        std::string epochAfter;
+        if (cookieAt == std::string::npos || !readState(pid, epochAfter) || epochAfter != epoch)
+            return out; // daemon is wedged or rotated under us
+
+        // Parse everything up to and including our cookie line.
+        unsigned long long sinceSeq = 0, lastSeq = 0;
+        std::string sinceEpoch;
+        bool incremental = parseToken(since, sinceEpoch, sinceSeq) && sinceEpoch == epoch;
+        size_t end = log.find('\n', cookieAt);
+        std::istringstream iss(log.substr(0, end + 1));
+        std::string line;
+        while (std::getline(iss, line))
+        {
+            if (line.size() < 4 || line[1] != ' ')
+                continue;
+            auto sp = line.find(' ', 2);
+            if (sp == std::string::npos)
+                continue;
+            // A malformed line means changes may be missing: rescan everything.
+            char *endp = nullptr;
+            unsigned long long seq = std::strtoull(line.c_str() + 2, &endp, 10);
+            if (sp == 2 || endp != line.c_str() + sp)
+            {
+                incremental = false;
+                continue;
+            }
+            lastSeq = seq;
+            if (line[0] == 'D' && incremental && seq > sinceSeq)
+                out.paths.push_back(line.substr(sp + 1));
+        }
+        if (incremental && lastSeq < sinceSeq)
+            incremental = false; // token from the future: not ours
+        out.token = epoch + ":" + std::to_string(lastSeq);
+        out.fullScan = !incremental;
+        if (out.fullScan)
+            out.paths.clear();
+        return out;
+    }
+
+#else
+
+    bool FsMonitor::supported() { return false; }
+    bool FsMonitor::running() const { return false; }
+    int FsMonitor::run() { return 1; }
+    bool FsMonitor::start() { return false; }
+    bool FsMonitor::stop() { return false; }
+    FsMonitor::Changes FsMonitor::changesSince(const std::string &) const { return Changes{}; }
+
+#endif
+
+}
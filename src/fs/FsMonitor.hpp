@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <filesystem>
+
+namespace fsops
+{
+    namespace fs = std::filesystem;
+
+    // inotify-backed working-tree monitor. A background process appends every
+    // changed path to .chronofs/fsmonitor/log with a sequence number; clients
+    // ask for the paths changed since a token ("<epoch>:<seq>"). The epoch
+    // changes whenever the daemon restarts or its queue overflows, which
+    // invalidates all older tokens and forces one full scan.
+    class FsMonitor
+    {
+    public:
+        struct Changes
+        {
+            std::string token;              // empty: monitor unavailable, do not persist
+            bool fullScan = true;           // token is fresh but `since` was not usable
+            std::vector<std::string> paths; // relative; directories mean "rescan subtree"
+        };
+
+        explicit FsMonitor(const fs::path &root);
+
+        static bool supported();
+
+        bool start();      // fork a background daemon
+        bool stop();       // SIGTERM the running daemon
+        bool running() const;
+        int run();         // daemon loop in the foreground
+
+        Changes changesSince(const std::string &since) const;
+
+        fs::path stateDir() const { return root_ / ".chronofs" / "fsmonitor"; }
+
+    private:
+        fs::path root_;
+
+        fs::path stateFile() const { return stateDir() / "state"; }
+        fs::path logFile() const { return stateDir() / "log"; }
+        fs::path cookieDir() const { return stateDir() / "cookies"; }
+        bool readState(long &pid, std::string &epoch) const;
+    };
+
+}
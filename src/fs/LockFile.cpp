@@ -0,0 +1,83 @@
+#include "fs/LockFile.hpp"
+#include "util/Trace.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <thread>
+
+namespace fsops
+{
+
+    LockFile::LockFile(fs::path target) : target_(std::move(target)) {}
+
+    LockFile::~LockFile() { rollback(); }
+
+    fs::path LockFile::lockPath() const
+    {
+        auto p = target_;
+        p += ".lock";
+        return p;
+    }
+
+    bool LockFile::acquire(std::chrono::milliseconds timeout)
+    {
+        if (held())
+            return true;
+        util::TraceScope scope("lock.wait");
+        auto path = lockPath();
+        std::error_code ec;
+        if (path.has_parent_path())
+        {
+            util::Trace::add(util::Counter::FsOps);
+            fs::create_directories(path.parent_path(), ec);
+        }
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        std::chrono::milliseconds backoff{1};
+        for (;;)
+        {
+            util::Trace::add(util::Counter::FsOps);
+            // "x": fails if the file exists (O_CREAT | O_EXCL).
+            file_ = std::fopen(path.string().c_str(), "wbx");
+            if (file_)
+                return true;
+            if (errno != EEXIST || std::chrono::steady_clock::now() >= deadline)
+                return false;
+            std::this_thread::sleep_for(backoff);
+            backoff = std::min(backoff * 2, std::chrono::milliseconds{100});
+        }
+    }
+
+    bool LockFile::commit(const std::string &data)
+    {
+        if (!held())
+            return false;
+        util::Trace::add(util::Counter::FsOps, 2); // write, close
+        util::Trace::add(util::Counter::BytesWritten, data.size());
+        bool ok = std::fwrite(data.data(), 1, data.size(), file_) == data.size();
+        ok &= std::fclose(file_) == 0;
+        file_ = nullptr;
+        std::error_code ec;
+        if (ok)
+        {
+            util::Trace::add(util::Counter::FsOps);
+            fs::rename(lockPath(), target_, ec);
+        }
+        if (!ok || ec)
+        {
+            util::Trace::add(util::Counter::FsOps);
+            fs::remove(lockPath(), ec);
+            return false;
+        }
+        return true;
+    }
+
+    void LockFile::rollback()
+    {
+        if (!held())
+            return;
+        std::fclose(file_);
+        file_ = nullptr;
+        std::error_code ec;
+        fs::remove(lockPath(), ec);
+    }
+
+}
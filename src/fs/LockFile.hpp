@@ -0,0 +1,43 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+namespace fsops
+{
+    namespace fs = std::filesystem;
+
+    // Mutual exclusion between processes for one file, git-style: the holder
+    // owns "<target>.lock", created exclusively, and publishes by writing the
+    // new contents there and renaming it over the target. Readers never lock;
+    // they see the old file or the new one. A lock left by a crashed process
+    // stays until someone removes it, so acquire() gives up after a timeout.
+    class LockFile
+    {
+    public:
+        static constexpr std::chrono::milliseconds kTimeout{10000};
+
+        explicit LockFile(fs::path target);
+        ~LockFile(); // rolls back if still held
+        LockFile(const LockFile &) = delete;
+        LockFile &operator=(const LockFile &) = delete;
+
+        // Retries with backoff while another holder has the lock.
+        bool acquire(std::chrono::milliseconds timeout = kTimeout);
+        bool held() const { return file_ != nullptr; }
+
+        // Replaces the target with data and releases the lock.
+        bool commit(const std::string &data);
+        // Releases the lock, leaving the target untouched.
+        void rollback();
+
+        const fs::path &target() const { return target_; }
+        fs::path lockPath() const;
+
+    private:
+        fs::path target_;
+        std::FILE *file_ = nullptr;
+    };
+
+}
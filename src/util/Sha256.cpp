@@ -36,7 +36,7 @@ namespace util
 
     std::array<uint8_t, 32> Sha256::digest()
     {
-        std::array<uint8_t, 64> final_block{};
+        std::array<uint8_t, 128> final_block{}; // room for a second block when the length spills over
         std::memcpy(final_block.data(), buffer_.data(), buffer_len_);
         final_block[buffer_len_] = 0x80;
         size_t pad_len = (buffer_len_ < 56) ? (56 - buffer_len_) : (120 - buffer_len_);
@@ -0,0 +1,91 @@
+#include "util/ThreadPool.hpp"
+#include <algorithm>
+
+namespace util
+{
+
+    size_t ThreadPool::defaultThreads()
+    {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    ThreadPool::ThreadPool(size_t threads)
+    {
+        if (threads == 0)
+            threads = defaultThreads();
+        workers_.reserve(threads);
+        for (size_t i = 0; i < threads; i++)
+            workers_.emplace_back([this]
+                                  { workerLoop(); });
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            stopping_ = true;
+        }
+        work_.notify_all();
+        for (auto &t : workers_)
+            t.join();
+    }
+
+    void ThreadPool::submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            queue_.push_back(std::move(task));
+        }
+        work_.notify_one();
+    }
+
+    void ThreadPool::wait()
+    {
+        std::unique_lock<std::mutex> lock(mu_);
+        idle_.wait(lock, [this]
+                   { return queue_.empty() && active_ == 0; });
+    }
+
+    void ThreadPool::parallelFor(size_t n, const std::function<void(size_t)> &fn)
+    {
+        if (n == 0)
+            return;
+        size_t chunks = std::min(n, size() * 4);
+        size_t step = (n + chunks - 1) / chunks;
+        for (size_t begin = 0; begin < n; begin += step)
+        {
+            size_t end = std::min(n, begin + step);
+            submit([&fn, begin, end]
+                   {
+                       for (size_t i = begin; i < end; i++)
+                           fn(i); });
+        }
+        wait();
+    }
+
+    void ThreadPool::workerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mu_);
+                work_.wait(lock, [this]
+                           { return stopping_ || !queue_.empty(); });
+                if (queue_.empty())
+                    return;
+                task = std::move(queue_.front());
+                queue_.pop_front();
+                active_++;
+            }
+            task();
+            {
+                std::lock_guard<std::mutex> lock(mu_);
+                active_--;
+                if (queue_.empty() && active_ == 0)
+                    idle_.notify_all();
+            }
+        }
+    }
+
+}
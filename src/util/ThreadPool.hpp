@@ -0,0 +1,43 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace util
+{
+
+    // Fixed-size worker pool. Tasks may submit further tasks; wait() returns
+    // once the queue is drained and no task is running.
+    class ThreadPool
+    {
+    public:
+        explicit ThreadPool(size_t threads = 0); // 0: one per hardware thread
+        ~ThreadPool();
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        void submit(std::function<void()> task);
+        void wait();
+        size_t size() const { return workers_.size(); }
+
+        static size_t defaultThreads();
+
+        // Runs fn(i) for i in [0, n) across the pool in contiguous chunks.
+        void parallelFor(size_t n, const std::function<void(size_t)> &fn);
+
+    private:
+        std::vector<std::thread> workers_;
+        std::deque<std::function<void()>> queue_;
+        std::mutex mu_;
+        std::condition_variable work_, idle_;
+        size_t active_ = 0;
+        bool stopping_ = false;
+
+        void workerLoop();
+    };
+
+}
@@ -0,0 +1,131 @@
+#include "util/Trace.hpp"
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace util
+{
+
+    namespace
+    {
+        struct Event
+        {
+            const char *name;
+            long long ts;  // microseconds since start()
+            long long dur; // microseconds
+            size_t tid;
+        };
+
+        struct Totals
+        {
+            long long calls = 0;
+            double ms = 0;
+        };
+
+        std::mutex mu;
+        bool keepEvents = false;
+        Trace::Clock::time_point origin;
+        std::vector<Event> events;
+        std::map<std::string, Totals> totals;
+    }
+
+    void Trace::start(bool withEvents)
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        keepEvents = withEvents;
+        origin = Clock::now();
+        events.clear();
+        totals.clear();
+        for (auto &c : counters_)
+            c.store(0, std::memory_order_relaxed);
+        active_.store(true, std::memory_order_relaxed);
+    }
+
+    const char *Trace::counterName(Counter c)
+    {
+        switch (c)
+        {
+        case Counter::BytesHashed:
+            return "bytes_hashed";
+        case Counter::ObjectsRead:
+            return "objects_read";
+        case Counter::ObjectsWritten:
+            return "objects_written";
+        case Counter::BytesRead:
+            return "bytes_read";
+        case Counter::BytesWritten:
+            return "bytes_written";
+        case Counter::CacheHits:
+            return "cache_hits";
+        case Counter::FsOps:
+            return "fs_ops";
+        default:
+            return "?";
+        }
+    }
+
+    void Trace::record(const char *name, Clock::time_point begin, Clock::time_point end)
+    {
+        using us = std::chrono::microseconds;
+        std::lock_guard<std::mutex> lock(mu);
+        auto &t = totals[name];
+        t.calls++;
+        t.ms += std::chrono::duration<double, std::milli>(end - begin).count();
+        if (keepEvents)
+            events.push_back({name,
+                              std::chrono::duration_cast<us>(begin - origin).count(),
+                              std::chrono::duration_cast<us>(end - begin).count(),
+                              std::hash<std::thread::id>()(std::this_thread::get_id()) % 100000});
+    }
+
+    bool Trace::writeChromeTrace(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        std::ofstream f(path, std::ios::binary);
+        if (!f)
+            return false;
+        f << "{\"traceEvents\":[\n";
+        for (size_t i = 0; i < events.size(); i++)
+        {
+            auto &e = events[i];
+            f << "{\"name\":\"" << e.name << "\",\"cat\":\"chronofs\",\"ph\":\"X\",\"ts\":" << e.ts
+              << ",\"dur\":" << e.dur << ",\"pid\":1,\"tid\":" << e.tid << "},\n";
+        }
+        // Final counter sample so the values show up as tracks in the viewer.
+        long long end = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - origin).count();
+        f << "{\"name\":\"counters\",\"ph\":\"C\",\"ts\":" << end << ",\"pid\":1,\"args\":{";
+        for (int c = 0; c < static_cast<int>(Counter::Count_); c++)
+            f << (c ? "," : "") << '"' << counterName(static_cast<Counter>(c)) << "\":"
+              << counters_[c].load(std::memory_order_relaxed);
+        f << "}}\n],\"displayTimeUnit\":\"ms\"}\n";
+        return (bool)f;
+    }
+
+    std::string Trace::summary()
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        std::ostringstream o;
+        o << "phase                     calls       total ms\n";
+        for (auto &kv : totals)
+        {
+            char line[128];
+            std::snprintf(line, sizeof(line), "%-24s %6lld %14.3f\n", kv.first.c_str(), kv.second.calls, kv.second.ms);
+            o << line;
+        }
+        o << "\ncounter                        value\n";
+        for (int c = 0; c < static_cast<int>(Counter::Count_); c++)
+        {
+            char line[128];
+            std::snprintf(line, sizeof(line), "%-24s %12llu\n", counterName(static_cast<Counter>(c)),
+                          (unsigned long long)counters_[c].load(std::memory_order_relaxed));
+            o << line;
+        }
+        return o.str();
+    }
+
+}
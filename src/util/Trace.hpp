@@ -0,0 +1,84 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace util
+{
+
+    enum class Counter
+    {
+        BytesHashed,
+        ObjectsRead,
+        ObjectsWritten,
+        BytesRead,
+        BytesWritten,
+        CacheHits, // work skipped because the result was already known
+        FsOps,     // filesystem operations issued (open/read/stat/readdir/rename/...),
+                   // counted where each is made; a std::filesystem or stream call
+                   // counts once, whatever syscalls it makes underneath
+        Count_
+    };
+
+    // Process-wide scoped timers and counters. Everything is a relaxed atomic
+    // load and a branch while tracing is off; define CHRONOFS_NO_TRACE to
+    // compile it out entirely.
+    class Trace
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        // events: keep every span for a Chrome trace file, not just aggregates.
+        static void start(bool events);
+        static void stop() { active_.store(false, std::memory_order_relaxed); }
+
+#ifdef CHRONOFS_NO_TRACE
+        static constexpr bool enabled() { return false; }
+#else
+        static bool enabled() { return active_.load(std::memory_order_relaxed); }
+#endif
+
+        static void add(Counter c, uint64_t n = 1)
+        {
+            if (enabled())
+                counters_[static_cast<int>(c)].fetch_add(n, std::memory_order_relaxed);
+        }
+        static uint64_t value(Counter c) { return counters_[static_cast<int>(c)].load(std::memory_order_relaxed); }
+        static const char *counterName(Counter c);
+
+        static void record(const char *name, Clock::time_point begin, Clock::time_point end);
+
+        // Chrome trace event format (chrome://tracing, Perfetto).
+        static bool writeChromeTrace(const std::string &path);
+        // Human-readable per-phase totals and counters for --stats.
+        static std::string summary();
+
+    private:
+        static inline std::atomic<bool> active_{false};
+        static inline std::atomic<uint64_t> counters_[static_cast<int>(Counter::Count_)]{};
+    };
+
+    class TraceScope
+    {
+    public:
+        explicit TraceScope(const char *name) : name_(name), on_(Trace::enabled())
+        {
+            if (on_)
+                begin_ = Trace::Clock::now();
+        }
+        ~TraceScope()
+        {
+            if (on_)
+                Trace::record(name_, begin_, Trace::Clock::now());
+        }
+        TraceScope(const TraceScope &) = delete;
+        TraceScope &operator=(const TraceScope &) = delete;
+
+    private:
+        const char *name_;
+        bool on_;
+        Trace::Clock::time_point begin_;
+    };
+
+}
@@ -0,0 +1,195 @@
+#include "vcs/Blame.hpp"
+#include "vcs/Diff.hpp"
+#include "util/Trace.hpp"
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <sstream>
+
+namespace vcs
+{
+
+    namespace
+    {
+        constexpr size_t kNone = static_cast<size_t>(-1);
+        constexpr size_t kTextCache = 4;
+
+        bool bySourceLine(const std::pair<size_t, size_t> &a, const std::pair<size_t, size_t> &b)
+        {
+            return a.second < b.second;
+        }
+    }
+
+    Blamer::Blamer(const ObjectStore &store) : store_(store) {}
+
+    bool Blamer::lookup(std::string tree, const Suspect *like, std::string &blob, std::vector<std::string> &trail) const
+    {
+        trail.clear();
+        for (size_t i = 0; i < parts_.size(); i++)
+        {
+            // Same directory hash as the commit we came from: the rest of the
+            // path, and the blob, are the same too.
+            if (like && like->trail[i] == tree)
+            {
+                trail.insert(trail.end(), like->trail.begin() + (long)i, like->trail.end());
+                blob = like->blob;
+                return true;
+            }
+            trail.push_back(tree);
+            std::vector<TreeEntry> entries;
+            if (!store_.readTree(tree, entries))
+                return false;
+            auto it = std::find_if(entries.begin(), entries.end(), [&](const TreeEntry &e)
+                                   { return e.name == parts_[i]; });
+            bool last = i + 1 == parts_.size();
+            if (it == entries.end() || it->mode != (last ? "100644" : "040000"))
+                return false;
+            if (last)
+                blob = it->hash;
+            else
+                tree = it->hash;
+        }
+        return true;
+    }
+
+    std::string Blamer::text(const std::string &blob)
+    {
+        for (auto &t : texts_)
+            if (t.first == blob)
+            {
+                util::Trace::add(util::Counter::CacheHits);
+                return t.second;
+            }
+        std::string data;
+        store_.readBlob(blob, data);
+        if (texts_.size() >= kTextCache)
+            texts_.erase(texts_.begin());
+        texts_.emplace_back(blob, data);
+        return data;
+    }
+
+    bool Blamer::run(const std::string &commit, const std::string &path, std::vector<BlameLine> &out)
+    {
+        util::TraceScope scope("blame");
+        parts_.clear();
+        std::istringstream pathSS(path);
+        std::string segment;
+        while (std::getline(pathSS, segment, '/'))
+            if (!segment.empty() && segment != ".")
+                parts_.push_back(segment);
+        texts_.clear();
+
+        std::string tree, author, msg;
+        std::vector<std::string> parents;
+        long long ts = 0;
+        Suspect start;
+        start.commit = commit;
+        if (parts_.empty() || !store_.readCommit(commit, tree, parents, author, start.time, msg) ||
+            !lookup(tree, nullptr, start.blob, start.trail))
+            return false;
+        auto lines = splitLines(text(start.blob));
+        out.assign(lines.size(), BlameLine{});
+        for (size_t k = 0; k < lines.size(); k++)
+        {
+            out[k].text = std::move(lines[k]);
+            start.lines.emplace_back(k, k);
+        }
+
+        // Newest first, so a commit is normally handled once, after every
+        // descendant that could pass it lines.
+        std::map<std::string, Suspect> pending;
+        std::priority_queue<std::pair<long long, std::string>> queue;
+        auto enqueue = [&](Suspect s)
+        {
+            auto it = pending.find(s.commit);
+            if (it != pending.end())
+            {
+                it->second.lines.insert(it->second.lines.end(), s.lines.begin(), s.lines.end());
+                return;
+            }
+            queue.emplace(s.time, s.commit);
+            pending.emplace(s.commit, std::move(s));
+        };
+        if (!start.lines.empty())
+            enqueue(std::move(start));
+
+        while (!queue.empty())
+        {
+            auto node = pending.extract(queue.top().second);
+            queue.pop();
+            Suspect s = std::move(node.mapped());
+            std::sort(s.lines.begin(), s.lines.end(), bySourceLine);
+            if (!store_.readCommit(s.commit, tree, parents, author, ts, msg))
+            {
+                // Unreadable history: the lines stop here.
+                parents.clear();
+                author.clear();
+                ts = s.time;
+            }
+
+            std::vector<Suspect> versions; // parents that have the file
+            for (auto &p : parents)
+            {
+                Suspect q;
+                q.commit = p;
+                std::string ptree, pauthor, pmsg;
+                std::vector<std::string> pparents;
+                if (store_.readCommit(p, ptree, pparents, pauthor, q.time, pmsg) && lookup(ptree, &s, q.blob, q.trail))
+                    versions.push_back(std::move(q));
+            }
+            auto same = std::find_if(versions.begin(), versions.end(), [&](const Suspect &q)
+                                     { return q.blob == s.blob; });
+            if (same != versions.end())
+            {
+                same->lines = std::move(s.lines);
+                enqueue(std::move(*same));
+                continue;
+            }
+
+            if (!versions.empty())
+            {
+                util::TraceScope diffScope("blame.diff");
+                auto mine = text(s.blob);
+                for (auto &q : versions)
+                {
+                    if (s.lines.empty())
+                        break;
+                    // from[j]: the parent's line for our line j, if it kept it.
+                    std::vector<size_t> from;
+                    size_t i = 0;
+                    for (auto &h : diffText(text(q.blob), mine))
+                    {
+                        if (h.tag == ' ')
+                            from.push_back(i++);
+                        else if (h.tag == '-')
+                            i++;
+                        else
+                            from.push_back(kNone);
+                    }
+                    std::vector<std::pair<size_t, size_t>> kept;
+                    for (auto &l : s.lines)
+                    {
+                        if (l.second < from.size() && from[l.second] != kNone)
+                            q.lines.emplace_back(l.first, from[l.second]);
+                        else
+                            kept.push_back(l);
+                    }
+                    s.lines = std::move(kept);
+                    if (!q.lines.empty())
+                        enqueue(std::move(q));
+                }
+            }
+
+            for (auto &l : s.lines)
+            {
+                auto &o = out[l.first];
+                o.commit = s.commit;
+                o.author = author;
+                o.time = ts;
+                o.origLine = l.second + 1;
+            }
+        }
+        return true;
+    }
+
+}
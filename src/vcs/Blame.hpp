@@ -0,0 +1,54 @@
+#pragma once
+#include "vcs/ObjectStore.hpp"
+#include <string>
+#include <vector>
+
+namespace vcs
+{
+
+    struct BlameLine
+    {
+        std::string commit; // the commit that introduced the line
+        std::string author;
+        long long time = 0;
+        size_t origLine = 0; // 1-based line number in that commit's version
+        std::string text;
+    };
+
+    // Per-line attribution for one file. Commits are visited newest first,
+    // each holding the lines it is suspected of. A commit whose parent has
+    // the same blob at the path passes every line on untouched; that check
+    // follows the path down both trees and stops at the first directory
+    // whose hash matches, so unchanged history costs a tree read or two per
+    // commit. Only when the blob differs are the two versions diffed
+    // (diffText), lines kept from a parent moving to it and the rest staying
+    // with the commit. Merges pass lines to every parent that has them. The
+    // walk ends as soon as no line is left unattributed.
+    class Blamer
+    {
+    public:
+        explicit Blamer(const ObjectStore &store);
+
+        // False when the commit cannot be read or path is not a file in it.
+        bool run(const std::string &commit, const std::string &path, std::vector<BlameLine> &out);
+
+    private:
+        struct Suspect
+        {
+            std::string commit, blob;
+            long long time = 0;
+            std::vector<std::string> trail; // tree hash of each directory from the root down to the file
+            // (line of the final file, line of this blob), both 0-based.
+            std::vector<std::pair<size_t, size_t>> lines;
+        };
+
+        const ObjectStore &store_;
+        std::vector<std::string> parts_; // path components
+
+        bool lookup(std::string tree, const Suspect *like, std::string &blob, std::vector<std::string> &trail) const;
+        std::string text(const std::string &blob);
+
+        std::vector<std::pair<std::string, std::string>> texts_; // a few recently read blobs
+    };
+
+}
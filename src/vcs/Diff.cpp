@@ -1,4 +1,5 @@
 #include "vcs/Diff.hpp"
+#include "util/Trace.hpp"
 #include <sstream>
 #include <algorithm>
 
@@ -6,47 +7,70 @@
 namespace vcs
 {
 
-    static std::vector<std::string> splitLines(const std::string &s)
+    std::vector<std::string> splitLines(const std::string &s)
     {
         std::vector<std::string> out;
-        std::istringstream iss(s);
-        std::string line;
-        while (std::getline(iss, line))
-            out.push_back(line);
+        out.reserve((size_t)std::count(s.begin(), s.end(), '\n') + 1);
+        for (size_t pos = 0; pos < s.size();)
+        {
+            size_t eol = s.find('\n', pos);
+            if (eol == std::string::npos)
+                eol = s.size();
+            out.emplace_back(s, pos, eol - pos);
+            pos = eol + 1;
+        }
         return out;
     }
 
     std::vector<DiffHunkLine> diffText(const std::string &a, const std::string &b)
     {
+        util::TraceScope scope("diff.text");
         auto A = splitLines(a);
         auto B = splitLines(b);
-        size_t n = A.size(), m = B.size();
+        // A common prefix and suffix are always part of some longest common
+        // subsequence, so only the middle needs the quadratic table; for the
+        // usual small edit to a large file that middle is a few lines.
+        size_t pre = 0;
+        while (pre < A.size() && pre < B.size() && A[pre] == B[pre])
+            pre++;
+        size_t suf = 0;
+        while (suf < A.size() - pre && suf < B.size() - pre && A[A.size() - 1 - suf] == B[B.size() - 1 - suf])
+            suf++;
+        size_t n = A.size() - pre - suf, m = B.size() - pre - suf;
+        auto at = [pre](std::vector<std::string> &v, size_t k) -> std::string &
+        { return v[pre + k]; };
         std::vector<std::vector<int>> dp(n + 1, std::vector<int>(m + 1, 0));
         for (size_t i = 0; i < n; i++)
             for (size_t j = 0; j < m; j++)
-                dp[i + 1][j + 1] = (A[i] == B[j]) ? dp[i][j] + 1 : std::max(dp[i + 1][j], dp[i][j + 1]);
-        // reconstruct
+                dp[i + 1][j + 1] = (at(A, i) == at(B, j)) ? dp[i][j] + 1 : std::max(dp[i + 1][j], dp[i][j + 1]);
+        // reconstruct, backwards from the end; lines are moved out once
+        // they have been compared for the last time
         std::vector<DiffHunkLine> out;
+        out.reserve(A.size() + m);
+        for (size_t k = 0; k < suf; k++)
+            out.push_back({' ', std::move(A[A.size() - 1 - k])});
         size_t i = n, j = m;
         while (i > 0 || j > 0)
         {
-            if (i > 0 && j > 0 && A[i - 1] == B[j - 1])
+            if (i > 0 && j > 0 && at(A, i - 1) == at(B, j - 1))
             {
-                out.push_back({' ', A[i - 1]});
+                out.push_back({' ', std::move(at(A, i - 1))});
                 i--;
                 j--;
             }
             else if (j > 0 && (i == 0 || dp[i][j - 1] >= dp[i - 1][j]))
             {
-                out.push_back({'+', B[j - 1]});
+                out.push_back({'+', std::move(at(B, j - 1))});
                 j--;
             }
             else
             {
-                out.push_back({'-', A[i - 1]});
+                out.push_back({'-', std::move(at(A, i - 1))});
                 i--;
             }
         }
+        for (size_t k = pre; k > 0; k--)
+            out.push_back({' ', std::move(A[k - 1])});
         std::reverse(out.begin(), out.end());
         return out;
     }
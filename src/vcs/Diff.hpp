@@ -9,6 +9,10 @@ struct DiffHunkLine {
   std::string text;  // line text without newline
 };
 
+// Lines as diffText numbers them: split on '\n', a final newline ends the
+// last line. Blame and merge use it too so line numbers agree.
+std::vector<std::string> splitLines(const std::string& s);
+
 std::vector<DiffHunkLine> diffText(const std::string& a, const std::string& b);
 
 } 
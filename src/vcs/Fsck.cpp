@@ -0,0 +1,215 @@
+#include "vcs/Fsck.hpp"
+#include "fs/FileOps.hpp"
+#include "util/Sha256.hpp"
+#include "util/ThreadPool.hpp"
+#include "util/Trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+
+namespace vcs
+{
+
+    namespace
+    {
+        enum class Kind : char
+        {
+            Blob = 'b',
+            Tree = 't',
+            Commit = 'c',
+            Tags = 'g',
+            Unknown = '?'
+        };
+
+        struct Reference
+        {
+            std::string from, to;
+            Kind expected;
+        };
+
+        bool isObjectName(const std::string &name)
+        {
+            if (name.size() != 64)
+                return false;
+            for (char c : name)
+                if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+                    return false;
+            return true;
+        }
+
+        const char *kindName(Kind k)
+        {
+            switch (k)
+            {
+            case Kind::Blob:
+                return "blob";
+            case Kind::Tree:
+                return "tree";
+            case Kind::Commit:
+                return "commit";
+            case Kind::Tags:
+                return "tags";
+            default:
+                return "object";
+            }
+        }
+    }
+
+    Fsck::Fsck(const ObjectStore &store, const fs::path &checkpointFile, const FsckOptions &opt)
+        : store_(store), checkpointFile_(checkpointFile), opt_(opt) {}
+
+    FsckReport Fsck::run(const std::vector<std::pair<std::string, std::string>> &extraRoots)
+    {
+        util::TraceScope scope("fsck");
+        FsckReport report;
+        auto started = fs::file_time_type::clock::now();
+
+        fs::file_time_type checkpoint = fs::file_time_type::min();
+        std::string cp;
+        if (opt_.incremental && fsops::readFile(checkpointFile_, cp))
+        {
+            // Anything but "<ticks>\n" counts as no checkpoint: check everything.
+            // (The file clock's epoch may lie in the future, so ticks can be negative.)
+            char *end = nullptr;
+            long long ticks = std::strtoll(cp.c_str(), &end, 10);
+            if (end != cp.c_str() && (*end == '\0' || *end == '\n'))
+                checkpoint = fs::file_time_type(fs::file_time_type::duration(ticks));
+        }
+
+        std::vector<fs::path> files;
+        std::error_code ec;
+        for (auto it = fs::directory_iterator(store_.objectsDir(), ec); !ec && it != fs::directory_iterator(); it.increment(ec))
+            files.push_back(it->path());
+        size_t looseCount = files.size(); // files after this are raw blob bodies
+        if (store_.rawBlobs())
+        {
+            ec.clear();
+            for (auto it = fs::directory_iterator(store_.rawDir(), ec); !ec && it != fs::directory_iterator(); it.increment(ec))
+                files.push_back(it->path());
+        }
+
+        std::mutex mu;
+        std::unordered_map<std::string, Kind> kinds; // every object seen this run
+        std::vector<Reference> refs;
+        std::atomic<size_t> checked{0}, skipped{0};
+
+        util::ThreadPool pool(opt_.jobs);
+        pool.parallelFor(files.size(), [&](size_t i)
+                         {
+                             auto name = files[i].filename().string();
+                             if (!isObjectName(name))
+                                 return;
+                             std::error_code fec;
+                             if (opt_.incremental && fs::last_write_time(files[i], fec) <= checkpoint && !fec)
+                             {
+                                 skipped++;
+                                 std::lock_guard<std::mutex> lock(mu);
+                                 kinds.emplace(name, Kind::Unknown);
+                                 return;
+                             }
+
+                             // Stream the whole file through the hash; keep the body only
+                             // for trees, commits and tags objects, which we need to parse.
+                             util::Sha256 h;
+                             std::string head, body;
+                             Kind kind = Kind::Unknown;
+                             if (i >= looseCount)
+                             {
+                                 h.update("blob\n");
+                                 kind = Kind::Blob;
+                             }
+                             bool ok = fsops::streamFile(files[i], [&](const char *p, size_t n)
+                                                         {
+                                 h.update(reinterpret_cast<const uint8_t *>(p), n);
+                                 util::Trace::add(util::Counter::BytesHashed, n);
+                                 if (kind == Kind::Unknown && head.size() < 8)
+                                 {
+                                     head.append(p, std::min(n, 8 - head.size()));
+                                     if (head.rfind("blob\n", 0) == 0)
+                                         kind = Kind::Blob;
+                                     else if (head.rfind("tree\n", 0) == 0)
+                                         kind = Kind::Tree;
+                                     else if (head.rfind("commit\n", 0) == 0)
+                                         kind = Kind::Commit;
+                                     else if (head.rfind("tags\n", 0) == 0)
+                                         kind = Kind::Tags;
+                                 }
+                                 if (kind == Kind::Tree || kind == Kind::Commit || kind == Kind::Tags ||
+                                     (kind == Kind::Unknown && head.size() < 8))
+                                     body.append(p, n);
+                                 return true; });
+                             checked++;
+
+                             std::vector<std::string> problems;
+                             std::vector<Reference> found;
+                             if (!ok)
+                                 problems.push_back("unreadable " + name);
+                             else if (util::Sha256::toHex(h.digest()) != name)
+                                 problems.push_back("corrupt " + name + ": content does not match its name");
+                             else if (kind == Kind::Unknown)
+                                 problems.push_back("bad object " + name + ": unknown type");
+                             else if (kind == Kind::Tree)
+                             {
+                                 std::vector<TreeEntry> entries;
+                                 ObjectStore::parseTree(body, entries);
+                                 for (auto &e : entries)
+                                     found.push_back({name, e.hash, e.mode == "040000" ? Kind::Tree : Kind::Blob});
+                             }
+                             else if (kind == Kind::Commit)
+                             {
+                                 std::string tree, author, msg, tags;
+                                 std::vector<std::string> parents;
+                                 long long ts = 0;
+                                 if (!ObjectStore::parseCommit(body, tree, parents, author, ts, msg, &tags))
+                                     problems.push_back("bad commit " + name + ": no tree");
+                                 else
+                                 {
+                                     found.push_back({name, tree, Kind::Tree});
+                                     for (auto &p : parents)
+                                         found.push_back({name, p, Kind::Commit});
+                                     if (!tags.empty())
+                                         found.push_back({name, tags, Kind::Tags});
+                                 }
+                             }
+                             else if (kind == Kind::Tags)
+                             {
+                                 std::vector<TagEntry> entries;
+                                 if (!ObjectStore::parseTags(body, entries))
+                                     problems.push_back("bad tags " + name + ": malformed entry");
+                             }
+
+                             std::lock_guard<std::mutex> lock(mu);
+                             kinds.emplace(name, kind);
+                             refs.insert(refs.end(), found.begin(), found.end());
+                             report.problems.insert(report.problems.end(), problems.begin(), problems.end()); });
+
+        for (auto &r : extraRoots)
+            refs.push_back({r.first, r.second, Kind::Unknown});
+
+        // References: type-checked against objects we parsed, existence-checked
+        // against everything else (old objects skipped by --incremental).
+        for (auto &r : refs)
+        {
+            report.references++;
+            auto it = kinds.find(r.to);
+            if (it == kinds.end())
+            {
+                report.problems.push_back("missing " + std::string(kindName(r.expected)) + " " + r.to + " (referenced by " + r.from + ")");
+                continue;
+            }
+            if (it->second != Kind::Unknown && r.expected != Kind::Unknown && it->second != r.expected)
+                report.problems.push_back("wrong type for " + r.to + ": " + kindName(it->second) + ", expected " +
+                                          kindName(r.expected) + " (referenced by " + r.from + ")");
+        }
+
+        std::sort(report.problems.begin(), report.problems.end());
+        report.checked = checked;
+        report.skipped = skipped;
+        if (report.problems.empty())
+            fsops::writeFileAtomic(checkpointFile_, std::to_string(started.time_since_epoch().count()) + "\n");
+        return report;
+    }
+
+}
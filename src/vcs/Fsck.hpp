@@ -0,0 +1,43 @@
+#pragma once
+#include "vcs/ObjectStore.hpp"
+#include <string>
+#include <vector>
+
+namespace vcs
+{
+
+    struct FsckOptions
+    {
+        size_t jobs = 0;          // 0: one per hardware thread
+        bool incremental = false; // only objects newer than the last clean checkpoint
+    };
+
+    struct FsckReport
+    {
+        size_t checked = 0;   // objects re-hashed
+        size_t skipped = 0;   // older than the checkpoint (incremental mode)
+        size_t references = 0;
+        std::vector<std::string> problems;
+    };
+
+    // Integrity check of the loose object store. Every object is re-hashed in
+    // parallel, streaming its file in fixed-size chunks so memory stays bounded
+    // by thread count rather than object size; trees, commits and tags objects
+    // (small) are parsed and each reference is checked for existence and
+    // type. A clean run records its start time as the checkpoint for
+    // --incremental.
+    class Fsck
+    {
+    public:
+        Fsck(const ObjectStore &store, const fs::path &checkpointFile, const FsckOptions &opt);
+
+        // extraRoots: (description, commit or blob hash) from refs, HEAD and the index.
+        FsckReport run(const std::vector<std::pair<std::string, std::string>> &extraRoots);
+
+    private:
+        const ObjectStore &store_;
+        fs::path checkpointFile_;
+        FsckOptions opt_;
+    };
+
+}
@@ -0,0 +1,203 @@
+#include "vcs/Gc.hpp"
+#include "util/ThreadPool.hpp"
+#include "util/Trace.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+
+namespace vcs
+{
+
+    namespace
+    {
+        // Visited set sharded on the first hash byte to keep lock contention low.
+        class MarkSet
+        {
+        public:
+            bool insert(const std::string &hash)
+            {
+                auto &s = shards_[shardOf(hash)];
+                std::lock_guard<std::mutex> lock(s.mu);
+                return s.set.insert(hash).second;
+            }
+            bool contains(const std::string &hash) const
+            {
+                auto &s = shards_[shardOf(hash)];
+                std::lock_guard<std::mutex> lock(s.mu);
+                return s.set.count(hash) > 0;
+            }
+            size_t size() const
+            {
+                size_t n = 0;
+                for (auto &s : shards_)
+                    n += s.set.size();
+                return n;
+            }
+
+        private:
+            struct Shard
+            {
+                mutable std::mutex mu;
+                std::unordered_set<std::string> set;
+            };
+            std::array<Shard, 256> shards_;
+
+            static size_t shardOf(const std::string &hash)
+            {
+                if (hash.size() < 2)
+                    return 0;
+                auto nib = [](char c)
+                { return (size_t)(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10) & 0xF; };
+                return nib(hash[0]) << 4 | nib(hash[1]);
+            }
+        };
+
+        bool isObjectName(const std::string &name)
+        {
+            if (name.size() != 64)
+                return false;
+            for (char c : name)
+                if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+                    return false;
+            return true;
+        }
+    }
+
+    GarbageCollector::GarbageCollector(const ObjectStore &store, const GcOptions &opt)
+        : store_(store), opt_(opt) {}
+
+    GcStats GarbageCollector::run(const std::vector<std::string> &commitRoots,
+                                  const std::vector<std::string> &treeRoots,
+                                  const std::vector<std::string> &blobRoots)
+    {
+        GcStats stats;
+        MarkSet marked;
+        util::ThreadPool pool(opt_.jobs);
+
+        // Sweep cutoff is fixed before marking starts: anything written after
+        // this point is inside the grace period whether or not we saw it.
+        auto cutoff = fs::file_time_type::clock::now() - std::chrono::seconds(opt_.graceSeconds);
+
+        std::atomic<bool> markFailed{false};
+        std::mutex failMu;
+        std::string failedHash;
+        auto fail = [&](const std::string &hash)
+        {
+            std::lock_guard<std::mutex> lock(failMu);
+            if (!markFailed.exchange(true))
+                failedHash = hash;
+        };
+        {
+            util::TraceScope scope("gc.mark");
+            std::function<void(std::string)> markTree, markCommit;
+            markTree = [&](std::string hash)
+            {
+                std::vector<TreeEntry> entries;
+                if (!store_.readTree(hash, entries))
+                    return fail(hash);
+                for (auto &e : entries)
+                {
+                    if (!marked.insert(e.hash))
+                        continue;
+                    if (e.mode == "040000")
+                        pool.submit([&markTree, h = e.hash]
+                                    { markTree(h); });
+                }
+            };
+            markCommit = [&](std::string hash)
+            {
+                // Follow the first-parent chain inline; trees and the other
+                // parents of merges fan out to the pool.
+                while (!hash.empty())
+                {
+                    std::string tree, author, msg, tags;
+                    std::vector<std::string> parents;
+                    long long ts = 0;
+                    if (!store_.readCommit(hash, tree, parents, author, ts, msg, &tags))
+                        return fail(hash);
+                    if (marked.insert(tree))
+                        pool.submit([&markTree, tree]
+                                    { markTree(tree); });
+                    if (!tags.empty())
+                        marked.insert(tags);
+                    for (size_t i = 1; i < parents.size(); i++)
+                        if (marked.insert(parents[i]))
+                            pool.submit([&markCommit, p = parents[i]]
+                                        { markCommit(p); });
+                    if (parents.empty() || !marked.insert(parents[0]))
+                        return;
+                    hash = parents[0];
+                }
+            };
+            for (auto &c : commitRoots)
+                if (!c.empty() && marked.insert(c))
+                    pool.submit([&markCommit, c]
+                                { markCommit(c); });
+            for (auto &t : treeRoots)
+                if (marked.insert(t))
+                    pool.submit([&markTree, t]
+                                { markTree(t); });
+            for (auto &b : blobRoots)
+                marked.insert(b);
+            pool.wait();
+        }
+        stats.reachable = marked.size();
+        if (markFailed)
+        {
+            stats.error = "cannot read object " + failedHash + "; nothing removed";
+            return stats;
+        }
+
+        util::TraceScope scope("gc.sweep");
+        std::vector<fs::path> files;
+        std::error_code ec;
+        for (auto it = fs::directory_iterator(store_.objectsDir(), ec); !ec && it != fs::directory_iterator(); it.increment(ec))
+            files.push_back(it->path());
+        if (store_.rawBlobs())
+        {
+            ec.clear();
+            for (auto it = fs::directory_iterator(store_.rawDir(), ec); !ec && it != fs::directory_iterator(); it.increment(ec))
+                files.push_back(it->path());
+        }
+        stats.scanned = files.size();
+
+        std::atomic<size_t> removed{0}, recent{0};
+        std::atomic<uintmax_t> bytes{0};
+        pool.parallelFor(files.size(), [&](size_t i)
+                         {
+                             auto name = files[i].filename().string();
+                             std::error_code fec;
+                             if (name.rfind("tmp_", 0) == 0)
+                             {
+                                 // A writer's temporary (fsops::writeFileAtomic) left by a crash.
+                                 if (!opt_.dryRun && fs::last_write_time(files[i], fec) <= cutoff && !fec)
+                                     fs::remove(files[i], fec);
+                                 return;
+                             }
+                             if (!isObjectName(name) || marked.contains(name))
+                                 return;
+                             auto mtime = fs::last_write_time(files[i], fec);
+                             if (fec)
+                                 return;
+                             if (mtime > cutoff)
+                             {
+                                 recent++;
+                                 return;
+                             }
+                             auto size = fs::file_size(files[i], fec);
+                             if (fec)
+                                 size = 0;
+                             if (!opt_.dryRun && !fs::remove(files[i], fec))
+                                 return;
+                             removed++;
+                             bytes += size; });
+        stats.removed = removed;
+        stats.keptRecent = recent;
+        stats.bytesRemoved = bytes;
+        return stats;
+    }
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "vcs/ObjectStore.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vcs
+{
+
+    struct GcOptions
+    {
+        size_t jobs = 0;              // 0: one per hardware thread
+        long long graceSeconds = 3600; // objects younger than this are never removed
+        bool dryRun = false;
+    };
+
+    struct GcStats
+    {
+        size_t reachable = 0;   // objects marked from the roots
+        size_t scanned = 0;     // object files examined by the sweep
+        size_t removed = 0;     // unreachable objects deleted (or that would be, dry run)
+        size_t keptRecent = 0;  // unreachable but inside the grace period
+        uintmax_t bytesRemoved = 0;
+        std::string error;      // set when the mark could not read an object; nothing was swept
+    };
+
+    // Parallel mark-and-sweep over the loose object store. The mark walks
+    // commits and trees from the roots on a thread pool; the sweep partitions
+    // the object directory across the same pool. Writers never take a lock:
+    // they freshen the mtime of objects they re-reference, and the grace
+    // period keeps anything recently written or freshened. Temporaries left
+    // by interrupted writers are removed once past the grace period. A
+    // commit or tree the mark cannot read hides whatever it references, so
+    // any such failure cancels the sweep.
+    class GarbageCollector
+    {
+    public:
+        GarbageCollector(const ObjectStore &store, const GcOptions &opt);
+
+        GcStats run(const std::vector<std::string> &commitRoots,
+                    const std::vector<std::string> &treeRoots,
+                    const std::vector<std::string> &blobRoots);
+
+    private:
+        const ObjectStore &store_;
+        GcOptions opt_;
+    };
+
+}
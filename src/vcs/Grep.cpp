@@ -0,0 +1,358 @@
+#include "vcs/Grep.hpp"
+#include "fs/FileOps.hpp"
+#include "util/ThreadPool.hpp"
+#include "util/Trace.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define CHRONOFS_GREP_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace vcs
+{
+
+    namespace
+    {
+        constexpr size_t npos = std::string_view::npos;
+
+        std::string lowered(std::string_view s)
+        {
+            std::string out(s);
+            for (auto &c : out)
+                c = (char)std::tolower((unsigned char)c);
+            return out;
+        }
+
+        // Same test as the merge engine: a NUL byte near the start.
+        bool isBinary(std::string_view s)
+        {
+            return std::memchr(s.data(), '\0', std::min<size_t>(s.size(), 8000)) != nullptr;
+        }
+
+        size_t findLiteral(std::string_view hay, std::string_view needle)
+        {
+            const size_t k = needle.size();
+            if (k == 0)
+                return 0;
+            if (hay.size() < k)
+                return npos;
+            if (k == 1)
+            {
+                auto *p = static_cast<const char *>(std::memchr(hay.data(), needle[0], hay.size()));
+                return p ? (size_t)(p - hay.data()) : npos;
+            }
+            size_t i = 0;
+#ifdef CHRONOFS_GREP_SSE2
+            const __m128i first = _mm_set1_epi8(needle[0]);
+            const __m128i last = _mm_set1_epi8(needle[k - 1]);
+            for (; i + k - 1 + 16 <= hay.size(); i += 16)
+            {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hay.data() + i));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hay.data() + i + k - 1));
+                auto mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+                while (mask)
+                {
+                    unsigned bit = (unsigned)__builtin_ctz(mask);
+                    if (std::memcmp(hay.data() + i + bit + 1, needle.data() + 1, k - 2) == 0)
+                        return i + bit;
+                    mask &= mask - 1;
+                }
+            }
+#endif
+            auto r = hay.substr(i).find(needle);
+            return r == npos ? npos : i + r;
+        }
+
+        // The longest run of plain characters outside groups and classes,
+        // which every match must contain; "" if there is none (or the
+        // pattern alternates, where no single literal is required).
+        std::string requiredLiteral(const std::string &p)
+        {
+            std::string best, run;
+            auto flush = [&]
+            {
+                if (run.size() > best.size())
+                    best = run;
+                run.clear();
+            };
+            int depth = 0;
+            for (size_t i = 0; i < p.size(); i++)
+            {
+                char c = p[i];
+                switch (c)
+                {
+                case '|':
+                    return "";
+                case '\\':
+                    if (i + 1 < p.size() && !std::isalnum((unsigned char)p[i + 1]))
+                    {
+                        if (depth == 0)
+                            run += p[i + 1];
+                    }
+                    else
+                    {
+                        flush(); // \d, \w, \b and friends
+                    }
+                    i++;
+                    break;
+                case '*':
+                case '?':
+                case '{':
+                    // The atom before may be absent: it leaves the run.
+                    if (!run.empty())
+                        run.pop_back();
+                    flush();
+                    if (c == '{')
+                        while (i < p.size() && p[i] != '}')
+                            i++;
+                    break;
+                case '[':
+                    flush();
+                    i += i + 1 < p.size() && p[i + 1] == '^' ? 2 : 1;
+                    if (i < p.size() && p[i] == ']')
+                        i++;
+                    while (i < p.size() && p[i] != ']')
+                        i += p[i] == '\\' ? 2 : 1;
+                    break;
+                case '(':
+                    flush();
+                    depth++;
+                    break;
+                case ')':
+                    flush();
+                    depth--;
+                    break;
+                case '+':
+                case '.':
+                case '^':
+                case '$':
+                    flush();
+                    break;
+                default:
+                    if (depth == 0)
+                        run += c;
+                    else
+                        flush();
+                }
+            }
+            flush();
+            return best;
+        }
+    }
+
+    GrepPattern::GrepPattern(const std::string &pattern, const GrepOptions &opt) : icase_(opt.ignoreCase)
+    {
+        if (opt.fixed)
+        {
+            literal_ = pattern;
+        }
+        else
+        {
+            auto flags = std::regex::ECMAScript | std::regex::optimize;
+            if (icase_)
+                flags |= std::regex::icase;
+            try
+            {
+                regex_.emplace(pattern, flags);
+            }
+            catch (const std::regex_error &)
+            {
+                valid_ = false;
+            }
+            literal_ = requiredLiteral(pattern);
+        }
+        if (icase_)
+            literal_ = lowered(literal_);
+    }
+
+    bool GrepPattern::lineMatches(std::string_view line) const
+    {
+        return std::regex_search(line.begin(), line.end(), *regex_);
+    }
+
+    void GrepPattern::scan(std::string_view data, const std::function<void(size_t, std::string_view)> &fn) const
+    {
+        std::string low;
+        std::string_view hay = data;
+        if (icase_ && !literal_.empty())
+        {
+            low = lowered(data);
+            hay = low;
+        }
+        size_t lineNo = 1, counted = 0; // newlines before `counted` are in lineNo
+        for (size_t pos = 0; pos < data.size();)
+        {
+            // pos is always the start of a line.
+            size_t start = pos;
+            if (!literal_.empty())
+            {
+                size_t hit = findLiteral(hay.substr(pos), literal_);
+                if (hit == npos)
+                    return;
+                hit += pos;
+                start = hit == 0 ? npos : hay.rfind('\n', hit - 1);
+                start = start == npos ? 0 : start + 1;
+            }
+            size_t end = data.find('\n', start);
+            if (end == npos)
+                end = data.size();
+            lineNo += (size_t)std::count(data.begin() + (long)counted, data.begin() + (long)start, '\n');
+            counted = start;
+            auto line = data.substr(start, end - start);
+            if (!regex_ || lineMatches(line))
+                fn(lineNo, line);
+            pos = end + 1;
+        }
+    }
+
+    Grepper::Grepper(const ObjectStore &store, const GrepPattern &pattern, size_t jobs)
+        : store_(store), pattern_(pattern), pool_(std::make_unique<util::ThreadPool>(jobs)) {}
+
+    Grepper::~Grepper()
+    {
+        cancelled_ = true; // queued scans finish without reading
+        pool_.reset();
+    }
+
+    void Grepper::queue(const std::string &hash, fs::path file)
+    {
+        auto &slot = blobs_[hash];
+        if (slot)
+            return;
+        slot = std::make_unique<Blob>();
+        auto *b = slot.get();
+        pool_->submit([this, b, hash, file = std::move(file)]
+                      {
+                          if (!cancelled_)
+                          {
+                              util::TraceScope scope("grep.scan");
+                              std::string data;
+                              if ((!file.empty() && fsops::readFile(file, data)) || store_.readBlob(hash, data))
+                              {
+                                  scanned_++;
+                                  util::Trace::add(util::Counter::BytesRead, data.size());
+                                  if (isBinary(data))
+                                  {
+                                      bool hit = false;
+                                      pattern_.scan(data, [&](size_t, std::string_view)
+                                                    { hit = true; });
+                                      if (hit)
+                                          b->matches.push_back({0, {}});
+                                  }
+                                  else
+                                  {
+                                      pattern_.scan(data, [&](size_t line, std::string_view text)
+                                                    { b->matches.push_back({line, std::string(text)}); });
+                                  }
+                              }
+                          }
+                          {
+                              std::lock_guard<std::mutex> lock(mu_);
+                              b->done = true;
+                          }
+                          doneCv_.notify_all(); });
+    }
+
+    const Grepper::Blob &Grepper::wait(const std::string &hash)
+    {
+        auto &b = *blobs_.at(hash);
+        std::unique_lock<std::mutex> lock(mu_);
+        doneCv_.wait(lock, [&]
+                     { return b.done; });
+        return b;
+    }
+
+    void Grepper::listTree(const std::string &treeHash)
+    {
+        if (!listedTrees_.insert(treeHash).second)
+            return;
+        std::vector<TreeEntry> entries;
+        if (!store_.readTree(treeHash, entries))
+            return;
+        for (auto &e : entries)
+        {
+            if (e.mode == "040000")
+                listTree(e.hash);
+            else
+                queue(e.hash, {});
+        }
+    }
+
+    void Grepper::addTree(const std::string &target, const std::string &treeHash)
+    {
+        util::TraceScope scope("grep.list");
+        targets_.push_back({target, treeHash, {}});
+        listTree(treeHash);
+    }
+
+    void Grepper::addFiles(const std::string &target, const fs::path &root,
+                           const std::vector<std::pair<std::string, std::string>> &files)
+    {
+        targets_.push_back({target, "", files});
+        for (auto &f : files)
+            queue(f.second, root / f.first);
+    }
+
+    bool Grepper::reportTree(const std::string &target, const std::string &treeHash, const std::string &prefix,
+                             const std::function<bool(const GrepHit &)> &fn, bool &found)
+    {
+        // A subtree already seen without a match (in an earlier target, or
+        // elsewhere in this one) is skipped without waiting on anything.
+        auto memo = treeHasMatch_.find(treeHash);
+        if (memo != treeHasMatch_.end() && !memo->second)
+            return true;
+        std::vector<TreeEntry> entries;
+        if (!store_.readTree(treeHash, entries))
+            return true;
+        found = false;
+        for (auto &e : entries)
+        {
+            auto path = prefix + e.name;
+            if (e.mode == "040000")
+            {
+                bool sub = false;
+                if (!reportTree(target, e.hash, path + "/", fn, sub))
+                    return false;
+                found |= sub;
+                continue;
+            }
+            for (auto &m : wait(e.hash).matches)
+            {
+                found = true;
+                if (!fn({target, path, m.line, m.text}))
+                    return false;
+            }
+        }
+        treeHasMatch_[treeHash] = found;
+        return true;
+    }
+
+    void Grepper::report(const std::function<bool(const GrepHit &)> &fn)
+    {
+        for (auto &t : targets_)
+        {
+            bool more = true;
+            if (t.tree.empty())
+            {
+                for (size_t i = 0; i < t.files.size() && more; i++)
+                    for (auto &m : wait(t.files[i].second).matches)
+                        if (!(more = fn({t.name, t.files[i].first, m.line, m.text})))
+                            break;
+            }
+            else
+            {
+                bool found = false;
+                more = reportTree(t.name, t.tree, "", fn, found);
+            }
+            if (!more)
+            {
+                cancelled_ = true;
+                return;
+            }
+        }
+    }
+
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include "vcs/ObjectStore.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace util
+{
+    class ThreadPool;
+}
+
+namespace vcs
+{
+    namespace fs = std::filesystem;
+
+    struct GrepOptions
+    {
+        bool fixed = false;      // pattern is a literal string, not an ECMAScript regex
+        bool ignoreCase = false;
+        bool history = false;    // every commit reachable from HEAD and the refs
+        size_t jobs = 0;         // 0: one per hardware thread
+    };
+
+    struct GrepHit
+    {
+        const std::string &target; // revision as given, commit hash (history), or "" for the working tree
+        const std::string &path;
+        size_t line;               // 1-based; 0 for a binary file that matches
+        std::string_view text;
+    };
+
+    // A compiled pattern. Regexes are only run on lines that contain a
+    // literal every match must contain (the longest one outside groups and
+    // alternations); finding those, and fixed strings, uses an SSE2 scan
+    // that tests 16 positions at once against the literal's first and last
+    // bytes and compares the rest only where both agree.
+    class GrepPattern
+    {
+    public:
+        GrepPattern(const std::string &pattern, const GrepOptions &opt);
+        bool valid() const { return valid_; }
+
+        // fn(1-based line number, line text) for each matching line.
+        void scan(std::string_view data, const std::function<void(size_t, std::string_view)> &fn) const;
+
+    private:
+        bool valid_ = true;
+        bool icase_ = false;
+        std::string literal_; // lower-cased with icase_; "" when a regex has none
+        std::optional<std::regex> regex_;
+
+        bool lineMatches(std::string_view line) const;
+    };
+
+    // Searches many trees at once with each distinct blob scanned once, no
+    // matter how many paths or revisions share it. Adding a target lists its
+    // trees (each distinct tree read once) and queues its new blobs on the
+    // pool right away; report() then walks the targets in order, waiting
+    // only for the blob it is about to print and skipping subtrees already
+    // found to hold no match, so results stream while later blobs are still
+    // being scanned.
+    class Grepper
+    {
+    public:
+        Grepper(const ObjectStore &store, const GrepPattern &pattern, size_t jobs);
+        ~Grepper();
+
+        void addTree(const std::string &target, const std::string &treeHash);
+        // Working-tree files (path, blob hash), read from root rather than the store.
+        void addFiles(const std::string &target, const fs::path &root,
+                      const std::vector<std::pair<std::string, std::string>> &files);
+
+        // Matches target by target, each in tree order (a directory's files,
+        // then its subdirectories); fn returns false to stop.
+        void report(const std::function<bool(const GrepHit &)> &fn);
+
+        size_t blobsScanned() const { return scanned_; }
+
+    private:
+        struct Match
+        {
+            size_t line;
+            std::string text;
+        };
+        struct Blob
+        {
+            bool done = false; // guarded by mu_
+            std::vector<Match> matches;
+        };
+        struct Target
+        {
+            std::string name, tree;
+            std::vector<std::pair<std::string, std::string>> files; // working tree only
+        };
+
+        const ObjectStore &store_;
+        const GrepPattern &pattern_;
+        std::unique_ptr<util::ThreadPool> pool_;
+        std::vector<Target> targets_;
+        std::unordered_map<std::string, std::unique_ptr<Blob>> blobs_; // only touched by the caller's thread
+        std::unordered_set<std::string> listedTrees_;
+        std::unordered_map<std::string, bool> treeHasMatch_;
+        std::mutex mu_;
+        std::condition_variable doneCv_;
+        std::atomic<bool> cancelled_{false};
+        std::atomic<size_t> scanned_{0};
+
+        void listTree(const std::string &treeHash);
+        void queue(const std::string &hash, fs::path file);
+        const Blob &wait(const std::string &hash);
+        bool reportTree(const std::string &target, const std::string &treeHash, const std::string &prefix,
+                        const std::function<bool(const GrepHit &)> &fn, bool &found);
+    };
+
+}
@@ -0,0 +1,244 @@
+#include "vcs/Ignore.hpp"
+#include "fs/FileOps.hpp"
+#include <algorithm>
+#include <sstream>
+
+namespace vcs
+{
+
+    namespace
+    {
+        // "[...]" at the start of p; len is 0 when the class is unterminated.
+        bool matchClass(std::string_view p, char c, size_t &len)
+        {
+            size_t i = 1;
+            bool negate = i < p.size() && (p[i] == '!' || p[i] == '^');
+            if (negate)
+                i++;
+            bool hit = false;
+            for (bool first = true; i < p.size() && (first || p[i] != ']'); first = false)
+            {
+                char lo = p[i];
+                if (lo == '\\' && i + 1 < p.size())
+                    lo = p[++i];
+                char hi = lo;
+                if (i + 2 < p.size() && p[i + 1] == '-' && p[i + 2] != ']')
+                {
+                    hi = p[i + 2];
+                    i += 2;
+                }
+                hit |= c >= lo && c <= hi;
+                i++;
+            }
+            if (i >= p.size())
+            {
+                len = 0;
+                return false;
+            }
+            len = i + 1;
+            return hit != negate;
+        }
+
+        // wildmatch-style: "*", "?" and classes stay within a path segment,
+        // "**" crosses segments and "**/" also matches no directory at all.
+        bool globMatch(std::string_view p, std::string_view s)
+        {
+            while (!p.empty())
+            {
+                char c = p[0];
+                if (c == '*')
+                {
+                    if (p.size() > 1 && p[1] == '*')
+                    {
+                        auto rest = p.substr(2);
+                        if (!rest.empty() && rest[0] == '/')
+                        {
+                            rest = rest.substr(1);
+                            if (globMatch(rest, s))
+                                return true;
+                            for (size_t i = 0; i < s.size(); i++)
+                                if (s[i] == '/' && globMatch(rest, s.substr(i + 1)))
+                                    return true;
+                            return false;
+                        }
+                        for (size_t i = 0; i <= s.size(); i++)
+                            if (globMatch(rest, s.substr(i)))
+                                return true;
+                        return false;
+                    }
+                    auto rest = p.substr(1);
+                    for (size_t i = 0;; i++)
+                    {
+                        if (globMatch(rest, s.substr(i)))
+                            return true;
+                        if (i >= s.size() || s[i] == '/')
+                            return false;
+                    }
+                }
+                if (s.empty())
+                    return false;
+                size_t len = 1;
+                if (c == '?')
+                {
+                    if (s[0] == '/')
+                        return false;
+                }
+                else if (c == '[')
+                {
+                    bool hit = matchClass(p, s[0], len);
+                    if (len == 0) // unterminated: a literal '['
+                    {
+                        if (s[0] != '[')
+                            return false;
+                        len = 1;
+                    }
+                    else if (!hit || s[0] == '/')
+                    {
+                        return false;
+                    }
+                }
+                else
+                {
+                    if (c == '\\' && p.size() > 1)
+                        c = p[len++];
+                    if (c != s[0])
+                        return false;
+                }
+                p = p.substr(len);
+                s = s.substr(1);
+            }
+            return s.empty();
+        }
+
+        bool hasGlob(std::string_view s) { return s.find_first_of("*?[\\") != std::string_view::npos; }
+    }
+
+    std::shared_ptr<const IgnoreRules> IgnoreRules::enter(const fs::path &root, const std::string &relDir,
+                                                          std::shared_ptr<const IgnoreRules> parent)
+    {
+        std::string text;
+        if (!fsops::readFile((relDir.empty() ? root : root / relDir) / kFileName, text))
+            return parent ? parent : std::make_shared<const IgnoreRules>();
+        auto rules = std::make_shared<IgnoreRules>();
+        rules->parent_ = std::move(parent);
+        rules->base_ = relDir.empty() ? "" : relDir + "/";
+        rules->parse(text);
+        return rules;
+    }
+
+    std::shared_ptr<const IgnoreRules> IgnoreRules::forDir(const fs::path &root, const std::string &relDir)
+    {
+        auto rules = enter(root, "", nullptr);
+        for (auto pos = relDir.find('/'); !relDir.empty(); pos = relDir.find('/', pos + 1))
+        {
+            rules = enter(root, relDir.substr(0, pos), rules);
+            if (pos == std::string::npos)
+                break;
+        }
+        return rules;
+    }
+
+    void IgnoreRules::parse(const std::string &text)
+    {
+        std::istringstream in(text);
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            // Trailing blanks go unless escaped.
+            while (!line.empty() && line.back() == ' ' && !(line.size() > 1 && line[line.size() - 2] == '\\'))
+                line.pop_back();
+            if (line.empty() || line[0] == '#')
+                continue;
+            Pattern p;
+            if (line[0] == '!')
+            {
+                p.negate = true;
+                line.erase(0, 1);
+            }
+            else if (line[0] == '\\' && line.size() > 1 && (line[1] == '!' || line[1] == '#'))
+            {
+                line.erase(0, 1);
+            }
+            while (!line.empty() && line.back() == '/')
+            {
+                p.dirOnly = true;
+                line.pop_back();
+            }
+            p.anchored = line.find('/') != std::string::npos;
+            while (!line.empty() && line[0] == '/')
+                line.erase(0, 1);
+            if (line.empty())
+                continue;
+            p.text = std::move(line);
+
+            auto id = (uint32_t)patterns_.size();
+            if (!hasGlob(p.text))
+            {
+                (p.anchored ? paths_ : names_)[p.text].push_back(id);
+            }
+            else if (!p.anchored && p.text[0] == '*' && !hasGlob(std::string_view(p.text).substr(1)))
+            {
+                auto suffix = p.text.substr(1);
+                if (std::find(suffixLens_.begin(), suffixLens_.end(), suffix.size()) == suffixLens_.end())
+                    suffixLens_.push_back(suffix.size());
+                suffixes_[suffix].push_back(id);
+            }
+            else
+            {
+                globs_.push_back(id);
+            }
+            patterns_.push_back(std::move(p));
+        }
+    }
+
+    IgnoreRules::Match IgnoreRules::match(std::string_view rel, std::string_view name, bool isDir) const
+    {
+        long best = -1;
+        auto consider = [&](const std::unordered_map<std::string, std::vector<uint32_t>> &table, std::string_view key)
+        {
+            auto it = table.find(std::string(key));
+            if (it == table.end())
+                return;
+            for (auto id = it->second.rbegin(); id != it->second.rend(); ++id)
+                if (!patterns_[*id].dirOnly || isDir)
+                {
+                    best = std::max(best, (long)*id);
+                    return;
+                }
+        };
+        if (!names_.empty())
+            consider(names_, name);
+        if (!paths_.empty())
+            consider(paths_, rel);
+        for (auto len : suffixLens_)
+            if (len <= name.size())
+                consider(suffixes_, name.substr(name.size() - len));
+        for (auto id = globs_.rbegin(); id != globs_.rend() && (long)*id > best; ++id)
+        {
+            auto &p = patterns_[*id];
+            if ((!p.dirOnly || isDir) && globMatch(p.text, p.anchored ? rel : name))
+                best = *id;
+        }
+        if (best < 0)
+            return Match::None;
+        return patterns_[best].negate ? Match::Included : Match::Ignored;
+    }
+
+    bool IgnoreRules::ignored(const std::string &rel, bool isDir) const
+    {
+        auto slash = rel.rfind('/');
+        std::string_view name = std::string_view(rel).substr(slash == std::string::npos ? 0 : slash + 1);
+        for (auto *r = this; r; r = r->parent_.get())
+        {
+            if (r->patterns_.empty() || rel.compare(0, r->base_.size(), r->base_) != 0)
+                continue;
+            auto m = r->match(std::string_view(rel).substr(r->base_.size()), name, isDir);
+            if (m != Match::None)
+                return m == Match::Ignored;
+        }
+        return false;
+    }
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace vcs
+{
+    namespace fs = std::filesystem;
+
+    // gitignore-style rules from `.chronofsignore` files. Each file applies to
+    // its directory and everything below it; a deeper file overrides a
+    // shallower one, and within a file the last matching line wins ("!"
+    // re-includes). A trailing "/" matches directories only; a pattern with
+    // another "/" is anchored to the file's directory, otherwise it matches
+    // the name at any depth. "*", "?", "[...]" and "**" are supported.
+    //
+    // Patterns are compiled per file: literal names and paths go into hash
+    // tables, "*<suffix>" patterns into a table keyed by suffix, and only the
+    // remaining globs are matched one by one (newest first, stopping once an
+    // already-found match is newer). Walkers ask before descending, so an
+    // ignored directory is never read.
+    class IgnoreRules
+    {
+    public:
+        static constexpr const char *kFileName = ".chronofsignore";
+
+        // Rules in effect inside relDir: `parent` plus relDir's own file, if
+        // it has one (otherwise `parent` itself is returned). Instances are
+        // immutable once built, so one chain can be shared across threads.
+        static std::shared_ptr<const IgnoreRules> enter(const fs::path &root, const std::string &relDir,
+                                                        std::shared_ptr<const IgnoreRules> parent);
+        // Same, loading the files of relDir and all of its ancestors.
+        static std::shared_ptr<const IgnoreRules> forDir(const fs::path &root, const std::string &relDir);
+
+        // rel is relative to the repository root.
+        bool ignored(const std::string &rel, bool isDir) const;
+
+    private:
+        enum class Match
+        {
+            None,
+            Ignored,
+            Included
+        };
+        struct Pattern
+        {
+            std::string text; // without "!", leading "/" and trailing "/"
+            bool negate = false;
+            bool dirOnly = false;
+            bool anchored = false; // matched against the path below base_, not the name
+        };
+
+        std::shared_ptr<const IgnoreRules> parent_;
+        std::string base_; // "" or "dir/"
+        std::vector<Pattern> patterns_; // file order; a higher index wins
+        std::unordered_map<std::string, std::vector<uint32_t>> names_, paths_, suffixes_;
+        std::vector<size_t> suffixLens_;
+        std::vector<uint32_t> globs_;
+
+        void parse(const std::string &text);
+        Match match(std::string_view rel, std::string_view name, bool isDir) const;
+    };
+
+}
@@ -0,0 +1,193 @@
+#include "vcs/Import.hpp"
+#include "vcs/Ignore.hpp"
+#include "fs/DirWalk.hpp"
+#include "fs/FileOps.hpp"
+#include "util/ThreadPool.hpp"
+#include "util/Trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+
+namespace vcs
+{
+
+    namespace
+    {
+        // Files of one directory are ingested in chunks of this size, so a
+        // directory with many files still spreads over the pool.
+        constexpr size_t kChunkFiles = 64;
+
+        struct Dir
+        {
+            std::string name, rel;
+            Dir *parent = nullptr;
+            // The directory's own scan, plus each file chunk and subdirectory
+            // still running; whoever drops it to zero writes the tree.
+            std::atomic<size_t> pending{1};
+            std::mutex mu;
+            std::vector<TreeEntry> files, dirs;
+            std::vector<std::unique_ptr<Dir>> children; // only touched by the scan
+            std::shared_ptr<const IgnoreRules> ignore;
+            std::string tree;
+        };
+
+        bool byName(const TreeEntry &a, const TreeEntry &b) { return a.name < b.name; }
+    }
+
+    Importer::Importer(ObjectStore &store, const ImportOptions &opt) : store_(store), opt_(opt) {}
+
+    std::string Importer::run(const fs::path &root, const std::string &relDir,
+                              std::vector<std::pair<std::string, std::string>> &files, ImportStats &stats)
+    {
+        util::TraceScope scope("import.ingest");
+        // Objects already stored are not written again, only freshened, once
+        // each, the first time this import reuses them.
+        const auto stored = store_.listObjects();
+        std::unordered_set<std::string> seen;
+        std::mutex seenMu;
+        std::atomic<size_t> nFiles{0}, nDirs{0}, nWritten{0}, nFailed{0};
+        std::atomic<uintmax_t> nBytes{0};
+
+        // Same layout as Repository::writeTreeRecursive: files, then directories.
+        std::function<void(Dir *)> finish = [&](Dir *d)
+        {
+            std::sort(d->files.begin(), d->files.end(), byName);
+            std::sort(d->dirs.begin(), d->dirs.end(), byName);
+            auto entries = std::move(d->files);
+            entries.insert(entries.end(), d->dirs.begin(), d->dirs.end());
+            d->dirs.clear();
+            if (!entries.empty())
+                d->tree = store_.writeTree(entries);
+            d->files = std::move(entries); // kept for the final file list
+            nDirs++;
+            auto *p = d->parent;
+            if (!p)
+                return;
+            if (!d->tree.empty())
+            {
+                std::lock_guard<std::mutex> lock(p->mu);
+                p->dirs.push_back({"040000", d->name, d->tree});
+            }
+            if (p->pending.fetch_sub(1) == 1)
+                finish(p);
+        };
+        auto release = [&](Dir *d)
+        {
+            if (d->pending.fetch_sub(1) == 1)
+                finish(d);
+        };
+
+        auto ingest = [&](Dir *d, const std::vector<std::string> &names)
+        {
+            util::TraceScope s("import.files");
+            std::vector<TreeEntry> out;
+            std::string data;
+            auto now = fs::file_time_type::clock::now();
+            for (auto &n : names)
+            {
+                auto rel = d->rel.empty() ? n : d->rel + "/" + n;
+                if (!fsops::readFile(root / rel, data))
+                {
+                    nFailed++;
+                    continue;
+                }
+                auto hash = ObjectStore::hashBlob(data);
+                bool first;
+                {
+                    std::lock_guard<std::mutex> lock(seenMu);
+                    first = seen.insert(hash).second;
+                }
+                // A freshen that fails means gc removed it since the listing.
+                if (!first || (stored.count(hash) && store_.freshen(hash, now)))
+                    util::Trace::add(util::Counter::CacheHits);
+                else if (store_.storeBlob(hash, data))
+                    nWritten++;
+                else
+                {
+                    nFailed++;
+                    continue;
+                }
+                nFiles++;
+                nBytes += data.size();
+                out.push_back({"100644", n, std::move(hash)});
+            }
+            {
+                std::lock_guard<std::mutex> lock(d->mu);
+                d->files.insert(d->files.end(), std::make_move_iterator(out.begin()), std::make_move_iterator(out.end()));
+            }
+            release(d);
+        };
+
+        util::ThreadPool pool(opt_.jobs);
+        std::function<void(Dir *)> scan = [&](Dir *d)
+        {
+            util::TraceScope s("import.walk");
+            if (d->parent)
+                d->ignore = IgnoreRules::enter(root, d->rel, d->ignore);
+            std::vector<std::string> names;
+            std::vector<fsops::DirEntry> entries;
+            if (!fsops::readDir(d->rel.empty() ? root : root / d->rel, entries))
+                nFailed++;
+            for (auto &ent : entries)
+            {
+                auto &name = ent.name;
+                if (ent.type == fsops::EntryType::Dir)
+                {
+                    auto rel = d->rel.empty() ? name : d->rel + "/" + name;
+                    if (rel == ".chronofs" || d->ignore->ignored(rel, true))
+                        continue;
+                    auto child = std::make_unique<Dir>();
+                    child->name = name;
+                    child->rel = std::move(rel);
+                    child->parent = d;
+                    child->ignore = d->ignore;
+                    d->pending++;
+                    auto *c = child.get();
+                    d->children.push_back(std::move(child));
+                    pool.submit([&scan, c]
+                                { scan(c); });
+                }
+                else if (ent.type == fsops::EntryType::File && !d->ignore->ignored(d->rel.empty() ? name : d->rel + "/" + name, false))
+                {
+                    names.push_back(std::move(name));
+                }
+            }
+            for (size_t b = 0; b < names.size(); b += kChunkFiles)
+            {
+                std::vector<std::string> chunk(names.begin() + b, names.begin() + std::min(names.size(), b + kChunkFiles));
+                d->pending++;
+                pool.submit([&ingest, d, chunk = std::move(chunk)]
+                            { ingest(d, chunk); });
+            }
+            release(d);
+        };
+
+        Dir top;
+        top.rel = relDir;
+        top.ignore = IgnoreRules::forDir(root, relDir);
+        pool.submit([&]
+                    { scan(&top); });
+        pool.wait();
+
+        std::function<void(const Dir &)> collect = [&](const Dir &d)
+        {
+            for (auto &e : d.files)
+                if (e.mode != "040000")
+                    files.emplace_back(d.rel.empty() ? e.name : d.rel + "/" + e.name, e.hash);
+            for (auto &c : d.children)
+                collect(*c);
+        };
+        collect(top);
+
+        stats.files += nFiles;
+        stats.dirs += nDirs;
+        stats.bytes += nBytes;
+        stats.objectsWritten += nWritten;
+        stats.failed += nFailed;
+        return top.tree;
+    }
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "vcs/ObjectStore.hpp"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace vcs
+{
+
+    struct ImportOptions
+    {
+        size_t jobs = 0; // 0: one per hardware thread
+    };
+
+    struct ImportStats
+    {
+        size_t files = 0;
+        size_t dirs = 0;
+        uintmax_t bytes = 0;
+        size_t objectsWritten = 0; // blobs not already in the store
+        size_t failed = 0;         // files that could not be read or stored
+    };
+
+    // Bulk ingest of a directory tree. Directories are listed, and their files
+    // read, hashed and stored, as independent tasks on a thread pool. The
+    // object directory is listed once up front, so new blobs are written
+    // without a per-object existence check, stored ones are freshened
+    // against a concurrent gc, and duplicate contents are handled once. A
+    // directory's tree object is written as soon as its last file and
+    // subdirectory finish, so trees are built bottom-up while the walk is
+    // still running and no index rebuild is needed afterwards.
+    class Importer
+    {
+    public:
+        Importer(ObjectStore &store, const ImportOptions &opt);
+
+        // Imports root/relDir (relDir "" for root itself). .chronofs and paths
+        // matched by .chronofsignore rules are skipped.
+        // Returns its tree hash, or "" if it holds no files; every imported
+        // file is appended to `files` as (path relative to root, blob hash).
+        std::string run(const fs::path &root, const std::string &relDir,
+                        std::vector<std::pair<std::string, std::string>> &files, ImportStats &stats);
+
+    private:
+        ObjectStore &store_;
+        ImportOptions opt_;
+    };
+
+}
@@ -1,47 +1,163 @@
 #include "vcs/Index.hpp"
 #include "fs/FileOps.hpp"
-#include <fstream>
-#include <sstream>
+#include "util/Trace.hpp"
+#include <algorithm>
 
 namespace vcs
 {
 
     Index::Index(const fs::path &repoDir) : repoDir_(repoDir) {}
 
-    bool Index::load()
+    bool Index::readStamp(fs::file_time_type &t, uintmax_t &size) const
     {
+        std::error_code ec;
+        t = fs::last_write_time(indexPath(), ec);
+        if (ec)
+            return false;
+        size = fs::file_size(indexPath(), ec);
+        return !ec;
+    }
+
+    bool Index::refresh()
+    {
+        fs::file_time_type t;
+        uintmax_t size = 0;
+        if (stampValid_ && readStamp(t, size) && t == stampTime_ && size == stampSize_)
+        {
+            util::Trace::add(util::Counter::CacheHits);
+            return true;
+        }
+        return load();
+    }
+
+    void Index::clear()
+    {
+        paths_.clear();
         entries_.clear();
-        std::ifstream f(indexPath());
-        if (!f)
+        count_ = 0;
+    }
+
+    bool Index::load()
+    {
+        util::TraceScope scope("index.load");
+        clear();
+        stampValid_ = readStamp(stampTime_, stampSize_);
+        std::string data;
+        if (!fsops::readFile(indexPath(), data))
             return true; // empty ok
-        std::string mode, path, hash;
-        while (f >> mode >> path >> hash)
+        size_t lines = static_cast<size_t>(std::count(data.begin(), data.end(), '\n'));
+        paths_.reserve(lines + lines / 4, data.size() / 2);
+        entries_.reserve(lines + lines / 4);
+        // Each line is "<mode> <path> <hash>\n"; parse in place without streams.
+        size_t pos = 0;
+        while (pos < data.size())
         {
-            entries_[path] = IndexEntry{mode, hash};
+            size_t eol = data.find('\n', pos);
+            if (eol == std::string::npos)
+                eol = data.size();
+            std::string_view line(data.data() + pos, eol - pos);
+            pos = eol + 1;
+            size_t s1 = line.find(' ');
+            size_t s2 = line.rfind(' ');
+            if (s1 == std::string_view::npos || s2 == s1)
+                continue;
+            add(std::string(line.substr(s1 + 1, s2 - s1 - 1)),
+                std::string(line.substr(0, s1)),
+                std::string(line.substr(s2 + 1)));
         }
         return true;
     }
 
     bool Index::save() const
     {
-        std::ofstream f(indexPath());
-        if (!f)
-            return false;
-        for (auto &kv : entries_)
+        util::TraceScope scope("index.save");
+        std::string out;
+        out.reserve(count_ * 96);
+        forEach([&](const std::string &path, const IndexEntry &e)
+                {
+                    out += e.mode;
+                    out += ' ';
+                    out += path;
+                    out += ' ';
+                    out += e.hash;
+                    out += '\n'; });
+        auto lock = std::move(lock_);
+        if (!lock)
         {
-            f << kv.second.mode << ' ' << kv.first << ' ' << kv.second.hash << '\n';
+            lock = std::make_unique<fsops::LockFile>(indexPath());
+            if (!lock->acquire())
+                return false;
         }
+        if (!lock->commit(out))
+            return false;
+        stampValid_ = readStamp(stampTime_, stampSize_);
         return true;
     }
 
+    bool Index::lock()
+    {
+        if (lock_)
+            return true;
+        auto lock = std::make_unique<fsops::LockFile>(indexPath());
+        if (!lock->acquire())
+            return false;
+        lock_ = std::move(lock);
+        return refresh();
+    }
+
+    void Index::unlock() { lock_.reset(); }
+
     void Index::add(const std::string &path, const std::string &mode, const std::string &blobHash)
     {
-        entries_[path] = IndexEntry{mode, blobHash};
+        auto id = paths_.intern(path);
+        if (id == PathTable::npos)
+            return;
+        if (entries_.size() <= id)
+            entries_.resize(paths_.nodeCount());
+        if (entries_[id].mode.empty())
+            count_++;
+        entries_[id] = IndexEntry{mode, blobHash};
     }
 
     void Index::remove(const std::string &path)
     {
-        entries_.erase(path);
+        auto id = paths_.find(path);
+        if (!entry(id))
+            return;
+        entries_[id] = IndexEntry{};
+        count_--;
+        // Drop directories left empty so tree building never sees them.
+        while (id != PathTable::root && id != PathTable::npos &&
+               paths_.children(id).empty() && !entry(id))
+        {
+            auto parent = paths_.parent(id);
+            paths_.unlink(id);
+            id = parent;
+        }
+        // A long-lived index (`chronofs serve`) would otherwise grow with
+        // add/remove churn; rebuilding once half the nodes are dead keeps
+        // the cost amortized constant per remove.
+        if (paths_.unlinkedCount() >= 1024 && paths_.unlinkedCount() * 2 >= paths_.nodeCount())
+            compact();
+    }
+
+    void Index::compact()
+    {
+        util::TraceScope scope("index.compact");
+        PathTable fresh;
+        std::vector<IndexEntry> kept;
+        kept.reserve(count_);
+        // Sorted walk order appends every child in place.
+        paths_.walk([&](PathTable::Id id, const std::string &p)
+                    {
+                        if (!entry(id))
+                            return;
+                        auto nid = fresh.intern(p);
+                        if (kept.size() <= nid)
+                            kept.resize(fresh.nodeCount());
+                        kept[nid] = std::move(entries_[id]); });
+        paths_ = std::move(fresh);
+        entries_ = std::move(kept);
     }
 
 }
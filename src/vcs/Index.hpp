@@ -1,12 +1,17 @@
 #pragma once
+#include "vcs/PathTable.hpp"
+#include "fs/LockFile.hpp"
+#include <memory>
 #include <string>
-#include <unordered_map>
+#include <vector>
 #include <filesystem>
 
 namespace vcs
 {
     namespace fs = std::filesystem;
 
+    // mode "100644" is a file with its blob hash; mode "040000" is a sparse
+    // directory that is not materialized and carries its tree hash instead.
     struct IndexEntry
     {
         std::string mode;
@@ -19,19 +24,59 @@ namespace vcs
         explicit Index(const fs::path &repoDir);
 
         bool load();
+        void clear();
+        // Publishes through the held lock (releasing it), or under a lock
+        // taken just for the write.
         bool save() const;
+        // Reloads only when the index file changed since our last load/save.
+        bool refresh();
+
+        // Read-modify-write across processes: lock() takes `index.lock` and
+        // then refreshes, so the entries edited are the latest ones; save()
+        // or unlock() ends it. Plain reads need no lock.
+        bool lock();
+        void unlock();
 
         void add(const std::string &path, const std::string &mode, const std::string &blobHash);
         void remove(const std::string &path);
 
-        const std::unordered_map<std::string, IndexEntry> &entries() const { return entries_; }
-        bool has(const std::string &path) const { return entries_.count(path) > 0; }
+        // Entries are keyed by PathTable ids; directories are nodes without an entry.
+        const PathTable &paths() const { return paths_; }
+        const IndexEntry *entry(PathTable::Id id) const
+        {
+            return id < entries_.size() && !entries_[id].mode.empty() ? &entries_[id] : nullptr;
+        }
+        const IndexEntry *find(const std::string &path) const { return entry(paths_.find(path)); }
+        bool has(const std::string &path) const { return find(path) != nullptr; }
+        size_t size() const { return count_; }
+
+        // Visits every entry in sorted path order: fn(const std::string &path, const IndexEntry &).
+        template <class Fn>
+        void forEach(Fn &&fn) const
+        {
+            paths_.walk([&](PathTable::Id id, const std::string &p)
+                        {
+                            if (auto *e = entry(id))
+                                fn(p, *e); });
+        }
 
         fs::path indexPath() const { return repoDir_ / ".chronofs" / "index"; }
 
     private:
         fs::path repoDir_;
-        std::unordered_map<std::string, IndexEntry> entries_;
+        PathTable paths_;
+        std::vector<IndexEntry> entries_; // parallel to paths_ node ids
+        size_t count_ = 0;
+        mutable std::unique_ptr<fsops::LockFile> lock_; // held between lock() and save()/unlock()
+
+        // Identity of the file contents we hold, for refresh().
+        mutable bool stampValid_ = false;
+        mutable fs::file_time_type stampTime_{};
+        mutable uintmax_t stampSize_ = 0;
+        bool readStamp(fs::file_time_type &t, uintmax_t &size) const;
+        // Rebuilds paths_ and entries_ from the live entries, dropping the
+        // nodes remove() unlinked. Ids change; none are held across a remove.
+        void compact();
     };
 
 }
@@ -0,0 +1,313 @@
+#include "vcs/Merge.hpp"
+#include "vcs/Diff.hpp"
+#include "util/Trace.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <map>
+#include <unordered_map>
+
+namespace vcs
+{
+
+    namespace
+    {
+        // A run of base lines [start, end) replaced by `lines` on one side.
+        struct Hunk
+        {
+            size_t start, end;
+            std::vector<std::string> lines;
+        };
+
+        std::vector<Hunk> hunksAgainst(const std::string &base, const std::string &side)
+        {
+            std::vector<Hunk> out;
+            size_t pos = 0;
+            bool open = false;
+            for (auto &l : diffText(base, side))
+            {
+                if (l.tag == ' ')
+                {
+                    open = false;
+                    pos++;
+                    continue;
+                }
+                if (!open)
+                {
+                    out.push_back({pos, pos, {}});
+                    open = true;
+                }
+                if (l.tag == '-')
+                    out.back().end = ++pos;
+                else
+                    out.back().lines.push_back(l.text);
+            }
+            return out;
+        }
+
+        // One side's text for base[start, end), given its hunks inside that range.
+        std::vector<std::string> sideText(const std::vector<std::string> &base, const Hunk *h, const Hunk *hEnd,
+                                          size_t start, size_t end)
+        {
+            std::vector<std::string> out;
+            size_t p = start;
+            for (; h != hEnd; ++h)
+            {
+                out.insert(out.end(), base.begin() + p, base.begin() + h->start);
+                out.insert(out.end(), h->lines.begin(), h->lines.end());
+                p = h->end;
+            }
+            out.insert(out.end(), base.begin() + p, base.begin() + end);
+            return out;
+        }
+
+        bool binary(const std::string &s)
+        {
+            return std::memchr(s.data(), '\0', std::min<size_t>(s.size(), 8000)) != nullptr;
+        }
+    }
+
+    std::optional<std::string> mergeBase(const ObjectStore &store, const std::string &a, const std::string &b)
+    {
+        util::TraceScope scope("merge.base");
+        if (a == b)
+            return a;
+        enum : unsigned char
+        {
+            FromA = 1,
+            FromB = 2,
+            Stale = 4,
+            Result = 8
+        };
+        struct Item
+        {
+            long long ts;
+            std::string hash;
+            bool operator<(const Item &o) const { return ts < o.ts; }
+        };
+        std::unordered_map<std::string, unsigned char> flags;
+        std::unordered_map<std::string, long long> times;
+        std::vector<Item> heap;
+        auto push = [&](const std::string &h)
+        {
+            auto it = times.find(h);
+            if (it == times.end())
+            {
+                std::string tree, author, msg;
+                std::vector<std::string> parents;
+                long long ts = 0;
+                store.readCommit(h, tree, parents, author, ts, msg);
+                it = times.emplace(h, ts).first;
+            }
+            heap.push_back({it->second, h});
+            std::push_heap(heap.begin(), heap.end());
+        };
+        auto anyLive = [&]
+        {
+            for (auto &it : heap)
+                if (!(flags[it.hash] & Stale))
+                    return true;
+            return false;
+        };
+        flags[a] = FromA;
+        flags[b] = FromB;
+        push(a);
+        push(b);
+
+        // Paint ancestors, newest first, with the side(s) that reach them. A
+        // commit painted by both sides is a candidate, and everything below it
+        // is painted stale; the walk ends when only stale commits are queued,
+        // so candidates that turn out to be ancestors of others drop out.
+        std::vector<std::string> results;
+        while (!heap.empty() && anyLive())
+        {
+            std::pop_heap(heap.begin(), heap.end());
+            auto hash = std::move(heap.back().hash);
+            heap.pop_back();
+            unsigned char f = flags[hash] & (FromA | FromB | Stale);
+            if (f == (FromA | FromB))
+            {
+                if (!(flags[hash] & Result))
+                {
+                    flags[hash] |= Result;
+                    results.push_back(hash);
+                }
+                f |= Stale;
+            }
+            std::string tree, author, msg;
+            std::vector<std::string> parents;
+            long long ts = 0;
+            if (!store.readCommit(hash, tree, parents, author, ts, msg))
+                continue;
+            for (auto &p : parents)
+            {
+                auto &pf = flags[p];
+                if ((pf & f) == f)
+                    continue;
+                pf |= f;
+                push(p);
+            }
+        }
+
+        // Criss-cross histories can leave several bases; take the newest
+        // rather than merging the bases recursively.
+        std::optional<std::string> best;
+        for (auto &r : results)
+            if (!(flags[r] & Stale) && (!best || times[r] > times[*best]))
+                best = r;
+        return best;
+    }
+
+    bool mergeText(const std::string &base, const std::string &ours, const std::string &theirs,
+                   std::string &out, const std::string &oursLabel, const std::string &theirsLabel)
+    {
+        util::TraceScope scope("merge.text");
+        auto B = splitLines(base);
+        auto A = hunksAgainst(base, ours);
+        auto T = hunksAgainst(base, theirs);
+        bool clean = true;
+        out.clear();
+        auto emit = [&](const std::vector<std::string> &ls)
+        {
+            for (auto &l : ls)
+                out.append(l).push_back('\n');
+        };
+
+        size_t pos = 0, i = 0, j = 0;
+        while (i < A.size() || j < T.size())
+        {
+            // Grow a cluster of hunks from either side that overlap or touch.
+            bool fromA = j >= T.size() || (i < A.size() && A[i].start <= T[j].start);
+            size_t start = fromA ? A[i].start : T[j].start;
+            size_t end = fromA ? A[i].end : T[j].end;
+            size_t i2 = i, j2 = j;
+            for (bool grew = true; grew;)
+            {
+                grew = false;
+                for (; i2 < A.size() && A[i2].start <= end; i2++, grew = true)
+                    end = std::max(end, A[i2].end);
+                for (; j2 < T.size() && T[j2].start <= end; j2++, grew = true)
+                    end = std::max(end, T[j2].end);
+            }
+
+            emit(std::vector<std::string>(B.begin() + pos, B.begin() + start));
+            auto o = sideText(B, A.data() + i, A.data() + i2, start, end);
+            auto t = sideText(B, T.data() + j, T.data() + j2, start, end);
+            if (i2 == i)
+                emit(t);
+            else if (j2 == j || o == t)
+                emit(o);
+            else
+            {
+                clean = false;
+                out += "<<<<<<< " + oursLabel + "\n";
+                emit(o);
+                out += "=======\n";
+                emit(t);
+                out += ">>>>>>> " + theirsLabel + "\n";
+            }
+            pos = end;
+            i = i2;
+            j = j2;
+        }
+        emit(std::vector<std::string>(B.begin() + pos, B.end()));
+        return clean;
+    }
+
+    TreeMerger::TreeMerger(ObjectStore &store, std::string oursLabel, std::string theirsLabel)
+        : store_(store), oursLabel_(std::move(oursLabel)), theirsLabel_(std::move(theirsLabel)) {}
+
+    std::string TreeMerger::merge(const std::string &base, const std::string &ours, const std::string &theirs)
+    {
+        util::TraceScope scope("merge.tree");
+        auto merged = mergeDir(base, ours, theirs, "");
+        return merged.empty() ? store_.writeTree({}) : merged;
+    }
+
+    std::string TreeMerger::mergeDir(const std::string &base, const std::string &ours, const std::string &theirs,
+                                     const std::string &prefix)
+    {
+        if (ours == theirs)
+            return ours;
+        if (base == ours)
+            return theirs;
+        if (base == theirs)
+            return ours;
+
+        std::array<std::vector<TreeEntry>, 3> sides;
+        const std::string *hashes[3] = {&base, &ours, &theirs};
+        for (int s = 0; s < 3; s++)
+        {
+            if (hashes[s]->empty())
+                continue;
+            treesRead_++;
+            store_.readTree(*hashes[s], sides[s]);
+        }
+        std::map<std::string, std::array<const TreeEntry *, 3>> byName;
+        for (int s = 0; s < 3; s++)
+            for (auto &e : sides[s])
+                byName[e.name][s] = &e;
+
+        auto isDir = [](const TreeEntry *e)
+        { return e && e->mode == "040000"; };
+        auto same = [](const TreeEntry *x, const TreeEntry *y)
+        { return x == y || (x && y && x->mode == y->mode && x->hash == y->hash); };
+
+        // Same layout as Repository::writeTreeRecursive: files, then directories.
+        std::vector<TreeEntry> files, dirs;
+        auto keep = [&](const TreeEntry *e)
+        {
+            if (e)
+                (isDir(e) ? dirs : files).push_back(*e);
+        };
+        for (auto &kv : byName)
+        {
+            auto [b, o, t] = kv.second;
+            auto path = prefix + kv.first;
+            if (same(o, t))
+                keep(o);
+            else if (same(b, o))
+                keep(t);
+            else if (same(b, t))
+                keep(o);
+            else if ((!b || isDir(b)) && (!o || isDir(o)) && (!t || isDir(t)))
+            {
+                auto h = mergeDir(b ? b->hash : "", o ? o->hash : "", t ? t->hash : "", path + "/");
+                if (!h.empty())
+                    dirs.push_back({"040000", kv.first, h});
+            }
+            else if (o && t && !isDir(o) && !isDir(t))
+            {
+                std::string bb, ob, tb, merged;
+                if (b && !isDir(b))
+                    store_.readBlob(b->hash, bb);
+                store_.readBlob(o->hash, ob);
+                store_.readBlob(t->hash, tb);
+                if (binary(ob) || binary(tb) || binary(bb))
+                {
+                    conflicts_.push_back({path, "binary"});
+                    keep(o);
+                    continue;
+                }
+                if (!mergeText(bb, ob, tb, merged, oursLabel_, theirsLabel_))
+                    conflicts_.push_back({path, b && !isDir(b) ? "content" : "add/add"});
+                files.push_back({"100644", kv.first, store_.writeBlob(merged)});
+            }
+            else if (!o || !t)
+            {
+                conflicts_.push_back({path, "modify/delete"});
+                keep(o ? o : t);
+            }
+            else
+            {
+                conflicts_.push_back({path, "file/directory"});
+                keep(o);
+            }
+        }
+        if (files.empty() && dirs.empty())
+            return "";
+        files.insert(files.end(), dirs.begin(), dirs.end());
+        return store_.writeTree(files);
+    }
+
+}
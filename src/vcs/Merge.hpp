@@ -0,0 +1,52 @@
+#pragma once
+#include "vcs/ObjectStore.hpp"
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace vcs
+{
+
+    struct MergeConflict
+    {
+        std::string path;
+        std::string kind; // "content", "add/add", "modify/delete", "file/directory", "binary"
+    };
+
+    // Best common ancestor of two commits: paints both histories newest-first
+    // (by commit time) and stops once every queued commit lies below a
+    // common one, so only the divergent part of history is read.
+    std::optional<std::string> mergeBase(const ObjectStore &store, const std::string &a, const std::string &b);
+
+    // Line-level three-way merge built on diffText. Returns false when
+    // overlapping edits were left in `out` between conflict markers.
+    bool mergeText(const std::string &base, const std::string &ours, const std::string &theirs,
+                   std::string &out, const std::string &oursLabel = "ours", const std::string &theirsLabel = "theirs");
+
+    // Recursive three-way tree merge. Whenever two of the three hashes of an
+    // entry agree (a subtree changed on one side only) the result is decided
+    // without reading the subtree, so merge cost follows the size of the
+    // divergence rather than of the tree. Conflicted blobs are stored with
+    // markers and reported; the merged tree is always written.
+    class TreeMerger
+    {
+    public:
+        TreeMerger(ObjectStore &store, std::string oursLabel, std::string theirsLabel);
+
+        // Tree hashes; "" stands for an absent tree. Returns the merged tree.
+        std::string merge(const std::string &base, const std::string &ours, const std::string &theirs);
+
+        const std::vector<MergeConflict> &conflicts() const { return conflicts_; }
+        size_t treesRead() const { return treesRead_; }
+
+    private:
+        ObjectStore &store_;
+        std::string oursLabel_, theirsLabel_;
+        std::vector<MergeConflict> conflicts_;
+        size_t treesRead_ = 0;
+
+        std::string mergeDir(const std::string &base, const std::string &ours, const std::string &theirs,
+                             const std::string &prefix);
+    };
+
+}
@@ -1,45 +1,251 @@
 #include "vcs/ObjectStore.hpp"
+#include "fs/AsyncIo.hpp"
 #include "fs/FileOps.hpp"
 #include "util/Sha256.hpp"
+#include "util/Trace.hpp"
+#include <algorithm>
+#include <cstdlib>
 #include <sstream>
+#include <tuple>
+#include <unordered_set>
 
 namespace vcs
 {
 
+    namespace
+    {
+        constexpr size_t kCacheLimit = 1 << 16;
+    }
+
     ObjectStore::ObjectStore(const fs::path &repoDir)
         : repoDir_(repoDir), objectsDir_(repoDir / ".chronofs" / "objects")
     {
         std::filesystem::create_directories(objectsDir_);
+        std::error_code ec;
+        rawBlobs_ = std::filesystem::is_directory(rawDir(), ec);
+    }
+
+    bool ObjectStore::enableRawBlobs()
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(rawDir(), ec);
+        rawBlobs_ = !ec;
+        return rawBlobs_;
+    }
+
+    fs::path ObjectStore::blobFile(const std::string &hash) const
+    {
+        if (!rawBlobs_)
+            return {};
+        std::error_code ec;
+        auto p = rawDir() / hash;
+        util::Trace::add(util::Counter::FsOps);
+        return std::filesystem::is_regular_file(p, ec) ? p : fs::path();
+    }
+
+    void ObjectStore::clearCache() const
+    {
+        std::lock_guard<std::mutex> lock(cacheMu_);
+        treeCache_.clear();
+        commitCache_.clear();
     }
 
     bool ObjectStore::writeObject(const std::string &content, std::string &outHash)
     {
-        outHash = util::Sha256::hashHex(content);
+        util::TraceScope scope("object.write");
+        {
+            util::TraceScope hashScope("hash");
+            util::Trace::add(util::Counter::BytesHashed, content.size());
+            outHash = util::Sha256::hashHex(content);
+        }
         auto path = objectsDir_ / outHash;
+        util::Trace::add(util::Counter::FsOps);
         if (!std::filesystem::exists(path))
         {
-            if (!fsops::writeFile(path, content))
+            if (!fsops::writeFileAtomic(path, content))
                 return false;
+            util::Trace::add(util::Counter::ObjectsWritten);
+        }
+        else
+        {
+            // Freshen the mtime so a concurrent gc's grace period covers an
+            // object we are about to reference again.
+            std::error_code ec;
+            util::Trace::add(util::Counter::FsOps);
+            std::filesystem::last_write_time(path, fs::file_time_type::clock::now(), ec);
+            util::Trace::add(util::Counter::CacheHits);
         }
         return true;
     }
 
+    bool ObjectStore::exists(const std::string &hash) const
+    {
+        std::error_code ec;
+        return std::filesystem::exists(objectPath(hash), ec) ||
+               (rawBlobs_ && std::filesystem::exists(rawDir() / hash, ec));
+    }
+
     bool ObjectStore::readObject(const std::string &hash, std::string &out) const
     {
-        auto path = objectsDir_ / hash;
-        return fsops::readFile(path, out);
+        util::TraceScope scope("object.read");
+        util::Trace::add(util::Counter::ObjectsRead);
+        return fsops::readFile(objectPath(hash), out);
+    }
+
+    bool ObjectStore::readRaw(const std::string &hash, std::string &out) const
+    {
+        if (readObject(hash, out))
+            return true;
+        if (!rawBlobs_ || !fsops::readFile(rawDir() / hash, out))
+            return false;
+        out.insert(0, "blob\n");
+        return true;
+    }
+
+    bool ObjectStore::storeRaw(const std::string &hash, const std::string &content)
+    {
+        // Stored under the hash of what arrived, so damaged content can never
+        // take the expected name. Blobs go through writeBlob so they land in
+        // the raw layout when enabled.
+        std::string h;
+        if (content.rfind("blob\n", 0) == 0)
+            h = writeBlob(content.substr(5));
+        else
+            writeObject(content, h);
+        return h == hash && exists(hash);
+    }
+
+    std::string ObjectStore::hashBlob(const std::string &data)
+    {
+        util::TraceScope hashScope("hash");
+        util::Trace::add(util::Counter::BytesHashed, data.size() + 5);
+        util::Sha256 sha;
+        sha.update("blob\n");
+        sha.update(data);
+        return util::Sha256::toHex(sha.digest());
+    }
+
+    bool ObjectStore::storeBlob(const std::string &hash, const std::string &data)
+    {
+        util::TraceScope scope("object.write");
+        bool ok = rawBlobs_ ? fsops::writeFileAtomic(rawDir() / hash, data)
+                            : fsops::writeFileAtomic(objectPath(hash), "blob\n" + data);
+        if (ok)
+            util::Trace::add(util::Counter::ObjectsWritten);
+        return ok;
+    }
+
+    std::unordered_set<std::string> ObjectStore::listObjects() const
+    {
+        std::unordered_set<std::string> out;
+        for (auto &dir : {objectsDir_, rawDir()})
+        {
+            std::error_code ec;
+            for (auto it = fs::directory_iterator(dir, ec); !ec && it != fs::directory_iterator(); it.increment(ec))
+                if (it->is_regular_file(ec))
+                    out.insert(it->path().filename().string());
+        }
+        return out;
+    }
+
+    bool ObjectStore::freshen(const std::string &hash, fs::file_time_type when) const
+    {
+        std::error_code ec;
+        util::Trace::add(util::Counter::FsOps);
+        std::filesystem::last_write_time(objectPath(hash), when, ec);
+        if (ec && rawBlobs_)
+        {
+            ec.clear();
+            util::Trace::add(util::Counter::FsOps);
+            std::filesystem::last_write_time(rawDir() / hash, when, ec);
+        }
+        return !ec;
     }
 
     std::string ObjectStore::writeBlob(const std::string &data)
     {
-        std::string content = "blob\n" + data;
         std::string h;
-        writeObject(content, h);
+        if (!rawBlobs_)
+        {
+            writeObject("blob\n" + data, h);
+            return h;
+        }
+        util::TraceScope scope("object.write");
+        h = hashBlob(data);
+        auto path = rawDir() / h;
+        util::Trace::add(util::Counter::FsOps);
+        std::error_code ec;
+        if (std::filesystem::exists(path, ec))
+        {
+            util::Trace::add(util::Counter::FsOps);
+            std::filesystem::last_write_time(path, fs::file_time_type::clock::now(), ec);
+            util::Trace::add(util::Counter::CacheHits);
+        }
+        else if (fsops::writeFileAtomic(path, data))
+        {
+            util::Trace::add(util::Counter::ObjectsWritten);
+        }
         return h;
     }
 
+    std::vector<std::string> ObjectStore::writeBlobs(std::vector<std::string> bodies, fsops::AsyncIo &io)
+    {
+        util::TraceScope scope("object.write");
+        std::vector<std::string> hashes(bodies.size());
+        std::vector<fsops::IoRequest> writes;
+        std::vector<fs::path> targets; // parallel to writes
+        std::unordered_set<std::string> queued;
+        auto now = fs::file_time_type::clock::now();
+        for (size_t i = 0; i < bodies.size(); i++)
+        {
+            hashes[i] = hashBlob(bodies[i]);
+            auto path = rawBlobs_ ? rawDir() / hashes[i] : objectPath(hashes[i]);
+            util::Trace::add(util::Counter::FsOps);
+            std::error_code ec;
+            if (std::filesystem::exists(path, ec))
+            {
+                util::Trace::add(util::Counter::FsOps);
+                std::filesystem::last_write_time(path, now, ec);
+                util::Trace::add(util::Counter::CacheHits);
+            }
+            else if (queued.insert(hashes[i]).second)
+            {
+                fsops::IoRequest w;
+                w.path = fsops::tempSibling(path);
+                w.data = rawBlobs_ ? std::move(bodies[i]) : "blob\n" + bodies[i];
+                writes.push_back(std::move(w));
+                targets.push_back(std::move(path));
+            }
+        }
+        // Written under temporary names and renamed once complete, like
+        // fsops::writeFileAtomic, so no reader sees a partial object.
+        io.writeFiles(writes);
+        for (size_t i = 0; i < writes.size(); i++)
+        {
+            std::error_code ec;
+            if (writes[i].ok)
+            {
+                util::Trace::add(util::Counter::FsOps);
+                std::filesystem::rename(writes[i].path, targets[i], ec);
+            }
+            if (!writes[i].ok || ec)
+            {
+                util::Trace::add(util::Counter::FsOps);
+                std::filesystem::remove(writes[i].path, ec);
+            }
+            else
+                util::Trace::add(util::Counter::ObjectsWritten);
+        }
+        return hashes;
+    }
+
     bool ObjectStore::readBlob(const std::string &hash, std::string &out) const
     {
+        if (rawBlobs_ && fsops::readFile(rawDir() / hash, out))
+        {
+            util::Trace::add(util::Counter::ObjectsRead);
+            return true;
+        }
         std::string content;
         if (!readObject(hash, content))
             return false;
@@ -64,11 +270,31 @@ namespace vcs
 
     bool ObjectStore::readTree(const std::string &hash, std::vector<TreeEntry> &out) const
     {
+        {
+            std::lock_guard<std::mutex> lock(cacheMu_);
+            auto cached = treeCache_.find(hash);
+            if (cached != treeCache_.end())
+            {
+                util::Trace::add(util::Counter::CacheHits);
+                out = cached->second;
+                return true;
+            }
+        }
         std::string content;
-        if (!readObject(hash, content))
+        if (!readObject(hash, content) || !parseTree(content, out))
             return false;
+        std::lock_guard<std::mutex> lock(cacheMu_);
+        if (treeCache_.size() >= kCacheLimit)
+            treeCache_.clear();
+        treeCache_.emplace(hash, out);
+        return true;
+    }
+
+    bool ObjectStore::parseTree(const std::string &content, std::vector<TreeEntry> &out)
+    {
         if (content.rfind("tree\n", 0) != 0)
             return false;
+        util::TraceScope scope("tree.parse");
         std::istringstream iss(content.substr(5));
         std::string mode, name, hashv;
         out.clear();
@@ -79,19 +305,71 @@ namespace vcs
         return true;
     }
 
+    std::string ObjectStore::serializeTags(std::vector<TagEntry> entries)
+    {
+        std::sort(entries.begin(), entries.end(), [](const TagEntry &a, const TagEntry &b)
+                  { return std::tie(a.path, a.tag) < std::tie(b.path, b.tag); });
+        std::string out = "tags\n";
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            auto &e = entries[i];
+            if (i > 0 && e.path == entries[i - 1].path && e.tag == entries[i - 1].tag)
+                continue;
+            out.append(e.path).append(1, '\t').append(e.tag).append(1, '\n');
+        }
+        return out;
+    }
+
+    std::string ObjectStore::writeTags(const std::vector<TagEntry> &entries)
+    {
+        std::string h;
+        writeObject(serializeTags(entries), h);
+        return h;
+    }
+
+    bool ObjectStore::readTags(const std::string &hash, std::vector<TagEntry> &out) const
+    {
+        std::string content;
+        return readObject(hash, content) && parseTags(content, out);
+    }
+
+    bool ObjectStore::parseTags(const std::string &content, std::vector<TagEntry> &out)
+    {
+        if (content.rfind("tags\n", 0) != 0)
+            return false;
+        out.clear();
+        for (size_t pos = 5; pos < content.size();)
+        {
+            size_t eol = content.find('\n', pos);
+            if (eol == std::string::npos)
+                eol = content.size();
+            size_t tab = content.find('\t', pos);
+            if (tab == std::string::npos || tab > eol)
+                return false;
+            out.push_back({content.substr(pos, tab - pos), content.substr(tab + 1, eol - tab - 1)});
+            pos = eol + 1;
+        }
+        return true;
+    }
+
     std::string ObjectStore::writeCommit(const std::string &treeHash,
-                                         const std::string &parentHash,
+                                         const std::vector<std::string> &parents,
                                          const std::string &author,
                                          long long timestamp,
-                                         const std::string &message)
+                                         const std::string &message,
+                                         const std::string &tagsHash)
     {
         std::ostringstream oss;
         oss << "commit\n";
         oss << "tree " << treeHash << "\n";
-        if (!parentHash.empty())
-            oss << "parent " << parentHash << "\n";
+        for (auto &p : parents)
+            if (!p.empty())
+                oss << "parent " << p << "\n";
         oss << "author " << author << "\n";
         oss << "time " << timestamp << "\n";
+        // Omitted when empty, so untagged commits hash as they always have.
+        if (!tagsHash.empty())
+            oss << "tags " << tagsHash << "\n";
         oss << "message\n"
             << message << "\n";
         std::string h;
@@ -103,18 +381,75 @@ namespace vcs
                                  std::string &parentHash, std::string &author,
                                  long long &timestamp, std::string &message) const
     {
-        std::string content;
-        if (!readObject(hash, content))
+        std::vector<std::string> parents;
+        if (!readCommit(hash, treeHash, parents, author, timestamp, message))
+            return false;
+        parentHash = parents.empty() ? "" : parents.front();
+        return true;
+    }
+
+    bool ObjectStore::readCommit(const std::string &hash, std::string &treeHash,
+                                 std::vector<std::string> &parents, std::string &author,
+                                 long long &timestamp, std::string &message,
+                                 std::string *tagsHash) const
+    {
+        {
+            std::lock_guard<std::mutex> lock(cacheMu_);
+            auto cached = commitCache_.find(hash);
+            if (cached != commitCache_.end())
+            {
+                util::Trace::add(util::Counter::CacheHits);
+                auto &c = cached->second;
+                treeHash = c.tree;
+                parents = c.parents;
+                author = c.author;
+                timestamp = c.timestamp;
+                message = c.message;
+                if (tagsHash)
+                    *tagsHash = c.tags;
+                return true;
+            }
+        }
+        std::string content, tags;
+        if (!readObject(hash, content) ||
+            !parseCommit(content, treeHash, parents, author, timestamp, message, &tags))
             return false;
+        if (tagsHash)
+            *tagsHash = tags;
+        std::lock_guard<std::mutex> lock(cacheMu_);
+        if (commitCache_.size() >= kCacheLimit)
+            commitCache_.clear();
+        commitCache_.emplace(hash, CommitInfo{treeHash, author, message, tags, parents, timestamp});
+        return true;
+    }
+
+    std::string ObjectStore::commitTags(const std::string &hash) const
+    {
+        std::string tree, author, message;
+        std::vector<std::string> parents;
+        long long ts = 0;
+        std::string tags;
+        if (!readCommit(hash, tree, parents, author, ts, message, &tags))
+            return "";
+        return tags;
+    }
+
+    bool ObjectStore::parseCommit(const std::string &content, std::string &treeHash,
+                                  std::vector<std::string> &parents, std::string &author,
+                                  long long &timestamp, std::string &message,
+                                  std::string *tagsHash)
+    {
         if (content.rfind("commit\n", 0) != 0)
             return false;
         std::istringstream iss(content.substr(7));
         std::string line;
         treeHash.clear();
-        parentHash.clear();
+        parents.clear();
         author.clear();
         timestamp = 0;
         message.clear();
+        if (tagsHash)
+            tagsHash->clear();
         while (std::getline(iss, line))
         {
             if (line.rfind("tree ", 0) == 0)
@@ -123,7 +458,7 @@ namespace vcs
             }
             else if (line.rfind("parent ", 0) == 0)
             {
-                parentHash = line.substr(7);
+                parents.push_back(line.substr(7));
             }
             else if (line.rfind("author ", 0) == 0)
             {
@@ -131,7 +466,12 @@ namespace vcs
             }
             else if (line.rfind("time ", 0) == 0)
             {
-                timestamp = std::stoll(line.substr(5));
+                timestamp = std::strtoll(line.c_str() + 5, nullptr, 10);
+            }
+            else if (line.rfind("tags ", 0) == 0)
+            {
+                if (tagsHash)
+                    *tagsHash = line.substr(5);
             }
             else if (line == "message")
             {
@@ -147,4 +487,4 @@ namespace vcs
         return !treeHash.empty();
     }
 
-} 
+}
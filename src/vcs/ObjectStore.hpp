@@ -2,6 +2,14 @@
 #include <string>
 #include <vector>
 #include <filesystem>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace fsops
+{
+    class AsyncIo;
+}
 
 namespace vcs
 {
@@ -14,31 +22,110 @@ namespace vcs
         std::string hash; // sha256
     };
 
+    // One line of a tags object: a "key=value" label on a path, or on the
+    // commit itself when path is empty.
+    struct TagEntry
+    {
+        std::string path;
+        std::string tag;
+    };
+
     class ObjectStore
     {
     public:
         explicit ObjectStore(const fs::path &repoDir);
 
         std::string writeBlob(const std::string &data); // returns hash
+        // Stores many blobs, writing the missing ones in one I/O batch.
+        std::vector<std::string> writeBlobs(std::vector<std::string> bodies, fsops::AsyncIo &io);
         bool readBlob(const std::string &hash, std::string &out) const;
+        static std::string hashBlob(const std::string &data);
+        // Writes a blob the caller knows to be absent (see listObjects), skipping
+        // the existence check; used by bulk import.
+        bool storeBlob(const std::string &hash, const std::string &data);
 
         std::string writeTree(const std::vector<TreeEntry> &entries);
         bool readTree(const std::string &hash, std::vector<TreeEntry> &out) const;
 
+        // One "parent" line per parent; merges record the merged-in commit second.
+        // A "tags" line names the commit's tags object, if it has one.
         std::string writeCommit(const std::string &treeHash,
-                                const std::string &parentHash,
+                                const std::vector<std::string> &parents,
                                 const std::string &author,
                                 long long timestamp,
-                                const std::string &message);
+                                const std::string &message,
+                                const std::string &tagsHash = "");
+        // `tagsHash`, if given, receives the commit's tags object ("" for none).
+        bool readCommit(const std::string &hash, std::string &treeHash,
+                        std::vector<std::string> &parents, std::string &author,
+                        long long &timestamp, std::string &message,
+                        std::string *tagsHash = nullptr) const;
+        // First-parent view for history walks that ignore merges.
         bool readCommit(const std::string &hash, std::string &treeHash,
                         std::string &parentHash, std::string &author,
                         long long &timestamp, std::string &message) const;
+        // The commit's tags object, "" when it has none or cannot be read.
+        std::string commitTags(const std::string &hash) const;
+
+        // "tags\n" then one "<path>\t<key=value>" line per entry, sorted by
+        // path then tag; serializeTags sorts and drops duplicates.
+        static std::string serializeTags(std::vector<TagEntry> entries);
+        std::string writeTags(const std::vector<TagEntry> &entries); // returns hash
+        bool readTags(const std::string &hash, std::vector<TagEntry> &out) const;
+
+        // Parse raw object content (header included) without touching the store.
+        static bool parseTree(const std::string &content, std::vector<TreeEntry> &out);
+        static bool parseCommit(const std::string &content, std::string &treeHash,
+                                std::vector<std::string> &parents, std::string &author,
+                                long long &timestamp, std::string &message,
+                                std::string *tagsHash = nullptr);
+        static bool parseTags(const std::string &content, std::vector<TagEntry> &out);
+
+        // Object content in the loose layout (header included), however it is
+        // stored; and storing such content from elsewhere, which fails unless
+        // it hashes to `hash`. Used to copy objects between repositories.
+        bool readRaw(const std::string &hash, std::string &out) const;
+        bool storeRaw(const std::string &hash, const std::string &content);
 
         fs::path objectsDir() const { return objectsDir_; }
+        fs::path objectPath(const std::string &hash) const { return objectsDir_ / hash; }
+        bool exists(const std::string &hash) const;
+        // Every stored object hash, loose and raw, from one listing per directory.
+        std::unordered_set<std::string> listObjects() const;
+        // Sets the object's mtime to `when`, as writing it again would, so a
+        // concurrent gc's grace period covers it; false if it is gone.
+        bool freshen(const std::string &hash, fs::file_time_type when) const;
+
+        // Raw blob layout: blob bodies are stored without the "blob\n" header
+        // under objects/raw/<hash>, so the directory records the type and the
+        // file can be reflinked straight into the working tree. Hashes are the
+        // same as for loose blobs; older loose blobs remain readable.
+        fs::path rawDir() const { return objectsDir_ / "raw"; }
+        bool rawBlobs() const { return rawBlobs_; }
+        bool enableRawBlobs();
+        // Path of the raw body of a blob, or empty when it is stored loose.
+        fs::path blobFile(const std::string &hash) const;
+
+        void clearCache() const;
 
     private:
         fs::path repoDir_;
         fs::path objectsDir_;
+        bool rawBlobs_ = false;
+
+        // Objects are immutable, so parsed trees and commits can be cached
+        // without invalidation; the maps are simply dropped when they grow large.
+        // Guarded by cacheMu_ so reads may run from several threads.
+        mutable std::mutex cacheMu_;
+        struct CommitInfo
+        {
+            std::string tree, author, message, tags;
+            std::vector<std::string> parents;
+            long long timestamp;
+        };
+        mutable std::unordered_map<std::string, std::vector<TreeEntry>> treeCache_;
+        mutable std::unordered_map<std::string, CommitInfo> commitCache_;
+
         bool readObject(const std::string &hash, std::string &out) const;
         bool writeObject(const std::string &content, std::string &outHash);
     };
@@ -0,0 +1,118 @@
+#include "vcs/PackedRefs.hpp"
+#include "fs/FileOps.hpp"
+#include "util/Trace.hpp"
+#include <string_view>
+
+namespace vcs
+{
+
+    PackedRefs::PackedRefs(fs::path file) : file_(std::move(file)) {}
+
+    void PackedRefs::refresh() const
+    {
+        std::error_code ec;
+        auto size = fs::file_size(file_, ec);
+        if (ec)
+        {
+            data_.clear();
+            loaded_ = true;
+            size_ = 0;
+            return;
+        }
+        auto mtime = fs::last_write_time(file_, ec);
+        if (loaded_ && size == size_ && mtime == mtime_)
+            return;
+        data_.clear();
+        if (!fsops::readFile(file_, data_))
+            data_.clear();
+        size_ = size;
+        mtime_ = mtime;
+        loaded_ = true;
+    }
+
+    std::optional<std::string> PackedRefs::find(const std::string &refPath) const
+    {
+        refresh();
+        std::string_view d(data_);
+        // [lo, hi) always starts and ends on line boundaries.
+        size_t lo = 0, hi = d.size();
+        while (lo < hi)
+        {
+            size_t mid = lo + (hi - lo) / 2;
+            size_t start = mid == 0 ? 0 : d.rfind('\n', mid - 1);
+            start = (start == std::string_view::npos || start < lo) ? lo : start + 1;
+            size_t end = d.find('\n', start);
+            if (end == std::string_view::npos)
+                end = d.size();
+            auto line = d.substr(start, end - start);
+            auto sp = line.find(' ');
+            auto name = sp == std::string_view::npos ? line : line.substr(sp + 1);
+            int c = name.compare(refPath);
+            if (c == 0)
+            {
+                if (sp == std::string_view::npos || sp == 0)
+                    return std::nullopt;
+                return std::string(line.substr(0, sp));
+            }
+            if (c < 0)
+                lo = end + 1;
+            else
+                hi = start;
+        }
+        return std::nullopt;
+    }
+
+    void PackedRefs::forEach(const std::function<void(const std::string &, const std::string &)> &fn) const
+    {
+        refresh();
+        std::string_view d(data_);
+        size_t pos = 0;
+        while (pos < d.size())
+        {
+            size_t end = d.find('\n', pos);
+            if (end == std::string_view::npos)
+                end = d.size();
+            auto line = d.substr(pos, end - pos);
+            auto sp = line.find(' ');
+            if (sp != std::string_view::npos && sp > 0)
+                fn(std::string(line.substr(sp + 1)), std::string(line.substr(0, sp)));
+            pos = end + 1;
+        }
+    }
+
+    bool PackedRefs::write(const std::vector<std::pair<std::string, std::string>> &refs)
+    {
+        util::TraceScope scope("refs.pack");
+        std::string data;
+        for (auto &r : refs)
+            data.append(r.second).append(1, ' ').append(r.first).append(1, '\n');
+        // Readers see either the old file or the new one, never a partial write.
+        auto lock = std::move(lock_);
+        if (!lock)
+        {
+            lock = std::make_unique<fsops::LockFile>(file_);
+            if (!lock->acquire())
+                return false;
+        }
+        if (!lock->commit(data))
+            return false;
+        loaded_ = false;
+        refresh();
+        return true;
+    }
+
+    bool PackedRefs::lock()
+    {
+        if (lock_)
+            return true;
+        auto lock = std::make_unique<fsops::LockFile>(file_);
+        if (!lock->acquire())
+            return false;
+        lock_ = std::move(lock);
+        loaded_ = false; // re-read: another process may have just replaced it
+        return true;
+    }
+
+    void PackedRefs::unlock() { lock_.reset(); }
+
+}
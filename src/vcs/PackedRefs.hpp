@@ -0,0 +1,49 @@
+#pragma once
+#include "fs/LockFile.hpp"
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace vcs
+{
+    namespace fs = std::filesystem;
+
+    // `.chronofs/packed-refs`: one "<hash> <refPath>" line per ref, sorted by
+    // refPath. Lookups binary-search the file contents in place, and listing
+    // is one sequential read, so neither cost grows with a directory of one
+    // file per ref. Loose ref files take precedence (see Repository::readRef).
+    class PackedRefs
+    {
+    public:
+        explicit PackedRefs(fs::path file);
+
+        std::optional<std::string> find(const std::string &refPath) const;
+        void forEach(const std::function<void(const std::string &refPath, const std::string &hash)> &fn) const;
+
+        // Replaces the file (via rename) with `refs`, which must be sorted by
+        // refPath. Publishes through the held lock, or takes one for the write.
+        bool write(const std::vector<std::pair<std::string, std::string>> &refs);
+
+        // `packed-refs.lock`, held from before the current contents are read
+        // until write() or unlock(), so rewrites from two processes cannot
+        // drop each other's changes.
+        bool lock();
+        void unlock();
+
+    private:
+        fs::path file_;
+        std::unique_ptr<fsops::LockFile> lock_;
+        // Reloaded when the file's size or mtime changes (e.g. under `serve`).
+        mutable std::string data_;
+        mutable fs::file_time_type mtime_{};
+        mutable uintmax_t size_ = 0;
+        mutable bool loaded_ = false;
+
+        void refresh() const;
+    };
+
+}
@@ -0,0 +1,112 @@
+#include "vcs/PathTable.hpp"
+#include <algorithm>
+
+namespace vcs
+{
+
+    PathTable::PathTable() { clear(); }
+
+    void PathTable::clear()
+    {
+        nodes_.clear();
+        arena_.clear();
+        unlinked_ = 0;
+        nodes_.push_back(Node{npos, 0, 0, {}});
+    }
+
+    void PathTable::reserve(size_t nodes, size_t nameBytes)
+    {
+        nodes_.reserve(nodes);
+        arena_.reserve(nameBytes);
+    }
+
+    PathTable::Id PathTable::child(Id dir, std::string_view name) const
+    {
+        auto &kids = nodes_[dir].children;
+        auto it = std::lower_bound(kids.begin(), kids.end(), name, [&](Id c, std::string_view n)
+                                   { return this->name(c) < n; });
+        if (it != kids.end() && this->name(*it) == name)
+            return *it;
+        return npos;
+    }
+
+    PathTable::Id PathTable::insertChild(Id dir, std::string_view name)
+    {
+        auto &kids = nodes_[dir].children;
+        auto it = std::lower_bound(kids.begin(), kids.end(), name, [&](Id c, std::string_view n)
+                                   { return this->name(c) < n; });
+        if (it != kids.end() && this->name(*it) == name)
+            return *it;
+        // Appending in sorted order (the common case for a saved index) never
+        // shifts the children vector.
+        size_t pos = it - kids.begin();
+        Id id = static_cast<Id>(nodes_.size());
+        Node n{dir, static_cast<uint32_t>(arena_.size()), static_cast<uint32_t>(name.size()), {}};
+        arena_.append(name);
+        nodes_.push_back(std::move(n));
+        auto &k = nodes_[dir].children; // nodes_ may have reallocated
+        k.insert(k.begin() + pos, id);
+        return id;
+    }
+
+    PathTable::Id PathTable::intern(std::string_view path)
+    {
+        Id cur = root;
+        size_t i = 0;
+        while (i < path.size())
+        {
+            size_t j = path.find('/', i);
+            if (j == std::string_view::npos)
+                j = path.size();
+            if (j > i)
+                cur = insertChild(cur, path.substr(i, j - i));
+            i = j + 1;
+        }
+        return cur == root ? npos : cur;
+    }
+
+    PathTable::Id PathTable::find(std::string_view path) const
+    {
+        Id cur = root;
+        size_t i = 0;
+        while (i < path.size() && cur != npos)
+        {
+            size_t j = path.find('/', i);
+            if (j == std::string_view::npos)
+                j = path.size();
+            if (j > i)
+                cur = child(cur, path.substr(i, j - i));
+            i = j + 1;
+        }
+        return cur == root ? npos : cur;
+    }
+
+    void PathTable::unlink(Id id)
+    {
+        if (id == root || id >= nodes_.size() || !nodes_[id].children.empty())
+            return;
+        Id p = nodes_[id].parent;
+        if (p == npos)
+            return;
+        auto &kids = nodes_[p].children;
+        kids.erase(std::remove(kids.begin(), kids.end(), id), kids.end());
+        nodes_[id].parent = npos;
+        unlinked_++;
+    }
+
+    std::string PathTable::path(Id id) const
+    {
+        std::vector<Id> chain;
+        for (Id cur = id; cur != root && cur != npos; cur = nodes_[cur].parent)
+            chain.push_back(cur);
+        std::string out;
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+        {
+            if (!out.empty())
+                out.push_back('/');
+            out.append(name(*it));
+        }
+        return out;
+    }
+
+}
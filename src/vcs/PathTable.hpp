@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace vcs
+{
+
+    // Directory-interned path trie. Every path segment is stored once per parent
+    // directory in a shared name arena, and children are kept sorted by name so
+    // lookup is one binary search per segment and walking yields sorted output.
+    // Node ids are stable until clear(); removed nodes are unlinked, not reused,
+    // and counted so an owner can rebuild the table once they pile up.
+    class PathTable
+    {
+    public:
+        using Id = uint32_t;
+        static constexpr Id npos = UINT32_MAX;
+        static constexpr Id root = 0;
+
+        PathTable();
+
+        void clear();
+        void reserve(size_t nodes, size_t nameBytes);
+
+        Id intern(std::string_view path);     // creates missing segments
+        Id find(std::string_view path) const; // npos if absent
+        Id child(Id dir, std::string_view name) const;
+        void unlink(Id id); // detach a childless node from its parent
+
+        Id parent(Id id) const { return nodes_[id].parent; }
+        std::string_view name(Id id) const { return std::string_view(arena_).substr(nodes_[id].nameOff, nodes_[id].nameLen); }
+        const std::vector<Id> &children(Id id) const { return nodes_[id].children; }
+        std::string path(Id id) const;
+        size_t nodeCount() const { return nodes_.size(); }
+        size_t unlinkedCount() const { return unlinked_; }
+
+        // Pre-order walk in sorted order; fn(Id, const std::string &path) sees each
+        // node below root with its full path built incrementally in one buffer.
+        template <class Fn>
+        void walk(Fn &&fn) const
+        {
+            std::string buf;
+            walkFrom(root, buf, fn);
+        }
+
+    private:
+        struct Node
+        {
+            Id parent;
+            uint32_t nameOff;
+            uint32_t nameLen;
+            std::vector<Id> children; // sorted by name
+        };
+
+        std::vector<Node> nodes_;
+        std::string arena_;
+        size_t unlinked_ = 0;
+
+        Id insertChild(Id dir, std::string_view name);
+
+        template <class Fn>
+        void walkFrom(Id dir, std::string &buf, Fn &fn) const
+        {
+            size_t base = buf.size();
+            for (Id c : nodes_[dir].children)
+            {
+                if (base)
+                    buf.push_back('/');
+                buf.append(name(c));
+                fn(c, static_cast<const std::string &>(buf));
+                walkFrom(c, buf, fn);
+                buf.resize(base);
+            }
+        }
+    };
+
+}
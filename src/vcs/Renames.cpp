@@ -0,0 +1,254 @@
+#include "vcs/Renames.hpp"
+#include "util/Sha256.hpp"
+#include "util/Trace.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace vcs
+{
+
+    namespace
+    {
+        // 16 bands of 4 rows: pairs at 50% similarity collide in some band
+        // with ~64% probability, at 80% with ~99.9%.
+        constexpr int kHashes = 64;
+        constexpr int kBands = 16;
+        constexpr int kRows = kHashes / kBands;
+        // Buckets shared by this many sources are boilerplate (licence headers,
+        // generated stubs); scoring them would bring back the quadratic case.
+        constexpr size_t kMaxBucket = 256;
+
+        uint64_t mix(uint64_t x)
+        {
+            x += 0x9e3779b97f4a7c15ull;
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+            return x ^ (x >> 31);
+        }
+
+        uint64_t fnv1a(const char *p, size_t n)
+        {
+            uint64_t h = 0xcbf29ce484222325ull;
+            for (size_t i = 0; i < n; i++)
+                h = (h ^ (unsigned char)p[i]) * 0x100000001b3ull;
+            return h;
+        }
+
+        struct Signature
+        {
+            std::array<uint64_t, kHashes> mins;
+        };
+
+        // MinHash over the set of non-blank lines (trailing whitespace ignored).
+        bool sign(const std::string &data, Signature &sig)
+        {
+            static const auto seeds = []
+            {
+                std::array<uint64_t, kHashes> s{};
+                for (int k = 0; k < kHashes; k++)
+                    s[k] = mix(0x5eedull + k);
+                return s;
+            }();
+            sig.mins.fill(UINT64_MAX);
+            bool any = false;
+            size_t pos = 0;
+            while (pos < data.size())
+            {
+                size_t end = data.find('\n', pos);
+                if (end == std::string::npos)
+                    end = data.size();
+                size_t last = end;
+                while (last > pos && (data[last - 1] == ' ' || data[last - 1] == '\t' || data[last - 1] == '\r'))
+                    last--;
+                if (last > pos)
+                {
+                    uint64_t h = fnv1a(data.data() + pos, last - pos);
+                    for (int k = 0; k < kHashes; k++)
+                        sig.mins[k] = std::min(sig.mins[k], mix(h ^ seeds[k]));
+                    any = true;
+                }
+                pos = end + 1;
+            }
+            return any;
+        }
+
+        uint64_t bandKey(const Signature &sig, int band)
+        {
+            uint64_t h = mix((uint64_t)band);
+            for (int r = 0; r < kRows; r++)
+                h = mix(h ^ sig.mins[band * kRows + r]);
+            return h;
+        }
+
+        int similarity(const Signature &a, const Signature &b)
+        {
+            int same = 0;
+            for (int k = 0; k < kHashes; k++)
+                same += a.mins[k] == b.mins[k];
+            return same * 100 / kHashes;
+        }
+
+        std::string baseName(const std::string &path)
+        {
+            auto slash = path.rfind('/');
+            return slash == std::string::npos ? path : path.substr(slash + 1);
+        }
+    }
+
+    std::vector<RenamePair> detectRenames(const ObjectStore &store,
+                                          const std::map<std::string, std::string> &left,
+                                          const std::map<std::string, std::string> &right,
+                                          const RenameOptions &opt)
+    {
+        std::vector<RenamePair> out;
+        if (!opt.detect)
+            return out;
+        util::TraceScope scope("diff.renames");
+        static const std::string emptyBlob = util::Sha256::hashHex("blob\n");
+
+        // Deleted paths are rename sources; with copies, modified paths are
+        // similarity sources too and any left path is an exact-copy source.
+        std::vector<std::string> deleted, modified, targets;
+        std::unordered_map<std::string, std::vector<std::string>> deletedByHash;
+        std::unordered_map<std::string, std::string> anyByHash;
+        for (auto &kv : left)
+        {
+            auto it = right.find(kv.first);
+            if (it == right.end())
+            {
+                deleted.push_back(kv.first);
+                deletedByHash[kv.second].push_back(kv.first);
+            }
+            else if (it->second != kv.second)
+            {
+                modified.push_back(kv.first);
+            }
+            if (opt.copies)
+                anyByHash.emplace(kv.second, kv.first);
+        }
+        for (auto &kv : right)
+            if (!left.count(kv.first) && kv.second != emptyBlob)
+                targets.push_back(kv.first);
+        if (targets.empty() || (deleted.empty() && !opt.copies))
+            return out;
+
+        std::unordered_set<std::string> consumed, paired;
+        auto pair = [&](const std::string &from, const std::string &to, int sim)
+        {
+            bool rename = !right.count(from) && consumed.insert(from).second;
+            if (!rename && !opt.copies)
+                return false;
+            out.push_back({from, to, sim, !rename});
+            paired.insert(to);
+            return true;
+        };
+
+        // Exact matches: one hash lookup per added path.
+        for (auto &to : targets)
+        {
+            auto &h = right.at(to);
+            auto d = deletedByHash.find(h);
+            if (d != deletedByHash.end())
+            {
+                auto src = std::find_if(d->second.begin(), d->second.end(), [&](const std::string &p)
+                                        { return !consumed.count(p); });
+                if (pair(src != d->second.end() ? *src : d->second.front(), to, 100))
+                    continue;
+            }
+            auto a = opt.copies ? anyByHash.find(h) : anyByHash.end();
+            if (a != anyByHash.end())
+                pair(a->second, to, 100);
+        }
+
+        // Similar matches: sign every remaining candidate once, bucket the
+        // sources by band, and only score targets against bucket mates.
+        std::vector<std::string> sources;
+        for (auto &p : deleted)
+            if (!consumed.count(p) || opt.copies)
+                sources.push_back(p);
+        if (opt.copies)
+            sources.insert(sources.end(), modified.begin(), modified.end());
+        std::vector<std::string> rest;
+        for (auto &t : targets)
+            if (!paired.count(t))
+                rest.push_back(t);
+        if (sources.empty() || rest.empty())
+            return out;
+
+        auto load = [&](const std::string &hash, Signature &sig)
+        {
+            std::string data;
+            return hash != emptyBlob && store.readBlob(hash, data) && sign(data, sig);
+        };
+        std::vector<Signature> srcSig(sources.size());
+        std::vector<bool> srcOk(sources.size());
+        std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+        for (size_t i = 0; i < sources.size(); i++)
+        {
+            srcOk[i] = load(left.at(sources[i]), srcSig[i]);
+            if (srcOk[i])
+                for (int b = 0; b < kBands; b++)
+                    buckets[bandKey(srcSig[i], b)].push_back((uint32_t)i);
+        }
+
+        struct Candidate
+        {
+            int sim;
+            bool sameName;
+            size_t target, source;
+        };
+        std::vector<Candidate> cands;
+        int minSim = (int)(opt.threshold * 100 + 0.5);
+        std::vector<uint32_t> seen;
+        for (size_t t = 0; t < rest.size(); t++)
+        {
+            Signature sig;
+            if (!load(right.at(rest[t]), sig))
+                continue;
+            seen.clear();
+            for (int b = 0; b < kBands; b++)
+            {
+                auto it = buckets.find(bandKey(sig, b));
+                if (it == buckets.end() || it->second.size() > kMaxBucket)
+                    continue;
+                seen.insert(seen.end(), it->second.begin(), it->second.end());
+            }
+            std::sort(seen.begin(), seen.end());
+            seen.erase(std::unique(seen.begin(), seen.end()), seen.end());
+            for (auto s : seen)
+            {
+                // The estimate can reach 100 for near-identical files; keep
+                // that value for exact matches.
+                int sim = std::min(similarity(sig, srcSig[s]), 99);
+                if (sim >= minSim)
+                    cands.push_back({sim, baseName(sources[s]) == baseName(rest[t]), t, s});
+            }
+        }
+
+        // Best pairs first; a matching file name breaks ties, then path order.
+        std::sort(cands.begin(), cands.end(), [&](const Candidate &x, const Candidate &y)
+                  {
+                      if (x.sim != y.sim)
+                          return x.sim > y.sim;
+                      if (x.sameName != y.sameName)
+                          return x.sameName;
+                      if (x.target != y.target)
+                          return x.target < y.target;
+                      return x.source < y.source; });
+        for (auto &c : cands)
+        {
+            auto &to = rest[c.target];
+            if (paired.count(to))
+                continue;
+            pair(sources[c.source], to, c.sim);
+        }
+
+        std::sort(out.begin(), out.end(), [](const RenamePair &x, const RenamePair &y)
+                  { return x.to < y.to; });
+        return out;
+    }
+
+}
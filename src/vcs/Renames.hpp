@@ -0,0 +1,36 @@
+#pragma once
+#include "vcs/ObjectStore.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace vcs
+{
+
+    struct RenameOptions
+    {
+        bool detect = true;      // --no-renames turns this off
+        bool copies = false;     // -C: also pair added paths with files that still exist
+        double threshold = 0.5;  // -M<n>: minimum estimated similarity, 0..1
+    };
+
+    struct RenamePair
+    {
+        std::string from, to;
+        int similarity = 100; // percent
+        bool copy = false;
+    };
+
+    // Pairs paths that only exist on the left of a diff with paths that only
+    // exist on the right. Identical blob hashes are matched first; the rest
+    // are compared by MinHash signatures over line fingerprints, and LSH
+    // banding limits scoring to pairs that share a band, so the work grows
+    // with the number of files rather than their product. Each left path is
+    // renamed at most once; with opt.copies, added paths may also be copies
+    // of any left path (exact) or of a deleted/modified one (similar).
+    std::vector<RenamePair> detectRenames(const ObjectStore &store,
+                                          const std::map<std::string, std::string> &left,
+                                          const std::map<std::string, std::string> &right,
+                                          const RenameOptions &opt);
+
+}
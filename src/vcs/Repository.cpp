@@ -1,22 +1,123 @@
 #include "vcs/Repository.hpp"
+#include "fs/AsyncIo.hpp"
+#include "fs/DirWalk.hpp"
 #include "fs/FileOps.hpp"
+#include "fs/FsMonitor.hpp"
+#include "fs/LockFile.hpp"
 #include "vcs/Diff.hpp"
+#include "util/Trace.hpp"
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <sstream>
 #include <chrono>
 #include <map>
 #include <set>
+#include <tuple>
 
 namespace vcs
 {
 
+    namespace
+    {
+        // Bulk paths hand fsops::AsyncIo this many files (or bytes, where
+        // sizes are known up front) per batch to bound memory.
+        constexpr size_t kBatchFiles = 256;
+        constexpr uintmax_t kBatchBytes = 64u << 20;
+
+        long long now()
+        {
+            return std::chrono::duration_cast<std::chrono::seconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                .count();
+        }
+
+        bool isHash(const std::string &s)
+        {
+            return s.size() == 64 && std::all_of(s.begin(), s.end(), [](char c)
+                                                 { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+        }
+
+        bool validBranchName(const std::string &name)
+        {
+            if (name.empty() || name.front() == '/' || name.front() == '-' || name.front() == '.' ||
+                name.back() == '/' || name.find("..") != std::string::npos || name.find("//") != std::string::npos ||
+                name == "HEAD" || (name.size() >= 5 && name.compare(name.size() - 5, 5, ".lock") == 0))
+                return false;
+            return std::none_of(name.begin(), name.end(), [](char c)
+                                { return (unsigned char)c <= ' ' || std::strchr("~^:?*[\\", c); });
+        }
+
+        std::string trimmed(std::string s)
+        {
+            while (!s.empty() && (s.back() == '\n' || s.back() == '\r'))
+                s.pop_back();
+            return s;
+        }
+
+        // A linked worktree's .chronofs/commondir names the shared directory.
+        fs::path sharedDir(const fs::path &root)
+        {
+            std::string s;
+            if (fsops::readFile(root / ".chronofs" / "commondir", s) && !(s = trimmed(s)).empty())
+                return s;
+            return root / ".chronofs";
+        }
+
+        bool isLockFile(const fs::path &p) { return p.extension() == ".lock"; }
+
+        bool replaceLocked(const fs::path &p, const std::string &data)
+        {
+            fsops::LockFile lock(p);
+            return lock.acquire() && lock.commit(data);
+        }
+
+        // In the index, or inside a sparse directory entry.
+        bool tracked(const Index &index, const std::string &path)
+        {
+            if (index.has(path))
+                return true;
+            for (auto slash = path.rfind('/'); slash != std::string::npos && slash > 0; slash = path.rfind('/', slash - 1))
+            {
+                auto *e = index.find(path.substr(0, slash));
+                if (e && e->mode == "040000")
+                    return true;
+            }
+            return false;
+        }
+
+        // Holds the index lock for one read-modify-write; Index::save() inside
+        // the scope releases it early.
+        struct IndexLock
+        {
+            Index &index;
+            bool ok;
+            explicit IndexLock(Index &i) : index(i), ok(i.lock()) {}
+            ~IndexLock() { index.unlock(); }
+        };
+    }
+
     Repository::Repository(const fs::path &root)
-        : root_(fs::absolute(root)), store_(root_), index_(root_) {}
+        : root_(fs::absolute(root)), common_(sharedDir(root_)), store_(common_.parent_path()), index_(root_),
+          packedRefs_(common_ / "packed-refs"), tagIndex_(common_ / "tag-index") {}
 
-    bool Repository::init()
+    Repository::~Repository() = default;
+
+    fsops::AsyncIo &Repository::io() const
+    {
+        if (!io_)
+            io_ = std::make_unique<fsops::AsyncIo>();
+        return *io_;
+    }
+
+    bool Repository::init(bool rawBlobs)
     {
+        // Switching an existing repository only affects blobs written later.
         if (isInitialized())
-            return true;
+            return !rawBlobs || store_.enableRawBlobs();
+        if (rawBlobs && !store_.enableRawBlobs())
+            return false;
         std::filesystem::create_directories(store_.objectsDir());
         std::filesystem::create_directories(refsHeadsDir());
         writeFile(headFile(), "ref: refs/heads/main\n");
@@ -26,7 +127,9 @@ namespace vcs
         return true;
     }
 
-    bool Repository::isInitialized() const { return std::filesystem::exists(dotDir()); }
+    // HEAD rather than .chronofs: constructing the object store already
+    // creates .chronofs/objects.
+    bool Repository::isInitialized() const { return std::filesystem::exists(headFile()); }
 
     std::string Repository::currentHeadRef() const
     {
@@ -45,19 +148,46 @@ namespace vcs
 
     bool Repository::setHeadRef(const std::string &refPath)
     {
-        return writeFile(headFile(), "ref: " + refPath + "\n");
+        return replaceLocked(headFile(), "ref: " + refPath + "\n");
+    }
+
+    bool Repository::advanceHead(const std::string &commitHash, const std::optional<std::string> &expected)
+    {
+        auto ref = currentHeadRef();
+        std::string head;
+        if (ref.empty() && readFile(headFile(), head) && !head.empty())
+        {
+            // Detached: HEAD itself is the ref.
+            fsops::LockFile lock(headFile());
+            if (!lock.acquire() || (expected && (!readFile(headFile(), head) || trimmed(head) != *expected)))
+                return false;
+            return lock.commit(commitHash + "\n");
+        }
+        if (ref.empty())
+        {
+            ref = "refs/heads/main";
+            setHeadRef(ref);
+        }
+        return updateRef(ref, commitHash, expected);
     }
 
-    bool Repository::updateRef(const std::string &refPath, const std::string &commitHash)
+    bool Repository::updateRef(const std::string &refPath, const std::string &commitHash,
+                               const std::optional<std::string> &expected)
     {
-        return writeFile(dotDir() / refPath, commitHash + "\n");
+        fsops::LockFile lock(commonDir() / refPath);
+        if (!lock.acquire())
+            return false;
+        // Checked under the lock: nobody else can move the ref before we do.
+        if (expected && readRef(refPath).value_or("") != *expected)
+            return false;
+        return lock.commit(commitHash + "\n");
     }
 
     std::optional<std::string> Repository::readRef(const std::string &refPath) const
     {
         std::string s;
-        if (!readFile(dotDir() / refPath, s))
-            return std::nullopt;
+        if (!readFile(commonDir() / refPath, s))
+            return packedRefs_.find(refPath);
         if (!s.empty() && s.back() == '\n')
             s.pop_back();
         if (s.empty())
@@ -65,12 +195,148 @@ namespace vcs
         return s;
     }
 
+    bool Repository::deleteRef(const std::string &refPath)
+    {
+        fsops::LockFile lock(commonDir() / refPath);
+        if (!lock.acquire())
+            return false;
+        // The packed entry goes first, so readers never fall back to it once
+        // the loose file is gone.
+        bool packed = packedRefs_.find(refPath).has_value();
+        if (packed)
+        {
+            if (!packedRefs_.lock())
+                return false;
+            std::vector<std::pair<std::string, std::string>> kept;
+            packedRefs_.forEach([&](const std::string &ref, const std::string &hash)
+                                {
+                                    if (ref != refPath)
+                                        kept.emplace_back(ref, hash); });
+            if (!packedRefs_.write(kept))
+                return false;
+        }
+        std::error_code ec;
+        bool removed = std::filesystem::remove(commonDir() / refPath, ec);
+        return packed || removed;
+    }
+
+    std::vector<std::pair<std::string, std::string>> Repository::looseRefs() const
+    {
+        std::vector<std::pair<std::string, std::string>> out;
+        std::error_code ec;
+        auto refsDir = commonDir() / "refs";
+        for (auto it = std::filesystem::recursive_directory_iterator(refsDir, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+        {
+            if (!it->is_regular_file() || isLockFile(it->path()))
+                continue;
+            std::string s;
+            if (!readFile(it->path(), s))
+                continue;
+            out.emplace_back(std::filesystem::relative(it->path(), commonDir()).generic_string(), trimmed(s));
+        }
+        return out;
+    }
+
+    std::vector<std::pair<std::string, std::string>> Repository::listRefs() const
+    {
+        util::TraceScope scope("refs.list");
+        std::map<std::string, std::string> refs;
+        packedRefs_.forEach([&](const std::string &ref, const std::string &hash)
+                            { refs.emplace_hint(refs.end(), ref, hash); });
+        for (auto &r : looseRefs())
+        {
+            if (r.second.empty())
+                refs.erase(r.first);
+            else
+                refs[r.first] = r.second;
+        }
+        return {refs.begin(), refs.end()};
+    }
+
+    bool Repository::packRefs(size_t &packed)
+    {
+        if (!packedRefs_.lock())
+            return false;
+        auto refs = listRefs();
+        if (!packedRefs_.write(refs))
+            return false;
+        packed = refs.size();
+        // Only files still holding the packed value go, checked under each
+        // ref's lock; an unborn branch (empty file) or a ref updated
+        // meanwhile stays loose.
+        std::map<std::string, std::string> byRef(refs.begin(), refs.end());
+        std::error_code ec;
+        for (auto &r : looseRefs())
+        {
+            auto it = byRef.find(r.first);
+            if (it == byRef.end() || it->second != r.second)
+                continue;
+            fsops::LockFile lock(commonDir() / r.first);
+            std::string s;
+            if (lock.acquire() && readFile(commonDir() / r.first, s) && trimmed(s) == it->second)
+                std::filesystem::remove(commonDir() / r.first, ec);
+        }
+        std::vector<fs::path> dirs;
+        for (auto it = std::filesystem::recursive_directory_iterator(commonDir() / "refs", ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+            if (it->is_directory())
+                dirs.push_back(it->path());
+        // Deepest first, so emptied parents can go too; refs/heads stays.
+        std::sort(dirs.rbegin(), dirs.rend());
+        for (auto &d : dirs)
+            if (d != refsHeadsDir())
+                std::filesystem::remove(d, ec); // only succeeds when empty
+        return true;
+    }
+
     std::optional<std::string> Repository::resolveHEAD() const
     {
         auto ref = currentHeadRef();
-        if (ref.empty())
+        if (!ref.empty())
+            return readRef(ref);
+        // Detached: HEAD holds the commit hash itself.
+        std::string s;
+        if (!readFile(headFile(), s) || !isHash(s = trimmed(s)))
             return std::nullopt;
-        return readRef(ref);
+        return s;
+    }
+
+    std::optional<std::string> Repository::resolveRevision(const std::string &rev) const
+    {
+        if (rev == "HEAD")
+            return resolveHEAD();
+        if (rev.rfind("refs/", 0) == 0)
+            return rev.find("..") == std::string::npos ? readRef(rev) : std::nullopt;
+        if (validBranchName(rev))
+            if (auto h = readRef("refs/heads/" + rev))
+                return h;
+        if (isHash(rev) && store_.exists(rev))
+            return rev;
+        return std::nullopt;
+    }
+
+    bool Repository::createBranch(const std::string &name, const std::string &rev)
+    {
+        if (!validBranchName(name) || readRef("refs/heads/" + name))
+            return false;
+        auto commit = resolveRevision(rev);
+        return commit && updateRef("refs/heads/" + name, *commit, std::string());
+    }
+
+    bool Repository::deleteBranch(const std::string &name)
+    {
+        if (!validBranchName(name) || currentHeadRef() == "refs/heads/" + name ||
+            checkedOutElsewhere("refs/heads/" + name))
+            return false;
+        return deleteRef("refs/heads/" + name);
+    }
+
+    std::vector<std::string> Repository::branches() const
+    {
+        std::vector<std::string> out;
+        for (auto &r : listRefs())
+            if (r.first.rfind("refs/heads/", 0) == 0)
+                out.push_back(r.first.substr(11));
+        return out;
     }
 
     bool Repository::readFile(const fs::path &p, std::string &out)
@@ -84,350 +350,1338 @@ namespace vcs
 
     bool Repository::addPath(const fs::path &relPath)
     {
-        auto abs = root_ / relPath;
-        if (!std::filesystem::exists(abs) || std::filesystem::is_directory(abs))
-            return false;
-        std::string data;
-        if (!fsops::readFile(abs, data))
-            return false;
-        auto blob = store_.writeBlob(data);
-        index_.load();
-        index_.add(relPath.generic_string(), "100644", blob);
-        return index_.save();
-    }
-
-    static std::vector<std::pair<std::string, IndexEntry>> sortIndexEntries(const std::unordered_map<std::string, IndexEntry> &m)
-    {
-        std::vector<std::pair<std::string, IndexEntry>> v(m.begin(), m.end());
-        std::sort(v.begin(), v.end(), [](auto &a, auto &b)
-                  { return a.first < b.first; });
-        return v;
+        return addPaths({relPath});
     }
 
-    void Repository::writeTreeRecursive(const std::vector<std::pair<std::string, IndexEntry>> &items,
-                                        size_t start, size_t end, const std::string &dirPrefix,
-                                        std::string &treeHash) const
+    bool Repository::addPaths(const std::vector<fs::path> &relPaths)
     {
-        std::map<std::string, std::vector<std::pair<std::string, IndexEntry>>> children;
-        std::vector<TreeEntry> entries;
-        for (size_t i = start; i < end; i++)
+        util::TraceScope scope("add");
+        IndexLock lock(index_);
+        if (!lock.ok)
+            return false;
+        bool ok = true;
+        std::vector<std::string> rels;
+        for (auto &relPath : relPaths)
         {
-            auto rel = items[i].first;
-            if (rel.compare(0, dirPrefix.size(), dirPrefix) != 0)
-                continue;
-            auto rest = rel.substr(dirPrefix.size());
-            auto pos = rest.find('/');
-            if (pos == std::string::npos)
+            auto abs = root_ / relPath;
+            auto rel = relPath.generic_string();
+            bool staged = std::filesystem::exists(abs) && !std::filesystem::is_directory(abs);
+            // Paths inside a sparse (unmaterialized) directory cannot be staged.
+            for (auto pos = rel.find('/'); staged && pos != std::string::npos; pos = rel.find('/', pos + 1))
             {
-                entries.push_back(TreeEntry{"100644", rest, items[i].second.hash});
+                auto *e = index_.find(rel.substr(0, pos));
+                staged = !(e && e->mode == "040000");
             }
-            else
+            if (staged)
+                rels.push_back(std::move(rel));
+            ok &= staged;
+        }
+
+        for (size_t b = 0; b < rels.size(); b += kBatchFiles)
+        {
+            size_t e = std::min(rels.size(), b + kBatchFiles);
+            std::vector<fsops::IoRequest> reads(e - b);
+            for (size_t i = b; i < e; i++)
+                reads[i - b].path = root_ / rels[i];
+            io().readFiles(reads);
+            std::vector<std::string> bodies, staged;
+            for (size_t i = b; i < e; i++)
             {
-                std::string child = rest.substr(0, pos);
-                children[child].push_back(items[i]);
+                ok &= reads[i - b].ok;
+                if (!reads[i - b].ok)
+                    continue;
+                bodies.push_back(std::move(reads[i - b].data));
+                staged.push_back(rels[i]);
             }
+            auto hashes = store_.writeBlobs(std::move(bodies), io());
+            for (size_t k = 0; k < staged.size(); k++)
+                index_.add(staged[k], "100644", hashes[k]);
+        }
+        return index_.save() && ok;
+    }
+
+    std::string Repository::writeTreeRecursive(PathTable::Id dir) const
+    {
+        // Files first, then subdirectories, each in name order: the same layout
+        // the flat sorted-index builder produced, so tree hashes are unchanged.
+        const auto &paths = index_.paths();
+        // Sparse directory entries (mode 040000) already carry their tree hash.
+        std::vector<TreeEntry> entries;
+        for (auto child : paths.children(dir))
+        {
+            auto *e = index_.entry(child);
+            if (e && e->mode != "040000")
+                entries.push_back(TreeEntry{"100644", std::string(paths.name(child)), e->hash});
         }
-        for (auto &kv : children)
+        for (auto child : paths.children(dir))
         {
-            std::string childDir = dirPrefix + kv.first + "/";
-            std::string subHash;
-            writeTreeRecursive(items, start, end, childDir, subHash);
-            entries.push_back(TreeEntry{"040000", kv.first, subHash});
+            auto *e = index_.entry(child);
+            if (e && e->mode == "040000")
+                entries.push_back(TreeEntry{"040000", std::string(paths.name(child)), e->hash});
+            else if (!e && !paths.children(child).empty())
+                entries.push_back(TreeEntry{"040000", std::string(paths.name(child)), writeTreeRecursive(child)});
         }
-        treeHash = store_.writeTree(entries);
+        return store_.writeTree(entries);
     }
 
     std::string Repository::buildTreeFromIndex() const
     {
-        auto items = sortIndexEntries(index_.entries());
-        std::string rootHash;
-        writeTreeRecursive(items, 0, items.size(), "", rootHash);
-        return rootHash;
+        return writeTreeRecursive(PathTable::root);
     }
 
     std::optional<std::string> Repository::blobHashOfCommitPath(const std::string &commitHash, const std::string &relPath) const
     {
-        std::string treeHash, parent, author, msg;
-        long long ts = 0;
-        if (!store_.readCommit(commitHash, treeHash, parent, author, ts, msg))
+        auto tree = commitTree(commitHash);
+        auto e = tree ? treeEntryAt(*tree, relPath) : std::nullopt;
+        if (!e || e->mode == "040000")
             return std::nullopt;
-        std::string currentTree = treeHash;
+        return e->hash;
+    }
+
+    std::optional<TreeEntry> Repository::treeEntryAt(const std::string &treeHash, const std::string &relPath) const
+    {
+        TreeEntry cur{"040000", "", treeHash};
         std::istringstream pathSS(relPath);
         std::string segment;
-        std::vector<std::string> parts;
         while (std::getline(pathSS, segment, '/'))
-            if (!segment.empty())
-                parts.push_back(segment);
-        for (size_t i = 0; i < parts.size(); i++)
         {
+            if (segment.empty())
+                continue;
             std::vector<TreeEntry> entries;
-            if (!store_.readTree(currentTree, entries))
+            if (cur.mode != "040000" || !store_.readTree(cur.hash, entries))
                 return std::nullopt;
-            bool found = false;
-            for (auto &e : entries)
-            {
-                if (e.name == parts[i])
-                {
-                    if (i + 1 == parts.size())
-                    {
-                        if (e.mode == "100644")
-                            return e.hash;
-                        else
-                            return std::nullopt;
-                    }
-                    else
-                    {
-                        if (e.mode == "040000")
-                        {
-                            currentTree = e.hash;
-                            found = true;
-                            break;
-                        }
-                        else
-                            return std::nullopt;
-                    }
-                }
-            }
-            if (!found && i + 1 < parts.size())
+            auto it = std::find_if(entries.begin(), entries.end(), [&](const TreeEntry &e)
+                                   { return e.name == segment; });
+            if (it == entries.end())
                 return std::nullopt;
+            cur = std::move(*it);
         }
-        return std::nullopt;
-    }
-
-    std::optional<std::string> Repository::workingBlobHash(const fs::path &relPath) const
-    {
-        auto abs = root_ / relPath;
-        if (!std::filesystem::exists(abs) || std::filesystem::is_directory(abs))
-            return std::nullopt;
-        std::string data;
-        if (!fsops::readFile(abs, data))
-            return std::nullopt;
-        return store_.writeBlob(data);
-    }
-
-    std::optional<std::string> Repository::commit(const std::string &message, const std::string &author)
-    {
-        index_.load();
-        auto treeHash = buildTreeFromIndex();
-        auto parent = headCommit().value_or("");
-        long long ts = std::chrono::duration_cast<std::chrono::seconds>(
-                           std::chrono::system_clock::now().time_since_epoch())
-                           .count();
-        auto commitHash = store_.writeCommit(treeHash, parent, author, ts, message);
-        auto ref = currentHeadRef();
-        if (ref.empty())
-            setHeadRef("refs/heads/main");
-        updateRef(currentHeadRef(), commitHash);
-        return commitHash;
+        return cur;
     }
 
-    bool Repository::materializeTree(const std::string &treeHash, const fs::path &dir) const
+    bool Repository::statCacheLookup(const WorkingFile &f, std::string &hash) const
     {
-        std::vector<TreeEntry> entries;
-        if (!store_.readTree(treeHash, entries))
+        auto it = statCache_.find(f.rel);
+        if (it == statCache_.end() || it->second.mtimeNs != f.mtimeNs || it->second.size != f.size)
             return false;
-        std::filesystem::create_directories(dir);
-        for (auto &e : entries)
-        {
-            if (e.mode == "040000")
-            {
-                materializeTree(e.hash, dir / e.name);
-            }
-            else
-            {
-                std::string data;
-                store_.readBlob(e.hash, data);
-                fsops::writeFile(dir / e.name, data);
-            }
-        }
+        util::Trace::add(util::Counter::CacheHits);
+        hash = it->second.hash;
         return true;
     }
 
-    bool Repository::checkout(const std::string &commitHash)
+    void Repository::hashWorkingFiles(const std::vector<WorkingFile> &files, std::map<std::string, std::string> &out) const
     {
-        std::string treeHash, parent, author, msg;
-        long long ts = 0;
-        if (!store_.readCommit(commitHash, treeHash, parent, author, ts, msg))
-            return false;
-        for (auto &p : std::filesystem::directory_iterator(root_))
+        // A file modified within the timestamp granularity could change again
+        // without moving mtime, so only remember entries that have settled.
+        auto settled = fsops::nowNs() - 2'000'000'000;
+        for (size_t b = 0; b < files.size();)
         {
-            if (p.path().filename() == ".chronofs")
-                continue;
-            fsops::removePath(p.path());
-        }
-        return materializeTree(treeHash, root_);
-    }
+            size_t e = b;
+            uintmax_t bytes = 0;
+            while (e < files.size() && e - b < kBatchFiles && (e == b || bytes + files[e].size <= kBatchBytes))
+                bytes += files[e++].size;
+            std::vector<fsops::IoRequest> reads(e - b);
+            for (size_t i = b; i < e; i++)
+                reads[i - b].path = root_ / files[i].rel;
+            io().readFiles(reads);
 
-    std::vector<Repository::StatusEntry> Repository::status() const
-    {
-        std::vector<StatusEntry> out;
-        index_.load();
-        std::set<std::string> working;
-        for (auto &p : std::filesystem::recursive_directory_iterator(root_))
-        {
-            if (p.is_directory())
+            std::vector<std::string> bodies;
+            std::vector<const WorkingFile *> read;
+            for (size_t i = b; i < e; i++)
             {
-                if (p.path().filename() == ".chronofs")
+                if (reads[i - b].ok)
                 {
-                    p.disable_recursion_pending();
-                    continue;
+                    bodies.push_back(std::move(reads[i - b].data));
+                    read.push_back(&files[i]);
+                }
+                else
+                {
+                    out[files[i].rel] = ""; // unreadable
+                    statCache_.erase(files[i].rel);
                 }
-                continue;
-            }
-            auto rel = std::filesystem::relative(p.path(), root_).generic_string();
-            working.insert(rel);
-        }
-        for (auto &rel : working)
-        {
-            auto whash = workingBlobHash(rel).value_or("");
-            auto it = index_.entries().find(rel);
-            if (it == index_.entries().end())
-            {
-                out.push_back({rel, "untracked"});
-            }
-            else if (it->second.hash != whash)
-            {
-                out.push_back({rel, "modified"});
             }
-            else
+            auto hashes = store_.writeBlobs(std::move(bodies), io());
+            for (size_t k = 0; k < read.size(); k++)
             {
-                out.push_back({rel, "staged"});
+                auto &f = *read[k];
+                out[f.rel] = hashes[k];
+                if (f.mtimeNs < settled)
+                    statCache_[f.rel] = StatCacheEntry{f.mtimeNs, f.size, hashes[k]};
+                else
+                    statCache_.erase(f.rel);
             }
+            b = e;
         }
-        for (auto &kv : index_.entries())
-        {
-            if (!working.count(kv.first))
-                out.push_back({kv.first, "deleted"});
-        }
-        if (out.empty())
-            out.push_back({"", "clean"});
-        return out;
     }
 
-    std::vector<std::string> Repository::log() const
+    bool Repository::tracksBelow(const std::string &relDir) const
     {
-        std::vector<std::string> lines;
-        auto head = headCommit();
-        std::string cur = head.value_or("");
-        while (!cur.empty())
-        {
-            std::string tree, parent, author, msg;
-            long long ts = 0;
-            if (!store_.readCommit(cur, tree, parent, author, ts, msg))
-                break;
-            std::ostringstream oss;
-            oss << "commit " << cur << "\n"
-                << "Author: " << author << "\n"
-                << "Date:   " << ts << "\n\n"
-                << "    " << msg << "\n";
-            lines.push_back(oss.str());
-            cur = parent;
-        }
-        if (lines.empty())
-            lines.push_back("(no commits yet)\n");
-        return lines;
+        auto id = index_.paths().find(relDir);
+        return id != PathTable::npos && (index_.entry(id) || !index_.paths().children(id).empty());
+    }
+
+    void Repository::scanWorkingTree(const std::string &relDir, std::map<std::string, std::string> &out) const
+    {
+        util::TraceScope scope("walk");
+        std::vector<WorkingFile> misses;
+        // Rules in effect at each depth of the walk. Ignore rules only hide
+        // untracked paths: a directory is skipped unopened unless the index
+        // has something below it.
+        std::vector<std::shared_ptr<const IgnoreRules>> rules{IgnoreRules::forDir(root_, relDir)};
+        fsops::DirWalker::walk(root_, relDir, [&](const fsops::DirWalker::Entry &e)
+                               {
+                                   auto here = rules[e.depth];
+                                   if (e.type == fsops::EntryType::Dir)
+                                   {
+                                       if (e.rel == ".chronofs" || (here->ignored(e.rel, true) && !tracksBelow(e.rel)))
+                                           return false;
+                                       rules.resize(e.depth + 2);
+                                       rules[e.depth + 1] = IgnoreRules::enter(root_, e.rel, std::move(here));
+                                       return true;
+                                   }
+                                   if (e.type == fsops::EntryType::Other || (here->ignored(e.rel, false) && !index_.has(e.rel)))
+                                       return false;
+                                   fsops::FileStat st;
+                                   e.stat(st);
+                                   if (st.dir) // symlink to a directory
+                                       return false;
+                                   WorkingFile f{e.rel, st.mtimeNs, st.size};
+                                   if (!statCacheLookup(f, out[f.rel]))
+                                       misses.push_back(std::move(f));
+                                   return false; });
+        hashWorkingFiles(misses, out);
     }
 
-    std::string Repository::diff(const std::string &a, const std::string &b) const
+    std::map<std::string, std::string> Repository::workingTree() const
     {
-        auto readRefOrCommit = [&](const std::string &id) -> std::optional<std::string>
+        std::map<std::string, std::string> snap;
+        fsops::FsMonitor monitor(root_);
+        // The snapshot file starts with the token it is valid at, then has
+        // "<hash> <path>" lines (hash empty for unreadable files). Both are
+        // published in one atomic rename, so readers never pair a token with
+        // another process's half-written snapshot.
+        std::string data, token;
+        bool haveSnapshot = readFile(monitor.stateDir() / "snapshot", data);
+        std::istringstream iss(data);
+        haveSnapshot = haveSnapshot && std::getline(iss, token) && !token.empty();
+        auto changes = monitor.changesSince(haveSnapshot ? token : "");
+
+        // Edited ignore rules can change which paths belong in the snapshot.
+        bool incremental = haveSnapshot && !changes.fullScan &&
+                           std::none_of(changes.paths.begin(), changes.paths.end(), [](const std::string &p)
+                                        { return fs::path(p).filename() == IgnoreRules::kFileName; });
+        if (incremental)
         {
-            if (id == "HEAD")
+            std::string line;
+            while (std::getline(iss, line))
             {
-                auto hc = headCommit();
-                if (!hc)
-                    return std::nullopt;
-                return *hc;
+                auto sp = line.find(' ');
+                if (sp != std::string::npos)
+                    snap.emplace_hint(snap.end(), line.substr(sp + 1), line.substr(0, sp));
             }
-            return id;
-        };
+        }
 
-        auto loadTreeFromCommit = [&](const std::string &commit, std::map<std::string, std::string> &pathToBlob)
+        if (!incremental)
         {
-            std::string tree, parent, author, msg;
-            long long ts = 0;
-            if (!store_.readCommit(commit, tree, parent, author, ts, msg))
-                return false;
-            std::function<void(const std::string &, const std::string &)> walk = [&](const std::string &th, const std::string &prefix)
+            snap.clear();
+            scanWorkingTree("", snap);
+        }
+        else
+        {
+            util::TraceScope scope("fsmonitor.apply");
+            std::set<std::string> dirty(changes.paths.begin(), changes.paths.end());
+            std::vector<WorkingFile> misses;
+            std::map<std::string, std::shared_ptr<const IgnoreRules>> rulesByDir;
+            auto ignoredPath = [&](const std::string &rel, bool isDir)
             {
-                std::vector<TreeEntry> entries;
-                if (!store_.readTree(th, entries))
-                    return;
-                for (auto &e : entries)
+                // The path or any of its directories may be ignored.
+                for (size_t pos = 0;; pos++)
                 {
-                    if (e.mode == "040000")
-                        walk(e.hash, prefix + e.name + "/");
-                    else
-                        pathToBlob[prefix + e.name] = e.hash;
+                    pos = rel.find('/', pos);
+                    auto sub = rel.substr(0, pos);
+                    auto slash = sub.rfind('/');
+                    auto parent = slash == std::string::npos ? "" : sub.substr(0, slash);
+                    auto &rules = rulesByDir[parent];
+                    if (!rules)
+                        rules = IgnoreRules::forDir(root_, parent);
+                    bool dir = pos != std::string::npos || isDir;
+                    if (rules->ignored(sub, dir) && !(dir ? tracksBelow(sub) : index_.has(sub)))
+                        return true;
+                    if (pos == std::string::npos)
+                        return false;
                 }
             };
-            walk(tree, "");
-            return true;
-        };
-
-        std::map<std::string, std::string> left, right;
-
-        if (a == "WORKING")
-        {
-            for (auto &p : std::filesystem::recursive_directory_iterator(root_))
+            for (auto &rel : dirty)
             {
-                if (p.is_directory())
+                // A path may name a file or a whole directory; drop both and re-read.
+                snap.erase(rel);
+                auto prefix = rel + "/";
+                for (auto it = snap.lower_bound(prefix); it != snap.end() && it->first.compare(0, prefix.size(), prefix) == 0;)
+                    it = snap.erase(it);
+                std::error_code ec;
+                auto st = std::filesystem::symlink_status(root_ / rel, ec);
+                if (ec)
+                    continue;
+                if (ignoredPath(rel, std::filesystem::is_directory(st)))
+                    continue;
+                if (std::filesystem::is_directory(st))
                 {
-                    if (p.path().filename() == ".chronofs")
-                    {
-                        p.disable_recursion_pending();
-                        continue;
-                    }
+                    scanWorkingTree(rel, snap);
                     continue;
                 }
-                auto rel = std::filesystem::relative(p.path(), root_).generic_string();
-                auto whash = workingBlobHash(rel);
-                if (whash)
-                    left[rel] = *whash;
+                fsops::FileStat fst;
+                fsops::statFile(root_ / rel, fst);
+                WorkingFile f{rel, fst.mtimeNs, fst.size};
+                if (!statCacheLookup(f, snap[rel]))
+                    misses.push_back(std::move(f));
             }
+            hashWorkingFiles(misses, snap);
         }
-        else if (a == "INDEX")
-        {
-            index_.load();
-            for (auto &kv : index_.entries())
-                left[kv.first] = kv.second.hash;
-        }
-        else
+
+        // Nothing changed: the stored snapshot is still right at its older
+        // token, and replaying from there finds no paths either.
+        if (!changes.token.empty() && !(incremental && changes.paths.empty()))
         {
-            auto ca = readRefOrCommit(a);
-            if (!ca)
-                return "Left side not found\n";
-            loadTreeFromCommit(*ca, left);
+            std::string out = changes.token + "\n";
+            for (auto &kv : snap)
+                out += kv.second + " " + kv.first + "\n";
+            fsops::writeFileAtomic(monitor.stateDir() / "snapshot", out);
         }
+        return snap;
+    }
 
-        if (b == "WORKING")
+    std::optional<std::string> Repository::commit(const std::string &message, const std::string &author,
+                                                  const std::vector<std::string> &tags)
+    {
+        util::TraceScope scope("commit");
+        if (!std::all_of(tags.begin(), tags.end(), validTag))
+            return std::nullopt;
+        index_.refresh();
+        auto treeHash = buildTreeFromIndex();
+        std::vector<std::string> parents;
+        auto head = headCommit();
+        if (head)
+            parents.push_back(*head);
+
+        // A pending merge adds its other side as a second parent, once every
+        // conflicted path has been re-staged without markers.
+        std::string pending;
+        if (readFile(mergeHeadFile(), pending))
         {
-            for (auto &p : std::filesystem::recursive_directory_iterator(root_))
+            std::istringstream in(pending);
+            std::string line;
+            if (std::getline(in, line) && isHash(line))
+                parents.push_back(line);
+            while (std::getline(in, line))
             {
-                if (p.is_directory())
-                {
-                    if (p.path().filename() == ".chronofs")
-                    {
-                        p.disable_recursion_pending();
-                        continue;
-                    }
-                    continue;
-                }
-                auto rel = std::filesystem::relative(p.path(), root_).generic_string();
-                auto whash = workingBlobHash(rel);
-                if (whash)
-                    right[rel] = *whash;
+                auto *e = index_.find(line);
+                std::string data;
+                if (e && e->mode != "040000" && store_.readBlob(e->hash, data) &&
+                    (data.rfind("<<<<<<< ", 0) == 0 || data.find("\n<<<<<<< ") != std::string::npos))
+                    return std::nullopt;
             }
         }
-        else if (b == "INDEX")
+
+        auto tagsHash = writeCommitTags(tags);
+        auto commitHash = store_.writeCommit(treeHash, parents, author, now(), message, tagsHash);
+        // Fails if another process committed since we read HEAD; the new
+        // commit object is left for gc.
+        if (!advanceHead(commitHash, head.value_or("")))
+            return std::nullopt;
+        std::error_code ec;
+        std::filesystem::remove(mergeHeadFile(), ec);
+        indexCommitTags(commitHash, tagsHash);
+        return commitHash;
+    }
+
+    std::string Repository::writeCommitTags(const std::vector<std::string> &commitTags)
+    {
+        std::vector<TagEntry> entries;
+        for (auto &e : stagedTags())
+            if (tracked(index_, e.path))
+                entries.push_back(e);
+        for (auto &t : commitTags)
+            entries.push_back({"", t});
+        return entries.empty() ? "" : store_.writeTags(entries);
+    }
+
+    void Repository::indexCommitTags(const std::string &commitHash, const std::string &tagsHash) const
+    {
+        // The index is only a cache: a failed append is caught up by the next query.
+        std::vector<std::string> own;
+        if (!tagsHash.empty())
         {
-            index_.load();
-            for (auto &kv : index_.entries())
-                right[kv.first] = kv.second.hash;
+            std::vector<TagEntry> entries;
+            if (!store_.readTags(tagsHash, entries) || !tagIndex_.addObject(tagsHash, entries))
+                return;
+            for (auto &e : entries)
+                if (e.path.empty())
+                    own.push_back(e.tag);
         }
-        else
-        {
-            auto cb = readRefOrCommit(b);
+        tagIndex_.addCommits({{commitHash, own}});
+    }
+
+    std::vector<TagEntry> Repository::stagedTags() const
+    {
+        std::string data;
+        std::vector<TagEntry> out;
+        if (!readFile(tagsFile(), data) || !ObjectStore::parseTags(data, out))
+            out.clear();
+        return out;
+    }
+
+    bool Repository::stageTags(const std::vector<TagEntry> &entries)
+    {
+        std::vector<TagEntry> paths;
+        for (auto &e : entries)
+            if (!e.path.empty())
+                paths.push_back(e);
+        if (paths.empty())
+        {
+            std::error_code ec;
+            std::filesystem::remove(tagsFile(), ec);
+            return !ec;
+        }
+        return replaceLocked(tagsFile(), ObjectStore::serializeTags(paths));
+    }
+
+    bool Repository::tagPaths(const std::string &tag, const std::vector<std::string> &paths, bool remove)
+    {
+        if (!validTag(tag))
+            return false;
+        index_.refresh();
+        fsops::LockFile lock(tagsFile());
+        if (!lock.acquire())
+            return false;
+        auto entries = stagedTags();
+        for (auto &p : paths)
+        {
+            auto rel = fs::path(p).lexically_normal().generic_string();
+            if (remove)
+            {
+                entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const TagEntry &e)
+                                             { return e.path == rel && e.tag == tag; }),
+                              entries.end());
+            }
+            else
+            {
+                if (rel.find_first_of("\t\n") != std::string::npos || !tracked(index_, rel))
+                    return false;
+                entries.push_back({rel, tag});
+            }
+        }
+        return lock.commit(ObjectStore::serializeTags(entries));
+    }
+
+    std::vector<TagEntry> Repository::commitPathTags(const std::string &commitHash) const
+    {
+        std::vector<TagEntry> entries, out;
+        auto tagsHash = store_.commitTags(commitHash);
+        if (!tagsHash.empty() && store_.readTags(tagsHash, entries))
+            for (auto &e : entries)
+                if (!e.path.empty())
+                    out.push_back(std::move(e));
+        return out;
+    }
+
+    std::optional<std::vector<TagEntry>> Repository::tagsAt(const std::string &rev) const
+    {
+        auto commit = resolveRevision(rev);
+        if (!commit)
+            return std::nullopt;
+        std::vector<TagEntry> entries;
+        auto tagsHash = store_.commitTags(*commit);
+        if (!tagsHash.empty() && !store_.readTags(tagsHash, entries))
+            return std::nullopt;
+        return entries;
+    }
+
+    std::optional<std::vector<std::string>> Repository::taggedPaths(const std::string &tag, const std::string &rev) const
+    {
+        util::TraceScope scope("tags.find");
+        auto commit = resolveRevision(rev);
+        if (!commit)
+            return std::nullopt;
+        // One commit read names the tags object; the postings come from the index.
+        auto tagsHash = store_.commitTags(*commit);
+        if (tagsHash.empty())
+            return std::vector<std::string>{};
+        if (!tagIndex_.hasObject(tagsHash))
+        {
+            // Made before the index existed, or its append was lost.
+            std::vector<TagEntry> entries;
+            if (!store_.readTags(tagsHash, entries))
+                return std::nullopt;
+            tagIndex_.addObject(tagsHash, entries);
+        }
+        return tagIndex_.paths(tag, tagsHash);
+    }
+
+    std::vector<std::string> Repository::taggedCommits(const std::string &tag) const
+    {
+        util::TraceScope scope("tags.commits");
+        // Catch up on commits the index has not seen (made before it existed,
+        // or whose append failed): walk back from each head only as far as
+        // the first indexed commit, which is normally the head itself.
+        std::vector<std::string> stack;
+        if (auto head = resolveHEAD())
+            stack.push_back(*head);
+        for (auto &r : listRefs())
+            stack.push_back(r.second);
+        std::set<std::string> seen;
+        std::vector<std::pair<std::string, std::vector<std::string>>> missing;
+        while (!stack.empty())
+        {
+            auto c = std::move(stack.back());
+            stack.pop_back();
+            if (c.empty() || !seen.insert(c).second || tagIndex_.hasCommit(c))
+                continue;
+            std::string tree, author, msg;
+            std::vector<std::string> parents;
+            long long ts = 0;
+            if (!store_.readCommit(c, tree, parents, author, ts, msg))
+                continue;
+            std::vector<std::string> own;
+            std::vector<TagEntry> entries;
+            auto tagsHash = store_.commitTags(c);
+            if (!tagsHash.empty() && !store_.readTags(tagsHash, entries))
+                continue;
+            for (auto &e : entries)
+                if (e.path.empty())
+                    own.push_back(e.tag);
+            missing.emplace_back(c, std::move(own));
+            stack.insert(stack.end(), parents.begin(), parents.end());
+        }
+        tagIndex_.addCommits(missing);
+
+        std::vector<std::pair<long long, std::string>> byTime;
+        for (auto &c : tagIndex_.commits(tag))
+        {
+            std::string tree, author, msg;
+            std::vector<std::string> parents;
+            long long ts = 0;
+            if (store_.readCommit(c, tree, parents, author, ts, msg))
+                byTime.emplace_back(ts, c);
+        }
+        std::stable_sort(byTime.begin(), byTime.end(), [](const auto &a, const auto &b)
+                         { return a.first > b.first; });
+        std::vector<std::string> out;
+        for (auto &t : byTime)
+            out.push_back(t.second);
+        return out;
+    }
+
+    bool Repository::materializeTree(const std::string &treeHash, const std::string &relDir,
+                                     const SparseSpec &sparse,
+                                     std::vector<std::pair<std::string, std::string>> &files) const
+    {
+        std::vector<TreeEntry> entries;
+        if (!store_.readTree(treeHash, entries))
+            return false;
+        auto dir = relDir.empty() ? root_ : root_ / relDir;
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        if (ec)
+            return false;
+        bool ok = true;
+        for (auto &e : entries)
+        {
+            auto rel = relDir.empty() ? e.name : relDir + "/" + e.name;
+            if (e.mode == "040000")
+            {
+                // Excluded subtrees are recorded by tree hash and never read.
+                if (sparse.matchDir(rel) == SparseSpec::Match::Excluded)
+                    index_.add(rel, "040000", e.hash);
+                else
+                    ok &= materializeTree(e.hash, rel, sparse, files);
+            }
+            else
+            {
+                files.emplace_back(rel, e.hash);
+                index_.add(rel, e.mode, e.hash);
+            }
+        }
+        return ok;
+    }
+
+    bool Repository::writeWorkingFiles(const std::vector<std::pair<std::string, std::string>> &files) const
+    {
+        util::TraceScope scope("checkout.write");
+        bool ok = true;
+        for (size_t b = 0; b < files.size(); b += kBatchFiles)
+        {
+            size_t e = std::min(files.size(), b + kBatchFiles);
+            std::vector<fsops::IoRequest> reads;
+            std::vector<size_t> which;
+            std::vector<bool> headerless;
+            for (size_t i = b; i < e; i++)
+            {
+                // Raw blob bodies are cloned so the filesystem can share extents.
+                auto raw = store_.blobFile(files[i].second);
+                if (!raw.empty() && fsops::cloneFile(raw, root_ / files[i].first))
+                    continue;
+                fsops::IoRequest r;
+                r.path = raw.empty() ? store_.objectPath(files[i].second) : raw;
+                reads.push_back(std::move(r));
+                which.push_back(i);
+                headerless.push_back(!raw.empty());
+            }
+            io().readFiles(reads);
+            util::Trace::add(util::Counter::ObjectsRead, reads.size());
+
+            std::vector<fsops::IoRequest> writes;
+            for (size_t k = 0; k < reads.size(); k++)
+            {
+                auto &r = reads[k];
+                if (!r.ok || (!headerless[k] && r.data.rfind("blob\n", 0) != 0))
+                {
+                    ok = false;
+                    continue;
+                }
+                fsops::IoRequest w;
+                w.path = root_ / files[which[k]].first;
+                w.data = std::move(r.data);
+                if (!headerless[k])
+                    w.data.erase(0, 5);
+                writes.push_back(std::move(w));
+            }
+            io().writeFiles(writes);
+            for (auto &w : writes)
+                ok &= w.ok;
+        }
+        return ok;
+    }
+
+    std::optional<std::string> Repository::importDir(const fs::path &dir, const std::string &message,
+                                                     const std::string &author, ImportStats &stats)
+    {
+        util::TraceScope scope("import");
+        if (std::filesystem::exists(mergeHeadFile()))
+            return std::nullopt;
+        std::error_code ec;
+        auto base = std::filesystem::weakly_canonical(root_, ec);
+        auto rel = std::filesystem::weakly_canonical(root_ / dir, ec).lexically_relative(base).generic_string();
+        if (ec || rel.empty() || rel.rfind("..", 0) == 0 || rel.rfind(".chronofs", 0) == 0)
+            return std::nullopt;
+        if (rel == ".")
+            rel.clear();
+
+        std::vector<std::pair<std::string, std::string>> files;
+        Importer importer(store_, ImportOptions{});
+        auto tree = importer.run(root_, rel, files, stats);
+
+        IndexLock lock(index_);
+        if (!lock.ok)
+            return std::nullopt;
+        if (rel.empty())
+        {
+            index_.clear();
+        }
+        else
+        {
+            std::vector<std::string> stale;
+            index_.forEach([&](const std::string &path, const IndexEntry &)
+                           {
+                               if (path == rel || path.rfind(rel + "/", 0) == 0)
+                                   stale.push_back(path); });
+            for (auto &p : stale)
+                index_.remove(p);
+        }
+        for (auto &f : files)
+            index_.add(f.first, "100644", f.second);
+        if (!index_.save())
+            return std::nullopt;
+
+        // A whole-tree import already has its root tree; a subdirectory is
+        // grafted into the rest of the index by a regular tree build.
+        if (!rel.empty())
+            tree = buildTreeFromIndex();
+        else if (tree.empty())
+            tree = store_.writeTree({});
+        std::vector<std::string> parents;
+        auto head = headCommit();
+        if (head)
+            parents.push_back(*head);
+        auto tagsHash = writeCommitTags({});
+        auto commitHash = store_.writeCommit(tree, parents, author, now(), message, tagsHash);
+        if (!advanceHead(commitHash, head.value_or("")))
+            return std::nullopt;
+        indexCommitTags(commitHash, tagsHash);
+        return commitHash;
+    }
+
+    std::optional<std::string> Repository::mergeHeadCommit() const
+    {
+        std::string data;
+        if (!readFile(mergeHeadFile(), data))
+            return std::nullopt;
+        auto line = data.substr(0, data.find('\n'));
+        if (!isHash(line))
+            return std::nullopt;
+        return line;
+    }
+
+    std::optional<std::string> Repository::commitTree(const std::string &commitHash) const
+    {
+        std::string tree, parent, author, msg;
+        long long ts = 0;
+        if (!store_.readCommit(commitHash, tree, parent, author, ts, msg))
+            return std::nullopt;
+        return tree;
+    }
+
+    bool Repository::checkout(const std::string &rev)
+    {
+        util::TraceScope scope("checkout");
+        std::string branch;
+        if (rev.rfind("refs/heads/", 0) == 0)
+            branch = rev;
+        else if (rev != "HEAD" && validBranchName(rev) && readRef("refs/heads/" + rev))
+            branch = "refs/heads/" + rev;
+        if (!branch.empty() && branch != currentHeadRef() && checkedOutElsewhere(branch))
+            return false;
+        auto commit = resolveRevision(rev);
+        auto tree = commit ? commitTree(*commit) : std::nullopt;
+        if (!tree || !resetTo(*tree) || !stageTags(commitPathTags(*commit)))
+            return false;
+        std::error_code ec;
+        std::filesystem::remove(mergeHeadFile(), ec);
+        if (rev == "HEAD")
+            return true;
+        if (!branch.empty())
+            return setHeadRef(branch);
+        return replaceLocked(headFile(), *commit + "\n");
+    }
+
+    bool Repository::restore(const std::string &rev, const std::vector<std::string> &paths, std::string &error)
+    {
+        util::TraceScope scope("restore");
+        auto commit = resolveRevision(rev);
+        auto tree = commit ? commitTree(*commit) : std::nullopt;
+        if (!tree)
+        {
+            error = "unknown revision " + rev;
+            return false;
+        }
+        IndexLock lock(index_);
+        if (!lock.ok)
+        {
+            error = "cannot lock the index";
+            return false;
+        }
+        SparseSpec sparse;
+        sparse.load(sparseFile());
+
+        // Resolve everything first, so a bad path changes nothing.
+        std::vector<std::pair<std::string, TreeEntry>> targets;
+        for (auto &p : paths)
+        {
+            auto rel = fs::path(p).lexically_normal().generic_string();
+            while (!rel.empty() && rel.back() == '/')
+                rel.pop_back();
+            if (rel == ".")
+                rel.clear();
+            if (fs::path(rel).is_absolute() || rel == ".." || rel.rfind("../", 0) == 0 ||
+                rel == ".chronofs" || rel.rfind(".chronofs/", 0) == 0)
+            {
+                error = "path outside the working tree: " + p;
+                return false;
+            }
+            auto e = treeEntryAt(*tree, rel);
+            if (!e)
+            {
+                error = "path " + p + " not found in " + rev;
+                return false;
+            }
+            auto slash = rel.rfind('/');
+            auto dir = e->mode == "040000" ? rel : slash == std::string::npos ? "" : rel.substr(0, slash);
+            if (sparse.matchDir(dir) == SparseSpec::Match::Excluded || (!rel.empty() && tracked(index_, rel) && !index_.has(rel)))
+            {
+                error = "path " + p + " is outside the sparse checkout";
+                return false;
+            }
+            targets.emplace_back(rel, std::move(*e));
+        }
+
+        std::vector<std::pair<std::string, std::string>> files; // (path, blob)
+        bool ok = true;
+        for (auto &t : targets)
+        {
+            auto &rel = t.first;
+            // A tracked file where a directory of the path now goes.
+            for (auto slash = rel.find('/'); slash != std::string::npos; slash = rel.find('/', slash + 1))
+            {
+                auto dir = rel.substr(0, slash);
+                if (index_.has(dir))
+                {
+                    index_.remove(dir);
+                    fsops::removePath(root_ / dir);
+                }
+            }
+            // Tracked entries at or below the path are replaced by rev's.
+            std::vector<std::string> stale;
+            std::function<void(PathTable::Id)> collect = [&](PathTable::Id id)
+            {
+                if (index_.entry(id))
+                    stale.push_back(index_.paths().path(id));
+                for (auto c : index_.paths().children(id))
+                    collect(c);
+            };
+            // find() has no id for "", the whole tree.
+            auto id = rel.empty() ? PathTable::root : index_.paths().find(rel);
+            if (id != PathTable::npos)
+                collect(id);
+            std::error_code ec;
+            auto top = rel.empty() ? root_ : root_ / rel;
+            for (auto &path : stale)
+            {
+                index_.remove(path);
+                fsops::removePath(root_ / path);
+                // Directories the removal emptied go too, up to the restored one.
+                for (auto dir = (root_ / path).parent_path(); dir != top && std::filesystem::remove(dir, ec);)
+                    dir = dir.parent_path();
+            }
+
+            if (t.second.mode == "040000")
+            {
+                ok &= materializeTree(t.second.hash, rel, sparse, files);
+                continue;
+            }
+            if (std::filesystem::is_directory(root_ / rel, ec))
+                fsops::removePath(root_ / rel);
+            auto parent = (root_ / rel).parent_path();
+            std::filesystem::create_directories(parent, ec);
+            ok &= !ec;
+            files.emplace_back(rel, t.second.hash);
+            index_.add(rel, t.second.mode, t.second.hash);
+        }
+        ok &= writeWorkingFiles(files);
+        // The index keeps no stat data; cached hashes of the old contents are
+        // dropped, and the new files are hashed again once they have settled
+        // (see hashWorkingFiles).
+        for (auto &f : files)
+            statCache_.erase(f.first);
+        if (!index_.save() || !ok)
+        {
+            error = "cannot write the restored files";
+            return false;
+        }
+        return true;
+    }
+
+    bool Repository::resetTo(const std::string &treeHash)
+    {
+        IndexLock lock(index_);
+        if (!lock.ok)
+            return false;
+        for (auto &p : std::filesystem::directory_iterator(root_))
+        {
+            if (p.path().filename() == ".chronofs")
+                continue;
+            fsops::removePath(p.path());
+        }
+        SparseSpec sparse;
+        sparse.load(sparseFile());
+        index_.clear();
+        std::vector<std::pair<std::string, std::string>> files; // (path, blob)
+        bool ok = materializeTree(treeHash, "", sparse, files);
+        ok &= writeWorkingFiles(files);
+        return index_.save() && ok;
+    }
+
+    bool Repository::switchTree(const std::string &from, const std::string &to,
+                                const std::set<std::string> &untracked, std::string &error)
+    {
+        SparseSpec sparse;
+        sparse.load(sparseFile());
+        // Index entries to drop and to add, as materializeTree records them:
+        // files, and 040000 entries for excluded subtrees. Matching subtrees
+        // are skipped unread.
+        std::vector<std::pair<std::string, TreeEntry>> gone, added;
+        std::function<bool(const std::string &, const std::string &, const std::string &)> diff =
+            [&](const std::string &a, const std::string &b, const std::string &relDir)
+        {
+            if (a == b)
+                return true;
+            std::vector<TreeEntry> ea, eb;
+            if ((!a.empty() && !store_.readTree(a, ea)) || (!b.empty() && !store_.readTree(b, eb)))
+                return false;
+            std::map<std::string, std::pair<const TreeEntry *, const TreeEntry *>> byName;
+            for (auto &e : ea)
+                byName[e.name].first = &e;
+            for (auto &e : eb)
+                byName[e.name].second = &e;
+            for (auto &kv : byName)
+            {
+                auto *o = kv.second.first, *n = kv.second.second;
+                if (o && n && o->mode == n->mode && o->hash == n->hash)
+                    continue;
+                auto rel = relDir.empty() ? kv.first : relDir + "/" + kv.first;
+                bool excluded = sparse.matchDir(rel) == SparseSpec::Match::Excluded;
+                bool oDir = o && o->mode == "040000" && !excluded;
+                bool nDir = n && n->mode == "040000" && !excluded;
+                if ((oDir || nDir) && !diff(oDir ? o->hash : "", nDir ? n->hash : "", rel))
+                    return false;
+                if (o && !oDir)
+                    gone.emplace_back(rel, *o);
+                if (n && !nDir)
+                    added.emplace_back(rel, *n);
+            }
+            return true;
+        };
+        if (!diff(from, to, ""))
+        {
+            error = "cannot read tree";
+            return false;
+        }
+        for (auto &a : added)
+        {
+            auto &p = a.first;
+            if (a.second.mode == "040000")
+                continue;
+            auto below = untracked.lower_bound(p + "/");
+            bool clash = untracked.count(p) || (below != untracked.end() && below->rfind(p + "/", 0) == 0);
+            for (auto slash = p.find('/'); !clash && slash != std::string::npos; slash = p.find('/', slash + 1))
+                clash = untracked.count(p.substr(0, slash)) > 0;
+            if (clash)
+            {
+                error = "untracked files would be overwritten at " + p;
+                return false;
+            }
+        }
+
+        IndexLock lock(index_);
+        if (!lock.ok)
+        {
+            error = "cannot lock the index";
+            return false;
+        }
+        std::error_code ec;
+        for (auto &g : gone)
+        {
+            index_.remove(g.first);
+            if (g.second.mode == "040000")
+                continue;
+            fsops::removePath(root_ / g.first);
+            statCache_.erase(g.first);
+            // Directories the removal emptied go too.
+            for (auto dir = (root_ / g.first).parent_path(); dir != root_ && std::filesystem::remove(dir, ec);)
+                dir = dir.parent_path();
+        }
+        std::vector<std::pair<std::string, std::string>> files; // (path, blob)
+        bool ok = true;
+        for (auto &a : added)
+        {
+            index_.add(a.first, a.second.mode, a.second.hash);
+            if (a.second.mode == "040000")
+                continue;
+            // Whatever is left in the way is ignored, and replaced as checkout would.
+            auto path = root_ / a.first;
+            if (std::filesystem::is_directory(std::filesystem::symlink_status(path, ec)))
+                fsops::removePath(path);
+            if (!std::filesystem::create_directories(path.parent_path(), ec) && ec)
+            {
+                for (auto dir = path.parent_path(); dir != root_; dir = dir.parent_path())
+                    if (std::filesystem::exists(std::filesystem::symlink_status(dir, ec)) && !std::filesystem::is_directory(dir, ec))
+                        fsops::removePath(dir);
+                std::filesystem::create_directories(path.parent_path(), ec);
+                ok &= !ec;
+            }
+            files.emplace_back(a.first, a.second.hash);
+            statCache_.erase(a.first);
+        }
+        ok &= writeWorkingFiles(files);
+        if (!index_.save() || !ok)
+        {
+            error = "cannot update working tree";
+            return false;
+        }
+        return true;
+    }
+
+    Repository::MergeResult Repository::merge(const std::string &rev, const std::string &author,
+                                              const std::string &message)
+    {
+        util::TraceScope scope("merge");
+        MergeResult r;
+        if (std::filesystem::exists(mergeHeadFile()))
+        {
+            r.error = "a merge is in progress; commit it or run merge --abort";
+            return r;
+        }
+        auto ours = headCommit();
+        auto theirs = resolveRevision(rev);
+        if (!theirs)
+        {
+            r.error = "unknown revision " + rev;
+            return r;
+        }
+        if (!ours)
+        {
+            r.error = "HEAD has no commits";
+            return r;
+        }
+        auto oursTree = commitTree(*ours), theirsTree = commitTree(*theirs);
+        if (!oursTree || !theirsTree)
+        {
+            r.error = "cannot read commit";
+            return r;
+        }
+        // Paths the merge rewrites would lose local edits; untracked files are
+        // left alone unless the merge would write over them.
+        std::set<std::string> untracked;
+        for (auto &e : status())
+        {
+            if (e.state == "modified" || e.state == "deleted")
+            {
+                r.error = "uncommitted changes in " + e.path;
+                return r;
+            }
+            if (e.state == "untracked")
+                untracked.insert(e.path);
+        }
+        if (buildTreeFromIndex() != *oursTree)
+        {
+            r.error = "staged changes not committed";
+            return r;
+        }
+
+        auto base = mergeBase(store_, *ours, *theirs);
+        if (base && *base == *theirs)
+        {
+            r.kind = MergeResult::Kind::UpToDate;
+            r.commit = *ours;
+            return r;
+        }
+        if (base && *base == *ours)
+        {
+            if (!switchTree(*oursTree, *theirsTree, untracked, r.error))
+                return r;
+            if (!stageTags(commitPathTags(*theirs)) || !advanceHead(*theirs, *ours))
+            {
+                r.error = "cannot update working tree";
+                return r;
+            }
+            r.kind = MergeResult::Kind::FastForward;
+            r.commit = *theirs;
+            return r;
+        }
+
+        // Unrelated histories merge against an empty base.
+        auto baseTree = base ? commitTree(*base).value_or("") : "";
+        TreeMerger merger(store_, "HEAD", rev);
+        auto merged = merger.merge(baseTree, *oursTree, *theirsTree);
+        r.conflicts = merger.conflicts();
+        // Path tags from both sides are kept.
+        auto tags = stagedTags();
+        for (auto &e : commitPathTags(*theirs))
+            tags.push_back(std::move(e));
+        if (!switchTree(*oursTree, merged, untracked, r.error))
+            return r;
+        if (!stageTags(tags))
+        {
+            r.error = "cannot update working tree";
+            return r;
+        }
+        if (!r.conflicts.empty())
+        {
+            std::string pending = *theirs + "\n";
+            for (auto &c : r.conflicts)
+                pending += c.path + "\n";
+            writeFile(mergeHeadFile(), pending);
+            r.kind = MergeResult::Kind::Conflicts;
+            return r;
+        }
+        auto tagsHash = writeCommitTags({});
+        r.commit = store_.writeCommit(merged, {*ours, *theirs}, author, now(),
+                                      message.empty() ? "Merge " + rev : message, tagsHash);
+        if (!advanceHead(r.commit, *ours))
+        {
+            r.error = "HEAD moved during the merge";
+            return r;
+        }
+        indexCommitTags(r.commit, tagsHash);
+        r.kind = MergeResult::Kind::Merged;
+        return r;
+    }
+
+    bool Repository::mergeAbort()
+    {
+        if (!std::filesystem::exists(mergeHeadFile()))
+            return false;
+        auto head = headCommit();
+        auto tree = head ? commitTree(*head) : std::nullopt;
+        if (!tree)
+            return false;
+        // Undoes what the merge (and any staging since) changed, keeping
+        // untracked files as merge did.
+        std::set<std::string> untracked;
+        for (auto &e : status())
+            if (e.state == "untracked")
+                untracked.insert(e.path);
+        std::string error;
+        if (!switchTree(buildTreeFromIndex(), *tree, untracked, error) || !stageTags(commitPathTags(*head)))
+            return false;
+        std::error_code ec;
+        return std::filesystem::remove(mergeHeadFile(), ec);
+    }
+
+    SparseSpec Repository::sparseSpec() const
+    {
+        SparseSpec spec;
+        spec.load(sparseFile());
+        return spec;
+    }
+
+    bool Repository::setSparseSpec(const std::vector<std::string> &dirs)
+    {
+        if (dirs.empty())
+        {
+            std::error_code ec;
+            std::filesystem::remove(sparseFile(), ec);
+            return !ec;
+        }
+        SparseSpec spec;
+        spec.set(dirs);
+        return spec.save(sparseFile());
+    }
+
+    std::vector<Repository::StatusEntry> Repository::status() const
+    {
+        util::TraceScope scope("status");
+        std::vector<StatusEntry> out;
+        index_.refresh();
+        auto working = workingTree();
+        util::TraceScope compareScope("status.compare");
+        for (auto &kv : working)
+        {
+            auto &rel = kv.first;
+            auto &whash = kv.second;
+            auto *e = index_.find(rel);
+            if (!e)
+            {
+                out.push_back({rel, "untracked"});
+            }
+            else if (e->hash != whash)
+            {
+                out.push_back({rel, "modified"});
+            }
+            else
+            {
+                out.push_back({rel, "staged"});
+            }
+        }
+        index_.forEach([&](const std::string &path, const IndexEntry &e)
+                       {
+                           if (e.mode != "040000" && !working.count(path))
+                               out.push_back({path, "deleted"}); });
+        if (out.empty())
+            out.push_back({"", "clean"});
+        return out;
+    }
+
+    bool Repository::log(const LogOptions &opt, const std::function<bool(const LogEntry &)> &fn) const
+    {
+        util::TraceScope scope("log");
+        auto start = opt.start == "HEAD" ? headCommit() : resolveRevision(opt.start);
+        if (!start)
+            return opt.start == "HEAD";
+        // First-parent history is time-ordered up to clock skew, so the walk
+        // stops after a few commits in a row older than `since`, not the first.
+        constexpr int kSinceSlop = 5;
+        int older = 0;
+        size_t shown = 0;
+        LogEntry e;
+        std::string tree;
+        for (std::string cur = *start; !cur.empty();)
+        {
+            if (!store_.readCommit(cur, tree, e.parents, e.author, e.time, e.message))
+                return false;
+            e.hash = std::move(cur);
+            cur = e.parents.empty() ? "" : e.parents.front();
+            if (opt.since && e.time < *opt.since)
+            {
+                if (++older >= kSinceSlop)
+                    break;
+                continue;
+            }
+            older = 0;
+            if (opt.until && e.time > *opt.until)
+                continue;
+            if (!fn(e) || (opt.maxCount && ++shown >= opt.maxCount))
+                break;
+        }
+        return true;
+    }
+
+    std::string Repository::formatLogEntry(const LogEntry &e, bool oneline)
+    {
+        std::ostringstream oss;
+        if (oneline)
+        {
+            oss << e.hash.substr(0, 12) << " " << e.message.substr(0, e.message.find('\n')) << "\n";
+            return oss.str();
+        }
+        oss << "commit " << e.hash << "\n";
+        if (e.parents.size() > 1)
+        {
+            oss << "Merge:";
+            for (auto &p : e.parents)
+                oss << " " << p.substr(0, 12);
+            oss << "\n";
+        }
+        oss << "Author: " << e.author << "\n"
+            << "Date:   " << e.time << "\n\n"
+            << "    " << e.message << "\n";
+        return oss.str();
+    }
+
+    bool Repository::grep(const std::string &pattern, const std::vector<std::string> &revs, const GrepOptions &opt,
+                          const std::function<bool(const GrepHit &)> &fn, std::string &error) const
+    {
+        util::TraceScope scope("grep");
+        GrepPattern compiled(pattern, opt);
+        if (!compiled.valid())
+        {
+            error = "invalid regular expression: " + pattern;
+            return false;
+        }
+        std::vector<std::pair<std::string, std::string>> trees; // (target, tree)
+        for (auto &rev : revs)
+        {
+            auto commit = resolveRevision(rev);
+            auto tree = commit ? commitTree(*commit) : std::nullopt;
+            if (!tree)
+            {
+                error = "unknown revision " + rev;
+                return false;
+            }
+            trees.emplace_back(rev, *tree);
+        }
+        if (opt.history)
+        {
+            // Every commit reachable from HEAD or a ref, newest first.
+            std::vector<std::string> stack;
+            for (auto &r : listRefs())
+                stack.push_back(r.second);
+            if (auto head = resolveHEAD())
+                stack.push_back(*head);
+            std::set<std::string> seen;
+            std::vector<std::tuple<long long, std::string, std::string>> commits;
+            while (!stack.empty())
+            {
+                auto c = std::move(stack.back());
+                stack.pop_back();
+                std::string tree, author, msg;
+                std::vector<std::string> parents;
+                long long ts = 0;
+                if (!seen.insert(c).second || !store_.readCommit(c, tree, parents, author, ts, msg))
+                    continue;
+                stack.insert(stack.end(), parents.begin(), parents.end());
+                commits.emplace_back(ts, std::move(c), std::move(tree));
+            }
+            std::sort(commits.begin(), commits.end(), std::greater<>());
+            for (auto &c : commits)
+                trees.emplace_back(std::get<1>(c), std::get<2>(c));
+        }
+
+        Grepper grepper(store_, compiled, opt.jobs);
+        if (revs.empty() && !opt.history)
+        {
+            auto files = workingTree();
+            grepper.addFiles("", root_, {files.begin(), files.end()});
+        }
+        for (auto &t : trees)
+            grepper.addTree(t.first, t.second);
+        grepper.report(fn);
+        return true;
+    }
+
+    std::optional<std::vector<BlameLine>> Repository::blame(const std::string &path, const std::string &rev) const
+    {
+        auto commit = resolveRevision(rev);
+        std::vector<BlameLine> lines;
+        if (!commit || !Blamer(store_).run(*commit, fs::path(path).lexically_normal().generic_string(), lines))
+            return std::nullopt;
+        return lines;
+    }
+
+    std::string Repository::diff(const std::string &a, const std::string &b, const RenameOptions &renameOpt) const
+    {
+        util::TraceScope scope("diff");
+        auto readRefOrCommit = [&](const std::string &id)
+        { return resolveRevision(id); };
+
+        std::function<void(const std::string &, const std::string &, std::map<std::string, std::string> &)> walkTree =
+            [&](const std::string &th, const std::string &prefix, std::map<std::string, std::string> &pathToBlob)
+        {
+            std::vector<TreeEntry> entries;
+            if (!store_.readTree(th, entries))
+                return;
+            for (auto &e : entries)
+            {
+                if (e.mode == "040000")
+                    walkTree(e.hash, prefix + e.name + "/", pathToBlob);
+                else
+                    pathToBlob[prefix + e.name] = e.hash;
+            }
+        };
+
+        auto loadTreeFromCommit = [&](const std::string &commit, std::map<std::string, std::string> &pathToBlob)
+        {
+            std::string tree, parent, author, msg;
+            long long ts = 0;
+            if (!store_.readCommit(commit, tree, parent, author, ts, msg))
+                return false;
+            walkTree(tree, "", pathToBlob);
+            return true;
+        };
+
+        std::map<std::string, std::string> left, right;
+
+        if (a == "WORKING")
+        {
+            for (auto &kv : workingTree())
+                if (!kv.second.empty())
+                    left.emplace_hint(left.end(), kv.first, kv.second);
+        }
+        else if (a == "INDEX")
+        {
+            index_.refresh();
+            index_.forEach([&](const std::string &path, const IndexEntry &e)
+                           {
+                               if (e.mode == "040000")
+                                   walkTree(e.hash, path + "/", left);
+                               else
+                                   left.emplace_hint(left.end(), path, e.hash); });
+        }
+        else
+        {
+            auto ca = readRefOrCommit(a);
+            if (!ca)
+                return "Left side not found\n";
+            loadTreeFromCommit(*ca, left);
+        }
+
+        if (b == "WORKING")
+        {
+            for (auto &kv : workingTree())
+                if (!kv.second.empty())
+                    right.emplace_hint(right.end(), kv.first, kv.second);
+        }
+        else if (b == "INDEX")
+        {
+            index_.refresh();
+            index_.forEach([&](const std::string &path, const IndexEntry &e)
+                           {
+                               if (e.mode == "040000")
+                                   walkTree(e.hash, path + "/", right);
+                               else
+                                   right.emplace_hint(right.end(), path, e.hash); });
+        }
+        else
+        {
+            auto cb = readRefOrCommit(b);
             if (!cb)
                 return "Right side not found\n";
             loadTreeFromCommit(*cb, right);
@@ -440,10 +1694,44 @@ namespace vcs
         for (auto &kv : right)
             all.insert(kv.first);
 
+        // Renamed/copied targets are shown against their source; rename
+        // sources are not reported as deleted.
+        std::map<std::string, RenamePair> renames;
+        std::set<std::string> renamedFrom;
+        for (auto &r : detectRenames(store_, left, right, renameOpt))
+        {
+            if (!r.copy)
+                renamedFrom.insert(r.from);
+            renames.emplace(r.to, std::move(r));
+        }
+
         for (auto &path : all)
         {
             auto itL = left.find(path), itR = right.find(path);
-            if (itL == left.end())
+            auto rn = renames.find(path);
+            if (renamedFrom.count(path) && itR == right.end())
+                continue;
+            if (rn != renames.end())
+            {
+                auto &r = rn->second;
+                const char *kind = r.copy ? "copy" : "rename";
+                out << "diff -- " << path << "\n";
+                out << kind << " from " << r.from << "\n";
+                out << kind << " to " << r.to << "\n";
+                out << "similarity " << r.similarity << "%\n";
+                auto &fromHash = left.at(r.from);
+                if (fromHash == itR->second)
+                    continue;
+                out << "--- a/" << r.from << "\n";
+                out << "+++ b/" << path << "\n";
+                std::string lb, rb;
+                store_.readBlob(fromHash, lb);
+                store_.readBlob(itR->second, rb);
+                auto h = diffText(lb, rb);
+                for (auto &l : h)
+                    out << l.tag << l.text << "\n";
+            }
+            else if (itL == left.end())
             {
                 out << "diff -- " << path << "\n";
                 out << "--- a/" << path << "\n";
@@ -484,6 +1772,399 @@ namespace vcs
         return s;
     }
 
+    std::unique_ptr<Repository> Repository::openRemote(const fs::path &remote, std::string &error) const
+    {
+        auto dir = remote.is_absolute() ? remote : root_ / remote;
+        std::error_code ec;
+        // Checked before constructing: opening a Repository creates .chronofs/objects.
+        if (!std::filesystem::exists(dir / ".chronofs" / "HEAD", ec))
+        {
+            error = remote.string() + " is not a chronofs repository";
+            return nullptr;
+        }
+        auto repo = std::make_unique<Repository>(dir);
+        if (repo->commonDir() == commonDir())
+        {
+            error = remote.string() + " shares this repository's objects and refs";
+            return nullptr;
+        }
+        return repo;
+    }
+
+    bool Repository::transfer(const Repository &from, Repository &to, std::vector<RefUpdate> &updates, bool force,
+                              TransferStats &stats, std::string &error)
+    {
+        util::TraceScope scope("transfer");
+        updates.erase(std::remove_if(updates.begin(), updates.end(), [](const RefUpdate &u)
+                                     { return u.oldHash == u.newHash; }),
+                      updates.end());
+        if (updates.empty())
+            return true;
+
+        // Negotiation: everything below the receiver's refs and HEAD is there.
+        std::vector<std::string> haves, wants;
+        for (auto &r : to.listRefs())
+            haves.push_back(r.second);
+        if (auto head = to.resolveHEAD())
+            haves.push_back(*head);
+        for (auto &u : updates)
+            wants.push_back(u.newHash);
+
+        // The pack is spooled next to the receiver's objects (gc removes a
+        // leftover tmp_ file) and unpacked from there.
+        auto spool = fsops::tempSibling(to.store_.objectsDir() / "pack");
+        bool ok;
+        {
+            std::ofstream out(spool, std::ios::binary);
+            PackWriter writer(from.store_);
+            ok = writer.write(wants, haves, out, stats);
+            out.close();
+            ok &= !out.fail();
+        }
+        if (!ok)
+            error = "cannot read objects to send";
+        else
+        {
+            std::ifstream in(spool, std::ios::binary);
+            ok = unpackObjects(to.store_, in, stats, error);
+        }
+        std::error_code ec;
+        std::filesystem::remove(spool, ec);
+        if (!ok)
+            return false;
+
+        for (auto &u : updates)
+            if (!force && !u.oldHash.empty() && mergeBase(to.store_, u.oldHash, u.newHash) != u.oldHash)
+            {
+                error = u.ref + " is not a fast-forward (use --force)";
+                return false;
+            }
+        // All or nothing, as a transaction: every ref is locked (in name
+        // order, so two transfers cannot deadlock), each old value is checked
+        // under the locks, and only then are the new values committed. A ref
+        // that moved since it was read fails the transfer before any changes.
+        std::vector<size_t> order(updates.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                  { return updates[a].ref < updates[b].ref; });
+        std::vector<std::unique_ptr<fsops::LockFile>> locks;
+        for (auto i : order)
+        {
+            auto &u = updates[i];
+            locks.push_back(std::make_unique<fsops::LockFile>(to.commonDir() / u.ref));
+            if (!locks.back()->acquire())
+            {
+                error = "cannot lock " + u.ref;
+                return false;
+            }
+            if (to.readRef(u.ref).value_or("") != u.oldHash)
+            {
+                error = u.ref + " changed during the transfer";
+                return false;
+            }
+        }
+        for (size_t k = 0; k < order.size(); k++)
+            if (!locks[k]->commit(updates[order[k]].newHash + "\n"))
+            {
+                // Only a failed rename gets here; the refs before it are
+                // already published, and the error names the first that is not.
+                error = "cannot write " + updates[order[k]].ref;
+                return false;
+            }
+        return true;
+    }
+
+    bool Repository::fetch(const fs::path &remote, const std::vector<std::string> &branches, const std::string &name,
+                           bool force, TransferStats &stats, std::vector<RefUpdate> &updated, std::string &error)
+    {
+        util::TraceScope scope("fetch");
+        if (!validBranchName(name) || name.find('/') != std::string::npos)
+        {
+            error = "bad remote name " + name;
+            return false;
+        }
+        auto from = openRemote(remote, error);
+        if (!from)
+            return false;
+        std::map<std::string, std::string> theirs;
+        for (auto &r : from->listRefs())
+            if (r.first.rfind("refs/heads/", 0) == 0 && !r.second.empty())
+                theirs.emplace(r.first.substr(11), r.second);
+        std::vector<std::string> wanted = branches;
+        if (wanted.empty())
+            for (auto &t : theirs)
+                wanted.push_back(t.first);
+        updated.clear();
+        for (auto &b : wanted)
+        {
+            auto it = theirs.find(b);
+            if (it == theirs.end())
+            {
+                error = "remote has no branch " + b;
+                return false;
+            }
+            auto ref = "refs/remotes/" + name + "/" + b;
+            updated.push_back({ref, readRef(ref).value_or(""), it->second});
+        }
+        return transfer(*from, *this, updated, force, stats, error);
+    }
+
+    bool Repository::push(const fs::path &remote, const std::vector<std::string> &branches, bool force,
+                          TransferStats &stats, std::vector<RefUpdate> &updated, std::string &error)
+    {
+        util::TraceScope scope("push");
+        auto to = openRemote(remote, error);
+        if (!to)
+            return false;
+        std::vector<std::string> wanted = branches;
+        if (wanted.empty())
+        {
+            auto head = currentHeadRef();
+            if (head.rfind("refs/heads/", 0) != 0)
+            {
+                error = "HEAD is detached; name the branches to push";
+                return false;
+            }
+            wanted.push_back(head.substr(11));
+        }
+        auto checkedOut = to->worktrees();
+        updated.clear();
+        for (auto &b : wanted)
+        {
+            auto ref = "refs/heads/" + b;
+            auto mine = validBranchName(b) ? readRef(ref).value_or("") : "";
+            if (mine.empty())
+            {
+                error = "no commits on branch " + b;
+                return false;
+            }
+            auto old = to->readRef(ref).value_or("");
+            // Moving a checked-out branch would leave that worktree's files
+            // and index behind its HEAD; an unborn one has nothing to lose.
+            for (auto &w : checkedOut)
+                if (w.branch == ref && !old.empty())
+                {
+                    error = b + " is checked out in " + w.root.string();
+                    return false;
+                }
+            updated.push_back({ref, old, mine});
+        }
+        return transfer(*this, *to, updated, force, stats, error);
+    }
+
+    std::vector<fs::path> Repository::worktreeRoots() const
+    {
+        std::vector<fs::path> out{commonDir().parent_path()};
+        std::string data;
+        readFile(worktreesFile(), data);
+        std::istringstream in(data);
+        std::string line;
+        std::error_code ec;
+        while (std::getline(in, line))
+            if (!line.empty() && std::filesystem::exists(fs::path(line) / ".chronofs" / "commondir", ec))
+                out.emplace_back(line);
+        return out;
+    }
+
+    bool Repository::isThisWorktree(const fs::path &root) const
+    {
+        std::error_code ec;
+        return std::filesystem::weakly_canonical(root, ec) == std::filesystem::weakly_canonical(root_, ec);
+    }
+
+    std::optional<fs::path> Repository::checkedOutElsewhere(const std::string &refPath) const
+    {
+        for (auto &wt : worktreeRoots())
+        {
+            std::string head;
+            if (!isThisWorktree(wt) && readFile(wt / ".chronofs" / "HEAD", head) && trimmed(head) == "ref: " + refPath)
+                return wt;
+        }
+        return std::nullopt;
+    }
+
+    bool Repository::addWorktree(const fs::path &dir, const std::string &rev, std::string &error)
+    {
+        util::TraceScope scope("worktree.add");
+        std::error_code ec;
+        auto target = std::filesystem::weakly_canonical(dir.is_absolute() ? dir : root_ / dir, ec);
+        if (ec || (std::filesystem::exists(target) && !std::filesystem::is_empty(target, ec)))
+        {
+            error = dir.string() + " exists and is not empty";
+            return false;
+        }
+        for (auto &wt : worktreeRoots())
+        {
+            auto rel = target.lexically_relative(std::filesystem::weakly_canonical(wt, ec)).generic_string();
+            if (rel.empty() || rel == "." || rel.rfind("..", 0) != 0)
+            {
+                error = dir.string() + " is inside the worktree " + wt.string();
+                return false;
+            }
+        }
+        auto commit = resolveRevision(rev);
+        if (!commit)
+        {
+            error = "unknown revision " + rev;
+            return false;
+        }
+        std::string branch;
+        if (rev.rfind("refs/heads/", 0) == 0)
+            branch = rev;
+        else if (rev != "HEAD" && validBranchName(rev) && readRef("refs/heads/" + rev))
+            branch = "refs/heads/" + rev;
+        if (!branch.empty() && (currentHeadRef() == branch || checkedOutElsewhere(branch)))
+        {
+            error = branch.substr(11) + " is already checked out in another worktree";
+            return false;
+        }
+
+        // Detached at the commit until checkout, which then sets the branch.
+        auto dot = target / ".chronofs";
+        std::filesystem::create_directories(dot, ec);
+        if (ec || !writeFile(dot / "commondir", commonDir().string() + "\n") || !writeFile(dot / "HEAD", *commit + "\n"))
+        {
+            error = "cannot create " + dot.string();
+            return false;
+        }
+        {
+            fsops::LockFile lock(worktreesFile());
+            std::string list;
+            bool ok = lock.acquire();
+            if (ok)
+            {
+                readFile(worktreesFile(), list);
+                ok = lock.commit(list + target.string() + "\n");
+            }
+            if (!ok)
+            {
+                error = "cannot register the worktree";
+                fsops::removePath(target);
+                return false;
+            }
+        }
+        Repository wt(target);
+        if (!wt.checkout(branch.empty() ? *commit : branch))
+        {
+            error = "cannot check out " + rev + " in " + target.string();
+            return false;
+        }
+        return true;
+    }
+
+    bool Repository::removeWorktree(const fs::path &dir, std::string &error)
+    {
+        std::error_code ec;
+        auto target = std::filesystem::weakly_canonical(dir.is_absolute() ? dir : root_ / dir, ec);
+        auto roots = worktreeRoots();
+        auto it = std::find_if(roots.begin() + 1, roots.end(), [&](const fs::path &wt)
+                               { return std::filesystem::weakly_canonical(wt, ec) == target; });
+        if (it == roots.end())
+        {
+            error = dir.string() + " is not a linked worktree";
+            return false;
+        }
+        if (isThisWorktree(target))
+        {
+            error = "cannot remove the current worktree";
+            return false;
+        }
+        Repository wt(target);
+        for (auto &e : wt.status())
+            if (e.state != "staged")
+            {
+                error = e.path + " is " + e.state + " in " + target.string();
+                return false;
+            }
+        fsops::LockFile lock(worktreesFile());
+        if (!lock.acquire())
+        {
+            error = "cannot lock the worktree list";
+            return false;
+        }
+        std::string list, kept;
+        readFile(worktreesFile(), list);
+        std::istringstream in(list);
+        std::string line;
+        while (std::getline(in, line))
+            if (!line.empty() && line != it->string() && std::filesystem::exists(fs::path(line) / ".chronofs" / "commondir", ec))
+                kept += line + "\n";
+        if (!lock.commit(kept) || !fsops::removePath(target))
+        {
+            error = "cannot remove " + target.string();
+            return false;
+        }
+        return true;
+    }
+
+    std::vector<Repository::WorktreeInfo> Repository::worktrees() const
+    {
+        std::vector<WorktreeInfo> out;
+        for (auto &wt : worktreeRoots())
+        {
+            Repository r(wt);
+            out.push_back({wt, r.resolveHEAD().value_or(""), r.currentHeadRef()});
+        }
+        return out;
+    }
+
+    GcStats Repository::gc(const GcOptions &opt) const
+    {
+        util::TraceScope scope("gc");
+        std::vector<std::string> commits, blobs;
+        for (auto &r : listRefs())
+            commits.push_back(r.second);
+        // Every worktree's HEAD and staged but uncommitted content are live too.
+        std::vector<std::string> trees;
+        for (auto &wt : worktreeRoots())
+        {
+            std::unique_ptr<Repository> other;
+            auto *repo = this;
+            if (!isThisWorktree(wt))
+                repo = (other = std::make_unique<Repository>(wt)).get();
+            if (auto head = repo->resolveHEAD())
+                commits.push_back(*head);
+            // Only MERGE_HEAD may reference the commit a pending merge will record.
+            if (auto theirs = repo->mergeHeadCommit())
+                commits.push_back(*theirs);
+            repo->index_.refresh();
+            repo->index_.forEach([&](const std::string &, const IndexEntry &e)
+                                 { (e.mode == "040000" ? trees : blobs).push_back(e.hash); });
+        }
+        GarbageCollector collector(store_, opt);
+        return collector.run(commits, trees, blobs);
+    }
+
+    FsckReport Repository::fsck(const FsckOptions &opt) const
+    {
+        // Roots are read before the object scan so every object they name
+        // was already on disk when the directory was listed.
+        std::vector<std::pair<std::string, std::string>> roots;
+        for (auto &r : listRefs())
+            roots.push_back(r);
+        for (auto &wt : worktreeRoots())
+        {
+            std::unique_ptr<Repository> other;
+            auto *repo = this;
+            std::string label;
+            if (!isThisWorktree(wt))
+            {
+                repo = (other = std::make_unique<Repository>(wt)).get();
+                label = wt.string() + ":";
+            }
+            if (auto head = repo->resolveHEAD())
+                roots.emplace_back(label + "HEAD", *head);
+            if (auto theirs = repo->mergeHeadCommit())
+                roots.emplace_back(label + "MERGE_HEAD", *theirs);
+            repo->index_.refresh();
+            repo->index_.forEach([&](const std::string &path, const IndexEntry &e)
+                                 { roots.emplace_back(label + "index:" + path, e.hash); });
+        }
+        Fsck fsck(store_, commonDir() / "fsck-checkpoint", opt);
+        return fsck.run(roots);
+    }
+
     bool Repository::fsTouch(const fs::path &p) const { return fsops::touch(root_ / p); }
     bool Repository::fsMkdirs(const fs::path &p) const { return fsops::mkdirs(root_ / p); }
     bool Repository::fsRemove(const fs::path &p) const { return fsops::removePath(root_ / p); }
@@ -1,9 +1,31 @@
 #pragma once
 #include "../vcs/ObjectStore.hpp"
+#include "../vcs/Blame.hpp"
 #include "../vcs/Index.hpp"
+#include "../vcs/Gc.hpp"
+#include "../vcs/Grep.hpp"
+#include "../vcs/Fsck.hpp"
+#include "../vcs/Ignore.hpp"
+#include "../vcs/Import.hpp"
+#include "../vcs/Merge.hpp"
+#include "../vcs/PackedRefs.hpp"
+#include "../vcs/Renames.hpp"
+#include "../vcs/Sparse.hpp"
+#include "../vcs/TagIndex.hpp"
+#include "../vcs/Transfer.hpp"
 #include <string>
 #include <filesystem>
 #include <optional>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <unordered_map>
+
+namespace fsops
+{
+    class AsyncIo;
+}
 
 namespace vcs
 {
@@ -13,23 +35,76 @@ namespace vcs
     {
     public:
         explicit Repository(const fs::path &root);
+        ~Repository();
+
+        const fs::path &root() const { return root_; }
 
         // Core repo ops
-        bool init();
+        bool init(bool rawBlobs = false); // rawBlobs: store blob bodies header-less (see ObjectStore)
         bool isInitialized() const;
-        std::string currentHeadRef() const;             // e.g., "refs/heads/main"
+        std::string currentHeadRef() const;             // e.g., "refs/heads/main"; "" when detached
         std::optional<std::string> resolveHEAD() const; // commit hash
+        // "HEAD", a branch name, a "refs/..." path or a full commit hash.
+        std::optional<std::string> resolveRevision(const std::string &rev) const;
 
+        // Ref and HEAD writes hold "<file>.lock" (fsops::LockFile). With
+        // `expected`, the update is a compare-and-swap: it fails unless the
+        // ref still holds that commit ("" for a missing or unborn ref).
         bool setHeadRef(const std::string &refPath); // write HEAD: "ref: <refPath>"
-        bool updateRef(const std::string &refPath, const std::string &commitHash);
-        std::optional<std::string> readRef(const std::string &refPath) const;
+        // Moves the current branch, or a detached HEAD.
+        bool advanceHead(const std::string &commitHash, const std::optional<std::string> &expected = std::nullopt);
+        bool updateRef(const std::string &refPath, const std::string &commitHash,
+                       const std::optional<std::string> &expected = std::nullopt);
+        std::optional<std::string> readRef(const std::string &refPath) const; // loose file, else packed-refs
+        bool deleteRef(const std::string &refPath);
+        std::vector<std::pair<std::string, std::string>> listRefs() const; // (refPath, commit), sorted
+        // Moves every loose ref into packed-refs and removes the loose files.
+        bool packRefs(size_t &packed);
+
+        // Branches are refs under refs/heads/.
+        bool createBranch(const std::string &name, const std::string &rev);
+        bool deleteBranch(const std::string &name); // refuses a branch checked out in any worktree
+        std::vector<std::string> branches() const;
 
         // Staging/commit
         bool addPath(const fs::path &relPath); // stage file
-        std::optional<std::string> commit(const std::string &message, const std::string &author);
+        bool addPaths(const std::vector<fs::path> &relPaths); // stage files in I/O batches, save index once
+        // Concludes a pending merge; `tags` ("key=value") label the commit itself.
+        std::optional<std::string> commit(const std::string &message, const std::string &author,
+                                          const std::vector<std::string> &tags = {});
+        // Stages everything under dir (inside the working tree) in one parallel
+        // pass, replacing the index entries below it, and commits once.
+        std::optional<std::string> importDir(const fs::path &dir, const std::string &message,
+                                             const std::string &author, ImportStats &stats);
 
-        // Checkout
-        bool checkout(const std::string &commitHash);
+        // Tags: "key=value" labels on tracked paths are staged in
+        // `.chronofs/tags` like index entries and carried into every commit
+        // (through a tags object the commit names) until removed; checkout
+        // stages the target commit's path tags. Each commit is added to the
+        // TagIndex as it is made, so lookups read no trees.
+        bool tagPaths(const std::string &tag, const std::vector<std::string> &paths, bool remove);
+        std::vector<TagEntry> stagedTags() const;
+        std::optional<std::vector<TagEntry>> tagsAt(const std::string &rev) const; // path and commit tags
+        std::optional<std::vector<std::string>> taggedPaths(const std::string &tag, const std::string &rev = "HEAD") const;
+        // Commits reachable from HEAD or a ref that carry the tag, newest first.
+        std::vector<std::string> taggedCommits(const std::string &tag) const;
+
+        // Checkout (resets the index to the commit; honours the sparse spec).
+        // A branch name moves HEAD to that branch (unless another worktree
+        // has it checked out); anything else detaches it.
+        bool checkout(const std::string &rev);
+        // Writes the given paths (files, or directories recursively; "." is
+        // the whole tree) as they are in rev and points their index entries
+        // at those blobs, leaving everything else alone; tracked files below
+        // a restored directory that rev lacks are removed. Only the blob
+        // hashes change: the index keeps no stat data, and the written files
+        // are hashed again by the next status. Each path is found by tree
+        // lookup, so the cost follows what is restored. False with `error`
+        // set if rev or any path cannot be resolved, before anything is
+        // written.
+        bool restore(const std::string &rev, const std::vector<std::string> &paths, std::string &error);
+        SparseSpec sparseSpec() const;
+        bool setSparseSpec(const std::vector<std::string> &dirs); // empty disables
 
         // Status & log & diff
         struct StatusEntry
@@ -38,8 +113,97 @@ namespace vcs
             std::string state;
         }; // "staged", "modified", "deleted", "untracked", "clean"
         std::vector<StatusEntry> status() const;
-        std::vector<std::string> log() const;
-        std::string diff(const std::string &a, const std::string &b) const; // a,b: "WORKING", "INDEX", "HEAD" or commit hash
+        struct LogEntry
+        {
+            std::string hash;
+            std::vector<std::string> parents;
+            std::string author;
+            long long time = 0;
+            std::string message;
+        };
+        struct LogOptions
+        {
+            std::string start = "HEAD";            // any revision resolveRevision() accepts
+            size_t maxCount = 0;                   // 0: no limit
+            std::optional<long long> since, until; // inclusive bounds on the commit time
+        };
+        // Streams first-parent history newest first, reading one commit per
+        // entry; fn returns false to stop. The walk ends after maxCount
+        // entries or once the history has passed `since`. False when start
+        // does not resolve (an unborn HEAD just yields nothing).
+        bool log(const LogOptions &opt, const std::function<bool(const LogEntry &)> &fn) const;
+        static std::string formatLogEntry(const LogEntry &e, bool oneline);
+        // Searches the working tree (no revs), the given revisions and/or all
+        // history, each distinct blob once (see Grepper); hits are passed to
+        // fn as they are found. False with `error` set for a bad pattern or
+        // an unknown revision.
+        bool grep(const std::string &pattern, const std::vector<std::string> &revs, const GrepOptions &opt,
+                  const std::function<bool(const GrepHit &)> &fn, std::string &error) const;
+        // Line-by-line attribution of a file as of rev (see Blamer).
+        std::optional<std::vector<BlameLine>> blame(const std::string &path, const std::string &rev = "HEAD") const;
+        std::string diff(const std::string &a, const std::string &b,
+                         const RenameOptions &renames = {}) const; // a,b: "WORKING", "INDEX", "HEAD" or commit hash
+
+        // Merge
+        struct MergeResult
+        {
+            enum class Kind
+            {
+                UpToDate,
+                FastForward,
+                Merged,
+                Conflicts, // working tree holds markers; MERGE_HEAD awaits commit
+                Failed
+            } kind = Kind::Failed;
+            std::string commit; // new HEAD (not set for Conflicts/Failed)
+            std::vector<MergeConflict> conflicts;
+            std::string error;
+        };
+        // Only paths the merge changes are rewritten; it refuses to run over
+        // local edits or to write over untracked files.
+        MergeResult merge(const std::string &rev, const std::string &author, const std::string &message);
+        bool mergeAbort();
+
+        // Worktrees: a linked worktree shares the objects, refs, packed-refs
+        // and tag index of the main repository and has its own HEAD, index,
+        // sparse spec, staged tags and merge state in <dir>/.chronofs, whose
+        // `commondir` file names the shared directory. Adding one writes
+        // only its checked-out files. The main repository lists them in
+        // `worktrees`; gc and fsck treat every worktree's HEAD and index as
+        // roots.
+        struct WorktreeInfo
+        {
+            fs::path root;
+            std::string head;   // commit, "" when unborn
+            std::string branch; // e.g. "refs/heads/main"; "" when detached
+        };
+        bool addWorktree(const fs::path &dir, const std::string &rev, std::string &error);
+        bool removeWorktree(const fs::path &dir, std::string &error); // refuses one with local changes
+        std::vector<WorktreeInfo> worktrees() const;                    // the main worktree first
+
+        // Remotes are other repositories (or their worktrees) on a local path.
+        // The receiver's ref tips are sent as haves, only the objects it
+        // lacks travel, as one pack (see PackWriter), and refs move once the
+        // pack is stored: all their locks are taken and every value read at
+        // the start is checked before any is written, so all move or none
+        // do, and only as fast-forwards unless `force`. Fetch updates refs/remotes/<name>/<branch> from the
+        // remote's branches (all of them by default); push updates the
+        // remote's refs/heads/<branch> (the current branch by default) and
+        // refuses one checked out in a remote worktree once it has commits.
+        struct RefUpdate
+        {
+            std::string ref;
+            std::string oldHash; // "" for a new ref
+            std::string newHash;
+        };
+        bool fetch(const fs::path &remote, const std::vector<std::string> &branches, const std::string &name,
+                   bool force, TransferStats &stats, std::vector<RefUpdate> &updated, std::string &error);
+        bool push(const fs::path &remote, const std::vector<std::string> &branches, bool force,
+                  TransferStats &stats, std::vector<RefUpdate> &updated, std::string &error);
+
+        // Maintenance
+        GcStats gc(const GcOptions &opt) const;
+        FsckReport fsck(const FsckOptions &opt) const;
 
         // FS helpers (exposed via CLI)
         bool fsTouch(const fs::path &path) const;
@@ -49,25 +213,94 @@ namespace vcs
 
     private:
         fs::path root_;
-        ObjectStore store_;
+        fs::path common_; // the shared .chronofs: this worktree's own, or the one its commondir names
+        mutable ObjectStore store_; // status/diff hash working files into blobs
         mutable Index index_;
+        PackedRefs packedRefs_;
+        mutable TagIndex tagIndex_;
+        mutable std::unique_ptr<fsops::AsyncIo> io_; // created on first bulk operation
+        fsops::AsyncIo &io() const;
 
-        fs::path dotDir() const { return root_ / ".chronofs"; }
+        fs::path dotDir() const { return root_ / ".chronofs"; } // per-worktree state
+        fs::path commonDir() const { return common_; }            // objects, refs and other shared state
         fs::path headFile() const { return dotDir() / "HEAD"; }
-        fs::path refsHeadsDir() const { return dotDir() / "refs" / "heads"; }
+        fs::path refsHeadsDir() const { return commonDir() / "refs" / "heads"; }
+        fs::path worktreesFile() const { return commonDir() / "worktrees"; } // linked worktree roots, one per line
+        fs::path sparseFile() const { return dotDir() / "sparse-checkout"; }
+        fs::path tagsFile() const { return dotDir() / "tags"; } // staged path tags, as a tags object body
+        // (refPath, contents) of every file under refs/ except lock files; "" for an unborn branch.
+        std::vector<std::pair<std::string, std::string>> looseRefs() const;
+        fs::path mergeHeadFile() const { return dotDir() / "MERGE_HEAD"; } // theirs, then conflicted paths
 
         static bool readFile(const fs::path &p, std::string &out);
         static bool writeFile(const fs::path &p, const std::string &data);
 
         std::string buildTreeFromIndex() const;
-        void writeTreeRecursive(const std::vector<std::pair<std::string, IndexEntry>> &items,
-                                size_t start, size_t end, const std::string &dirPrefix,
-                                std::string &treeHash) const;
+        std::string writeTreeRecursive(PathTable::Id dir) const;
+
+        // Working-tree path -> blob hash, narrowed to fsmonitor-reported paths when possible.
+        std::map<std::string, std::string> workingTree() const;
+        // One fsops::DirWalker pass; skips paths matched by .chronofsignore
+        // rules unless they are tracked.
+        void scanWorkingTree(const std::string &relDir, std::map<std::string, std::string> &out) const;
+        bool tracksBelow(const std::string &relDir) const; // index has relDir or a path under it
 
-        std::optional<std::string> workingBlobHash(const fs::path &relPath) const;
+        // Working-file hashes keyed by path, reused while mtime and size match.
+        // Only pays off in long-lived processes such as `chronofs serve`.
+        struct StatCacheEntry
+        {
+            int64_t mtimeNs;
+            uintmax_t size;
+            std::string hash;
+        };
+        mutable std::unordered_map<std::string, StatCacheEntry> statCache_;
+        struct WorkingFile
+        {
+            std::string rel;
+            int64_t mtimeNs; // fsops::FileStat
+            uintmax_t size;
+        };
+        bool statCacheLookup(const WorkingFile &f, std::string &hash) const;
+        // Reads the files in I/O batches, stores them as blobs and records
+        // their hashes in `out` and the stat cache.
+        void hashWorkingFiles(const std::vector<WorkingFile> &files, std::map<std::string, std::string> &out) const;
         std::optional<std::string> blobHashOfCommitPath(const std::string &commitHash, const std::string &relPath) const;
-        bool materializeTree(const std::string &treeHash, const fs::path &dir) const;
+        // The entry at relPath ("" is the root, as a 040000 entry) read one directory at a time.
+        std::optional<TreeEntry> treeEntryAt(const std::string &treeHash, const std::string &relPath) const;
+        // Creates the tree's directories under relDir, records each entry in the
+        // index and queues its files as (path, blob) for writeWorkingFiles;
+        // subtrees excluded by `sparse` are staged as 040000 entries unread.
+        bool materializeTree(const std::string &treeHash, const std::string &relDir, const SparseSpec &sparse,
+                             std::vector<std::pair<std::string, std::string>> &files) const;
+        bool writeWorkingFiles(const std::vector<std::pair<std::string, std::string>> &files) const;
         std::optional<std::string> headCommit() const { return resolveHEAD(); }
+        // The other side of a pending merge (first line of MERGE_HEAD), if any.
+        std::optional<std::string> mergeHeadCommit() const;
+        // Replaces the working tree and index with the tree.
+        bool resetTo(const std::string &treeHash);
+        // Moves the working tree and index from `from` (the tree the index
+        // holds) to `to`, rewriting only the paths whose entries differ, so
+        // files outside the change, untracked or not, are left alone. False
+        // with `error` set, before anything is touched, when a file to be
+        // written is, is below or is above a path in `untracked`.
+        bool switchTree(const std::string &from, const std::string &to, const std::set<std::string> &untracked,
+                        std::string &error);
+        std::optional<std::string> commitTree(const std::string &commitHash) const;
+        std::unique_ptr<Repository> openRemote(const fs::path &remote, std::string &error) const;
+        // Sends from `from` what `to` lacks for the updates and applies them to `to`'s refs.
+        static bool transfer(const Repository &from, Repository &to, std::vector<RefUpdate> &updates, bool force,
+                             TransferStats &stats, std::string &error);
+        std::vector<fs::path> worktreeRoots() const; // the main one, then each linked one that still exists
+        bool isThisWorktree(const fs::path &root) const;
+        // Another worktree whose HEAD is refPath, if any.
+        std::optional<fs::path> checkedOutElsewhere(const std::string &refPath) const;
+        // The tags object for a new commit: staged tags of paths still in the
+        // index plus the commit's own; "" when there are none.
+        std::string writeCommitTags(const std::vector<std::string> &commitTags);
+        void indexCommitTags(const std::string &commitHash, const std::string &tagsHash) const;
+        // Replaces the staged path tags (entries with an empty path are dropped).
+        bool stageTags(const std::vector<TagEntry> &entries);
+        std::vector<TagEntry> commitPathTags(const std::string &commitHash) const;
     };
 
 }
@@ -0,0 +1,74 @@
+#include "vcs/Sparse.hpp"
+#include "fs/FileOps.hpp"
+#include <algorithm>
+#include <sstream>
+
+namespace vcs
+{
+
+    bool SparseSpec::load(const fs::path &file)
+    {
+        dirs_.clear();
+        std::string data;
+        if (!fsops::readFile(file, data))
+            return false;
+        std::istringstream iss(data);
+        std::string line;
+        std::vector<std::string> dirs;
+        while (std::getline(iss, line))
+            dirs.push_back(line);
+        set(std::move(dirs));
+        return true;
+    }
+
+    bool SparseSpec::save(const fs::path &file) const
+    {
+        std::string data;
+        for (auto &d : dirs_)
+            data += d + "\n";
+        return fsops::writeFile(file, data);
+    }
+
+    void SparseSpec::set(std::vector<std::string> dirs)
+    {
+        dirs_.clear();
+        for (auto &d : dirs)
+        {
+            while (!d.empty() && (d.back() == '/' || d.back() == '\r'))
+                d.pop_back();
+            while (!d.empty() && d.front() == '/')
+                d.erase(0, 1);
+            if (!d.empty() && d[0] != '#')
+                dirs_.push_back(d);
+        }
+        std::sort(dirs_.begin(), dirs_.end());
+        dirs_.erase(std::unique(dirs_.begin(), dirs_.end()), dirs_.end());
+    }
+
+    SparseSpec::Match SparseSpec::matchDir(const std::string &relDir) const
+    {
+        if (dirs_.empty())
+            return Match::Included;
+        if (relDir.empty())
+            return Match::Ancestor;
+        // Included: some pattern equals relDir or is a parent of it. Only the
+        // patterns sorting at or before relDir can be such prefixes.
+        auto it = std::upper_bound(dirs_.begin(), dirs_.end(), relDir);
+        for (auto p = it; p != dirs_.begin();)
+        {
+            --p;
+            if (relDir.compare(0, p->size(), *p) == 0 &&
+                (relDir.size() == p->size() || relDir[p->size()] == '/'))
+                return Match::Included;
+            if (p->compare(0, 1, relDir, 0, 1) != 0)
+                break;
+        }
+        // Ancestor: some pattern lives below relDir; those sort right after it.
+        auto prefix = relDir + "/";
+        auto q = std::lower_bound(dirs_.begin(), dirs_.end(), prefix);
+        if (q != dirs_.end() && q->compare(0, prefix.size(), prefix) == 0)
+            return Match::Ancestor;
+        return Match::Excluded;
+    }
+
+}
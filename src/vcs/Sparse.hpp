@@ -0,0 +1,37 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace vcs
+{
+    namespace fs = std::filesystem;
+
+    // Cone-mode sparse checkout: the spec is a list of directories. A directory
+    // is Included if it is one of them or below one, an Ancestor if one of them
+    // lies below it (its own files are kept, its subtrees are filtered), and
+    // Excluded otherwise. An empty spec includes everything.
+    class SparseSpec
+    {
+    public:
+        enum class Match
+        {
+            Excluded,
+            Ancestor,
+            Included
+        };
+
+        bool load(const fs::path &file);
+        bool save(const fs::path &file) const;
+
+        void set(std::vector<std::string> dirs);
+        const std::vector<std::string> &dirs() const { return dirs_; }
+        bool active() const { return !dirs_.empty(); }
+
+        Match matchDir(const std::string &relDir) const; // "" is the root
+
+    private:
+        std::vector<std::string> dirs_; // sorted, no trailing '/'
+    };
+
+}
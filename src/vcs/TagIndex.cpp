@@ -0,0 +1,183 @@
+#include "vcs/TagIndex.hpp"
+#include "fs/LockFile.hpp"
+#include "util/Trace.hpp"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+
+namespace vcs
+{
+
+    bool validTag(const std::string &tag)
+    {
+        auto eq = tag.find('=');
+        if (eq == std::string::npos || eq == 0)
+            return false;
+        for (size_t i = 0; i < tag.size(); i++)
+        {
+            char c = tag[i];
+            if (c == '\t' || c == '\n' || c == '\r' || (i < eq && std::isspace((unsigned char)c)))
+                return false;
+        }
+        return true;
+    }
+
+    TagIndex::TagIndex(fs::path file) : file_(std::move(file)) {}
+
+    void TagIndex::refresh() const
+    {
+        std::error_code ec;
+        auto size = fs::file_size(file_, ec);
+        if (ec)
+            size = 0;
+        if (size < offset_)
+        {
+            // Replaced or removed: start over.
+            paths_.clear();
+            commits_.clear();
+            objects_.clear();
+            indexedCommits_.clear();
+            offset_ = 0;
+        }
+        if (size == offset_)
+            return;
+        util::TraceScope scope("tags.load");
+        std::ifstream in(file_, std::ios::binary);
+        in.seekg((std::streamoff)offset_);
+        std::string data(size - offset_, '\0');
+        in.read(&data[0], (std::streamsize)data.size());
+        data.resize((size_t)in.gcount());
+        util::Trace::add(util::Counter::BytesRead, data.size());
+        // Only whole lines; a partial one is finished by its writer.
+        size_t pos = 0;
+        for (size_t eol; (eol = data.find('\n', pos)) != std::string::npos; pos = eol + 1)
+            apply(data.substr(pos, eol - pos));
+        offset_ += pos;
+    }
+
+    void TagIndex::apply(const std::string &line) const
+    {
+        std::vector<std::string> f;
+        size_t pos = 0;
+        while (f.size() < 3)
+        {
+            auto tab = line.find('\t', pos);
+            if (tab == std::string::npos)
+                break;
+            f.push_back(line.substr(pos, tab - pos));
+            pos = tab + 1;
+        }
+        f.push_back(line.substr(pos)); // a path may not hold a tab, but keep the rest whole
+        if (f[0] == "P" && f.size() == 4)
+        {
+            if (!objects_.count(f[2]))
+                paths_[f[1]][f[2]].push_back(f[3]);
+        }
+        else if (f[0] == "O" && f.size() == 2)
+        {
+            objects_.insert(f[1]);
+        }
+        else if (f[0] == "C" && f.size() == 3)
+        {
+            if (!indexedCommits_.count(f[2]))
+                commits_[f[1]].push_back(f[2]);
+        }
+        else if (f[0] == "K" && f.size() == 2)
+        {
+            indexedCommits_.insert(f[1]);
+        }
+    }
+
+    bool TagIndex::append(const std::string &lines)
+    {
+        fsops::LockFile lock(file_);
+        if (!lock.acquire())
+            return false;
+        // Appends hold the lock, so a partial last line was left by a writer
+        // that died; cut it off rather than let our first line merge with it.
+        refresh();
+        std::error_code ec;
+        if (fs::file_size(file_, ec) > offset_ && !ec)
+        {
+            fs::resize_file(file_, offset_, ec);
+            if (ec)
+                return false;
+        }
+        util::Trace::add(util::Counter::BytesWritten, lines.size());
+        std::ofstream out(file_, std::ios::binary | std::ios::app);
+        out.write(lines.data(), (std::streamsize)lines.size());
+        out.close();
+        refresh();
+        return !out.fail();
+    }
+
+    bool TagIndex::hasObject(const std::string &tagsHash) const
+    {
+        refresh();
+        return objects_.count(tagsHash) > 0;
+    }
+
+    bool TagIndex::hasCommit(const std::string &commit) const
+    {
+        refresh();
+        return indexedCommits_.count(commit) > 0;
+    }
+
+    bool TagIndex::addObject(const std::string &tagsHash, const std::vector<TagEntry> &entries)
+    {
+        if (hasObject(tagsHash))
+            return true;
+        std::string lines;
+        for (auto &e : entries)
+            if (!e.path.empty())
+                lines.append("P\t").append(e.tag).append(1, '\t').append(tagsHash).append(1, '\t').append(e.path).append(1, '\n');
+        lines.append("O\t").append(tagsHash).append(1, '\n');
+        return append(lines);
+    }
+
+    bool TagIndex::addCommits(const std::vector<std::pair<std::string, std::vector<std::string>>> &commits)
+    {
+        refresh();
+        std::string lines;
+        for (auto &c : commits)
+        {
+            if (indexedCommits_.count(c.first))
+                continue;
+            for (auto &t : c.second)
+                lines.append("C\t").append(t).append(1, '\t').append(c.first).append(1, '\n');
+            lines.append("K\t").append(c.first).append(1, '\n');
+        }
+        return lines.empty() || append(lines);
+    }
+
+    std::vector<std::string> TagIndex::paths(const std::string &tag, const std::string &tagsHash) const
+    {
+        refresh();
+        std::vector<std::string> out;
+        auto t = paths_.find(tag);
+        if (t == paths_.end())
+            return out;
+        auto o = t->second.find(tagsHash);
+        if (o == t->second.end())
+            return out;
+        out = o->second;
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+        return out;
+    }
+
+    std::vector<std::string> TagIndex::commits(const std::string &tag) const
+    {
+        refresh();
+        std::vector<std::string> out;
+        auto t = commits_.find(tag);
+        if (t == commits_.end())
+            return out;
+        std::unordered_set<std::string> seen;
+        for (auto &c : t->second)
+            if (seen.insert(c).second)
+                out.push_back(c);
+        return out;
+    }
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "vcs/ObjectStore.hpp"
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace vcs
+{
+    namespace fs = std::filesystem;
+
+    // "key=value": a non-empty key without '=' or whitespace, and a value
+    // without tabs or newlines.
+    bool validTag(const std::string &tag);
+
+    // `.chronofs/tag-index`: inverted index from each "key=value" to the
+    // paths carrying it in a tags object and to the commits tagged with it.
+    // The file is an append-only log of tab-separated lines:
+    //   P <tag> <tagsObject> <path>
+    //   O <tagsObject>             every P line of the object precedes it
+    //   C <tag> <commit>
+    //   K <commit>                 every C line of the commit precedes it
+    // Appends hold `tag-index.lock`, first cut off a torn last line, and go
+    // out in one write ending with the completion marks, so a crash leaves
+    // at most unmarked lines that are indexed again later (duplicates are
+    // dropped). A query is one hash
+    // lookup; the file is read once and then only from where the last read
+    // stopped, so other processes' appends are picked up cheaply.
+    class TagIndex
+    {
+    public:
+        explicit TagIndex(fs::path file);
+
+        bool hasObject(const std::string &tagsHash) const;
+        bool hasCommit(const std::string &commit) const;
+
+        // Indexes the path entries of one tags object (commit-level entries,
+        // with an empty path, are recorded per commit by addCommits).
+        bool addObject(const std::string &tagsHash, const std::vector<TagEntry> &entries);
+        // (commit, its commit-level tags), in one append.
+        bool addCommits(const std::vector<std::pair<std::string, std::vector<std::string>>> &commits);
+
+        std::vector<std::string> paths(const std::string &tag, const std::string &tagsHash) const; // sorted
+        std::vector<std::string> commits(const std::string &tag) const;                            // in indexing order
+
+    private:
+        fs::path file_;
+        // tag -> tags object -> paths, and tag -> commits.
+        mutable std::unordered_map<std::string, std::unordered_map<std::string, std::vector<std::string>>> paths_;
+        mutable std::unordered_map<std::string, std::vector<std::string>> commits_;
+        mutable std::unordered_set<std::string> objects_, indexedCommits_;
+        mutable uintmax_t offset_ = 0; // bytes of the file applied so far
+
+        void refresh() const;
+        void apply(const std::string &line) const;
+        bool append(const std::string &lines);
+    };
+
+}
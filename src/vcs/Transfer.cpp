@@ -0,0 +1,223 @@
+#include "vcs/Transfer.hpp"
+#include "util/Trace.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <unordered_map>
+
+namespace vcs
+{
+
+    PackWriter::PackWriter(const ObjectStore &store) : store_(store) {}
+
+    std::vector<std::string> PackWriter::missingCommits(const std::vector<std::string> &wants,
+                                                        const std::vector<std::string> &haves) const
+    {
+        util::TraceScope scope("pack.negotiate");
+        enum : unsigned char
+        {
+            Seen = 1,
+            Common = 2
+        };
+        struct Item
+        {
+            long long ts;
+            bool common; // as pushed; ties (same second) pop common commits first
+            std::string hash;
+            bool operator<(const Item &o) const { return ts != o.ts ? ts < o.ts : !common && o.common; }
+        };
+        std::unordered_map<std::string, unsigned char> flags;
+        std::vector<Item> heap;
+        auto push = [&](const std::string &h, bool common)
+        {
+            auto &f = flags[h];
+            if (f & Seen)
+            {
+                // Still queued, or already sent when clock skew put it ahead
+                // of its descendants; either way, only the mark can change.
+                if (common)
+                    f |= Common;
+                return;
+            }
+            f = Seen | (common ? Common : 0);
+            std::string tree, author, msg;
+            std::vector<std::string> parents;
+            long long ts = 0;
+            store_.readCommit(h, tree, parents, author, ts, msg);
+            heap.push_back({ts, common, h});
+            std::push_heap(heap.begin(), heap.end());
+        };
+        auto anyLive = [&]
+        {
+            for (auto &it : heap)
+                if (!(flags[it.hash] & Common))
+                    return true;
+            return false;
+        };
+        for (auto &h : haves)
+            if (!h.empty() && store_.exists(h))
+                push(h, true);
+        for (auto &w : wants)
+            push(w, false);
+
+        std::vector<std::string> out;
+        while (!heap.empty() && anyLive())
+        {
+            std::pop_heap(heap.begin(), heap.end());
+            auto hash = std::move(heap.back().hash);
+            heap.pop_back();
+            bool common = flags[hash] & Common;
+            std::string tree, author, msg;
+            std::vector<std::string> parents;
+            long long ts = 0;
+            if (!store_.readCommit(hash, tree, parents, author, ts, msg))
+                continue;
+            if (!common)
+                out.push_back(hash);
+            for (auto &p : parents)
+                push(p, common);
+        }
+        return out;
+    }
+
+    void PackWriter::emit(const std::string &hash)
+    {
+        if (!sent_.insert(hash).second)
+            return;
+        std::string content;
+        if (!store_.readRaw(hash, content))
+        {
+            ok_ = false;
+            return;
+        }
+        *out_ << hash << ' ' << content.size() << '\n';
+        out_->write(content.data(), (std::streamsize)content.size());
+        stats_->objects++;
+        stats_->bytes += content.size();
+    }
+
+    void PackWriter::emitTreeDelta(const std::string &tree, const std::string &base)
+    {
+        if (tree == base || sent_.count(tree))
+            return;
+        std::vector<TreeEntry> entries, baseEntries;
+        if (!store_.readTree(tree, entries) || (!base.empty() && !store_.readTree(base, baseEntries)))
+        {
+            ok_ = false;
+            return;
+        }
+        std::unordered_map<std::string, const TreeEntry *> byName;
+        for (auto &b : baseEntries)
+            byName.emplace(b.name, &b);
+        emit(tree);
+        for (auto &e : entries)
+        {
+            auto it = byName.find(e.name);
+            const TreeEntry *b = it == byName.end() ? nullptr : it->second;
+            if (b && b->hash == e.hash)
+                continue;
+            if (e.mode == "040000")
+                emitTreeDelta(e.hash, b && b->mode == "040000" ? b->hash : "");
+            else
+                emit(e.hash);
+        }
+    }
+
+    bool PackWriter::write(const std::vector<std::string> &wants, const std::vector<std::string> &haves,
+                           std::ostream &out, TransferStats &stats)
+    {
+        util::TraceScope scope("pack.write");
+        out_ = &out;
+        stats_ = &stats;
+        out << "chronofs-pack 1\n";
+        auto commits = missingCommits(wants, haves);
+        stats.commits = commits.size();
+        for (auto &c : commits)
+        {
+            std::string tree, author, msg, tags, baseTree, ptree, ptags;
+            std::vector<std::string> parents, pparents;
+            long long ts = 0;
+            if (!store_.readCommit(c, tree, parents, author, ts, msg, &tags))
+            {
+                ok_ = false;
+                continue;
+            }
+            emit(c);
+            std::string baseTags;
+            if (!parents.empty() && store_.readCommit(parents[0], ptree, pparents, author, ts, msg, &ptags))
+            {
+                baseTree = ptree;
+                baseTags = ptags;
+            }
+            if (!tags.empty() && tags != baseTags)
+                emit(tags);
+            emitTreeDelta(tree, baseTree);
+        }
+        out << "end " << stats.objects << '\n';
+        return ok_ && out.good();
+    }
+
+    namespace
+    {
+        constexpr size_t kReadChunk = 1 << 20;
+    }
+
+    bool unpackObjects(ObjectStore &store, std::istream &in, TransferStats &stats, std::string &error)
+    {
+        util::TraceScope scope("pack.read");
+        std::string line;
+        if (!std::getline(in, line) || line != "chronofs-pack 1")
+        {
+            error = "not a chronofs pack";
+            return false;
+        }
+        size_t count = 0;
+        while (std::getline(in, line))
+        {
+            if (line.rfind("end ", 0) == 0)
+            {
+                if (std::strtoull(line.c_str() + 4, nullptr, 10) != count)
+                {
+                    error = "pack object count mismatch";
+                    return false;
+                }
+                return true;
+            }
+            auto sp = line.find(' ');
+            char *end = nullptr;
+            size_t size = sp == 64 ? std::strtoull(line.c_str() + sp + 1, &end, 10) : 0;
+            if (sp != 64 || end == line.c_str() + sp + 1 || *end != '\0')
+            {
+                error = "malformed pack entry";
+                return false;
+            }
+            auto hash = line.substr(0, sp);
+            // The size is untrusted until the bytes arrive: read in bounded
+            // chunks, so a corrupt header ends as a truncated pack instead of
+            // one huge allocation.
+            std::string content;
+            while (content.size() < size && in)
+            {
+                auto chunk = std::min<size_t>(size - content.size(), kReadChunk);
+                auto at = content.size();
+                content.resize(at + chunk);
+                in.read(&content[at], (std::streamsize)chunk);
+                content.resize(at + (size_t)in.gcount());
+            }
+            if (content.size() != size)
+                break;
+            count++;
+            bool had = store.exists(hash);
+            // Existing objects are written too: that freshens them against a concurrent gc.
+            if (!store.storeRaw(hash, content))
+            {
+                error = "object " + hash + " does not match its content";
+                return false;
+            }
+            if (!had)
+                stats.stored++;
+        }
+        error = "truncated pack";
+        return false;
+    }
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "vcs/ObjectStore.hpp"
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace vcs
+{
+
+    struct TransferStats
+    {
+        size_t commits = 0;  // commits the receiver lacked
+        size_t objects = 0;  // objects in the pack
+        uintmax_t bytes = 0; // object bytes in the pack
+        size_t stored = 0;   // objects the receiver did not already have
+    };
+
+    // Pack stream: "chronofs-pack 1\n", then per object "<hash> <size>\n"
+    // followed by its loose-layout content, then "end <count>\n". Every
+    // object is checked against its hash on arrival, and the trailer
+    // catches truncation.
+    //
+    // The sender gets the receiver's ref tips as `haves` (the receiver has
+    // everything below them) and the commits it wants to send. Histories
+    // are painted newest first, as in mergeBase, marking everything below a
+    // have the sender also knows as common; the walk stops once only common
+    // commits are queued, so it reads just the commits the receiver lacks
+    // and the few around the boundary. For each missing commit only the
+    // part of its tree that differs from its first parent's is listed,
+    // skipping any subtree whose hash matches. Whatever matches is either at
+    // the receiver or sent with that parent, so the pack grows with the
+    // changes rather than with history or tree size.
+    class PackWriter
+    {
+    public:
+        explicit PackWriter(const ObjectStore &store);
+
+        bool write(const std::vector<std::string> &wants, const std::vector<std::string> &haves,
+                   std::ostream &out, TransferStats &stats);
+
+    private:
+        const ObjectStore &store_;
+        std::unordered_set<std::string> sent_;
+        std::ostream *out_ = nullptr;
+        TransferStats *stats_ = nullptr;
+        bool ok_ = true;
+
+        std::vector<std::string> missingCommits(const std::vector<std::string> &wants,
+                                                const std::vector<std::string> &haves) const;
+        void emit(const std::string &hash);
+        void emitTreeDelta(const std::string &tree, const std::string &base);
+    };
+
+    // Stores every object in the stream that `store` lacks. False, with
+    // `error` set, on a malformed or truncated stream or a hash mismatch;
+    // objects stored before that point are left for gc.
+    bool unpackObjects(ObjectStore &store, std::istream &in, TransferStats &stats, std::string &error);
+
+}